@@ -1,41 +1,281 @@
+#include <stdlib.h>
+#include <omp.h>
 #include "centroid.h"
 
-void test_mean1(double *xymean, double* xy, int n)
+/*
+ * All three layouts reduce to summing a contiguous stream of doubles in
+ * which element e belongs to coordinate (e/B) % d, with B = 1 for AoS
+ * (and for each coordinate array of SoA, with d = 1) and B =
+ * POINTS_BLOCK for AoSoA.  We sum the stream into nv independent
+ * vector accumulators, with nv*VW lanes a multiple of d*B so that each
+ * lane always sees the same coordinate, and fold the lanes at the end.
+ * Using (at least) eight accumulators hides the latency of the adds,
+ * which a single scalar accumulator per coordinate serializes on.
+ *
+ * The vector width depends on the instruction set we are compiled for
+ * (e.g. with -xHost or -march=native); without AVX2 the same code runs
+ * with scalar accumulators.
+ */
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+typedef __m512d vec_t;
+#define VW 8
+#define vzero()     _mm512_setzero_pd()
+#define vload(p)    _mm512_loadu_pd(p)
+#define vstore(p,v) _mm512_storeu_pd(p,v)
+#define vadd(a,b)   _mm512_add_pd(a,b)
+#define vsub(a,b)   _mm512_sub_pd(a,b)
+
+#elif defined(__AVX2__)
+
+#include <immintrin.h>
+typedef __m256d vec_t;
+#define VW 4
+#define vzero()     _mm256_setzero_pd()
+#define vload(p)    _mm256_loadu_pd(p)
+#define vstore(p,v) _mm256_storeu_pd(p,v)
+#define vadd(a,b)   _mm256_add_pd(a,b)
+#define vsub(a,b)   _mm256_sub_pd(a,b)
+
+#else
+
+typedef double vec_t;
+#define VW 1
+#define vzero()     0.0
+#define vload(p)    (*(p))
+#define vstore(p,v) (*(p) = (v))
+#define vadd(a,b)   ((a)+(b))
+#define vsub(a,b)   ((a)-(b))
+
+#endif
+
+#define MIN_ACC 8    /* Minimum number of independent accumulators */
+#define MAX_ACC 32   /* Maximum number of vector accumulators */
+
+
+/*
+ * Sum nper periods of nv vectors each into lane sums s and (for Kahan
+ * summation) compensations c.  This is always inlined so that calls with
+ * constant nv and kahan keep the accumulators in registers.
+ */
+static inline __attribute__((always_inline))
+void sum_stream(double* restrict s, double* restrict c,
+                const double* restrict x, size_t nper, int nv, int kahan)
 {
-    int i;
-    double xsum = 0;
-    double ysum = 0;
-    for (i = 0; i < 2*n; i += 2) {
-        xsum += xy[i+0];
-        ysum += xy[i+1];
+    vec_t acc[MAX_ACC], comp[MAX_ACC];
+    for (int j = 0; j < nv; ++j) {
+        acc[j] = vzero();
+        comp[j] = vzero();
+    }
+    for (size_t p = 0; p < nper; ++p, x += nv*VW) {
+        if (kahan) {
+            for (int j = 0; j < nv; ++j) {
+                vec_t y = vsub(vload(x + j*VW), comp[j]);
+                vec_t t = vadd(acc[j], y);
+                comp[j] = vsub(vsub(t, acc[j]), y);
+                acc[j] = t;
+            }
+        } else {
+            for (int j = 0; j < nv; ++j)
+                acc[j] = vadd(acc[j], vload(x + j*VW));
+        }
     }
-    xymean[0] = xsum/n;
-    xymean[1] = ysum/n;
+    for (int j = 0; j < nv; ++j) {
+        vstore(s + j*VW, acc[j]);
+        vstore(c + j*VW, comp[j]);
+    }
+}
+
+
+static void sum_stream_plain8(double* s, double* c, const double* x,
+                              size_t nper)
+{
+    sum_stream(s, c, x, nper, MIN_ACC, 0);
 }
 
-void test_mean2(double *xymean, double* xy, int n)
+static void sum_stream_kahan8(double* s, double* c, const double* x,
+                              size_t nper)
 {
-    int i;
-    double xsum = 0;
-    double ysum = 0;
-    for (i = 0; i < 2*n; i += 2) 
-        xsum += xy[i+0];
-    for (i = 0; i < 2*n; i += 2)
-        ysum += xy[i+1];
-    xymean[0] = xsum/n;
-    xymean[1] = ysum/n;
+    sum_stream(s, c, x, nper, MIN_ACC, 1);
 }
 
-void test_mean3(double *xymean, double* xy, int n)
+static void sum_stream_plain(double* s, double* c, const double* x,
+                             size_t nper, int nv)
 {
-    int i;
-    double xsum = 0;
-    double ysum = 0;
-    for (i = 0; i < n; ++i)
-        xsum += xy[i];
-    for (i = n; i < 2*n; ++i)
-        ysum += xy[i];
-    xymean[0] = xsum/n;
-    xymean[1] = ysum/n;
+    sum_stream(s, c, x, nper, nv, 0);
 }
 
+static void sum_stream_kahan(double* s, double* c, const double* x,
+                             size_t nper, int nv)
+{
+    sum_stream(s, c, x, nper, nv, 1);
+}
+
+
+static int gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+/*
+ * Add the m-element stream x into the coordinate sums s and
+ * compensations c, where element e belongs to coordinate (e/B) % d.
+ */
+static void reduce(double* s, double* c, const double* x, size_t m,
+                   int d, int B, int kahan)
+{
+    double ls[MAX_ACC*VW], lc[MAX_ACC*VW];
+    int period = d*B;
+    int nv = period / gcd(period, VW);
+    size_t done = 0;
+
+    if (nv <= MAX_ACC) {
+        nv *= (MIN_ACC + nv-1) / nv;
+        size_t nper = m / (nv*VW);
+        if (nv == MIN_ACC && kahan)
+            sum_stream_kahan8(ls, lc, x, nper);
+        else if (nv == MIN_ACC)
+            sum_stream_plain8(ls, lc, x, nper);
+        else if (kahan)
+            sum_stream_kahan(ls, lc, x, nper, nv);
+        else
+            sum_stream_plain(ls, lc, x, nper, nv);
+        for (int l = 0; l < nv*VW; ++l)
+            sum_add(s + (l/B)%d, c + (l/B)%d, ls[l] - lc[l], kahan);
+        done = nper * nv*VW;
+    }
+
+    for (size_t e = done; e < m; ++e)
+        sum_add(s + (e/B)%d, c + (e/B)%d, x[e], kahan);
+}
+
+
+points_t* points_alloc(layout_t layout, int dim, size_t n)
+{
+    size_t np = n;
+    void* data;
+    if (layout == POINTS_AOSOA)
+        np = (n + POINTS_BLOCK-1) / POINTS_BLOCK * POINTS_BLOCK;
+    if (posix_memalign(&data, 64, np * dim * sizeof(double)) != 0)
+        return NULL;
+    points_t* pts = (points_t*) malloc(sizeof(points_t));
+    pts->layout = layout;
+    pts->dim = dim;
+    pts->n = n;
+    pts->data = (double*) data;
+    return pts;
+}
+
+
+void points_free(points_t* pts)
+{
+    free(pts->data);
+    free(pts);
+}
+
+
+void points_sum(double* sum, const points_t* pts, size_t i0, size_t i1,
+                int flags)
+{
+    int d = pts->dim;
+    int kahan = (flags & CENTROID_KAHAN);
+    double* s = (double*) calloc(2*d, sizeof(double));
+    double* c = s + d;
+    const double* x = pts->data;
+
+    if (pts->layout == POINTS_AOS) {
+        reduce(s, c, x + i0*d, (i1-i0)*d, d, 1, kahan);
+    } else if (pts->layout == POINTS_SOA) {
+        for (int k = 0; k < d; ++k)
+            reduce(s+k, c+k, x + k*pts->n + i0, i1-i0, 1, 1, kahan);
+    } else {
+        /* Whole blocks in the middle, partial blocks point by point */
+        size_t b0 = (i0 + POINTS_BLOCK-1) / POINTS_BLOCK;
+        size_t b1 = i1 / POINTS_BLOCK;
+        size_t head = (b0*POINTS_BLOCK < i1) ? b0*POINTS_BLOCK : i1;
+        size_t tail = (b1*POINTS_BLOCK > head) ? b1*POINTS_BLOCK : head;
+        for (size_t i = i0; i < head; ++i)
+            for (int k = 0; k < d; ++k)
+                sum_add(s+k, c+k, x[points_offset(pts, i, k)], kahan);
+        if (b0 < b1)
+            reduce(s, c, x + b0*d*POINTS_BLOCK, (b1-b0)*d*POINTS_BLOCK,
+                   d, POINTS_BLOCK, kahan);
+        for (size_t i = tail; i < i1; ++i)
+            for (int k = 0; k < d; ++k)
+                sum_add(s+k, c+k, x[points_offset(pts, i, k)], kahan);
+    }
+
+    for (int k = 0; k < d; ++k)
+        sum[k] = s[k] - c[k];
+    free(s);
+}
+
+
+void centroid(double* mean, const points_t* pts, int flags)
+{
+    points_sum(mean, pts, 0, pts->n, flags);
+    for (int k = 0; k < pts->dim; ++k)
+        mean[k] /= pts->n;
+}
+
+
+void points_chunk_range(const points_t* pts, int c, size_t* i0, size_t* i1)
+{
+    size_t nb = (pts->n + POINTS_BLOCK-1) / POINTS_BLOCK;
+    size_t b0 = nb * c / CENTROID_CHUNKS;
+    size_t b1 = nb * (c+1) / CENTROID_CHUNKS;
+    *i0 = b0 * POINTS_BLOCK;
+    *i1 = (b1 * POINTS_BLOCK < pts->n) ? b1 * POINTS_BLOCK : pts->n;
+}
+
+
+void points_thread_range(const points_t* pts, int t, int nt,
+                         size_t* i0, size_t* i1)
+{
+    int c0 = CENTROID_CHUNKS * t / nt;
+    int c1 = CENTROID_CHUNKS * (t+1) / nt;
+    size_t dummy;
+    points_chunk_range(pts, c0, i0, &dummy);
+    if (c1 > c0)
+        points_chunk_range(pts, c1-1, &dummy, i1);
+    else
+        *i1 = *i0;
+}
+
+
+void centroid_parallel(double* mean, const points_t* pts, int flags)
+{
+    int d = pts->dim;
+    double* sums = (double*) malloc(CENTROID_CHUNKS * d * sizeof(double));
+
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int c0 = CENTROID_CHUNKS * t / nt;
+        int c1 = CENTROID_CHUNKS * (t+1) / nt;
+        for (int c = c0; c < c1; ++c) {
+            size_t i0, i1;
+            points_chunk_range(pts, c, &i0, &i1);
+            points_sum(sums + c*d, pts, i0, i1, flags);
+        }
+    }
+
+    /* Combine in a fixed order for reproducible results */
+    int kahan = (flags & CENTROID_KAHAN);
+    for (int k = 0; k < d; ++k) {
+        double s = 0, comp = 0;
+        for (int c = 0; c < CENTROID_CHUNKS; ++c)
+            sum_add(&s, &comp, sums[c*d + k], kahan);
+        mean[k] = (s - comp) / pts->n;
+    }
+    free(sums);
+}
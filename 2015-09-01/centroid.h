@@ -1,8 +1,112 @@
 #ifndef CENTROID_H
 #define CENTROID_H
 
-void test_mean1(double *xymean, double* xy, int n);
-void test_mean2(double *xymean, double* xy, int n);
-void test_mean3(double *xymean, double* xy, int n);
+#include <stddef.h>
+
+/*
+ * Point sets with dim coordinates per point, in one of three layouts:
+ *
+ *   POINTS_AOS:   x0 y0 x1 y1 x2 y2 ...          (interleaved)
+ *   POINTS_SOA:   x0 x1 x2 ... y0 y1 y2 ...      (split)
+ *   POINTS_AOSOA: blocks of POINTS_BLOCK points, split within a block
+ *                 (x0..x7 y0..y7 x8..x15 y8..y15 ...); the last block
+ *                 is padded to a full block.
+ */
+typedef enum {
+    POINTS_AOS,
+    POINTS_SOA,
+    POINTS_AOSOA
+} layout_t;
+
+#define POINTS_BLOCK 8
+
+typedef struct points_t {
+    layout_t layout;  /* Data layout */
+    int dim;          /* Coordinates per point */
+    size_t n;         /* Number of points */
+    double* data;     /* Coordinate data (64-byte aligned if allocated) */
+} points_t;
+
+/* Offset of coordinate c of point i in the data array */
+static inline size_t points_offset(const points_t* pts, size_t i, int c)
+{
+    size_t d = pts->dim;
+    switch (pts->layout) {
+    case POINTS_SOA:
+        return c*pts->n + i;
+    case POINTS_AOSOA:
+        return (i/POINTS_BLOCK)*d*POINTS_BLOCK + c*POINTS_BLOCK +
+            i%POINTS_BLOCK;
+    default:
+        return i*d + c;
+    }
+}
+
+/* Allocate an (uninitialized) point set, and free it */
+points_t* points_alloc(layout_t layout, int dim, size_t n);
+void points_free(points_t* pts);
+
+/* Flags for the reductions */
+#define CENTROID_KAHAN 1   /* Use compensated (Kahan) summation */
+
+/* Add x to the sum s with compensation c (if kahan is set) */
+static inline void sum_add(double* s, double* c, double x, int kahan)
+{
+    if (kahan) {
+        double y = x - *c;
+        double t = *s + y;
+        *c = (t - *s) - y;
+        *s = t;
+    } else {
+        *s += x;
+    }
+}
+
+/* Coordinate sums of points [i0, i1); sum has dim entries */
+void points_sum(double* sum, const points_t* pts, size_t i0, size_t i1,
+                int flags);
+
+/* Centroid of a point set; mean has dim entries */
+void centroid(double* mean, const points_t* pts, int flags);
+
+/*
+ * Parallel centroid.  The points are split into CENTROID_CHUNKS chunks
+ * (on AoSoA block boundaries), and thread t of nt takes a contiguous
+ * range of chunks given by points_thread_range.  Initializing the data
+ * with the same ranges places each thread's pages on its own socket
+ * (first touch).  The chunk sums are combined in chunk order, so the
+ * result does not depend on the number of threads.
+ */
+#define CENTROID_CHUNKS 1024
+
+void points_chunk_range(const points_t* pts, int c, size_t* i0, size_t* i1);
+void points_thread_range(const points_t* pts, int t, int nt,
+                         size_t* i0, size_t* i1);
+void centroid_parallel(double* mean, const points_t* pts, int flags);
+
+/*
+ * Point files hold a 64-byte header (the magic string "POINTS01", then
+ * the layout and dimension as 32-bit ints and the number of points as
+ * a 64-bit int) followed by the data in AoS or SoA layout.
+ *
+ * points_file_write writes n points with coordinates value(i, k), a
+ * chunk at a time, so the file can be larger than memory.
+ *
+ * centroid_file computes the centroid of a point file without loading
+ * it: the file is memory-mapped and reduced chunk_bytes at a time, and
+ * before reducing each chunk we ask the kernel to start reading the
+ * next one (MADV_WILLNEED) and drop the last one (MADV_DONTNEED), so
+ * that the disk reads overlap the arithmetic.  If nbytes is not NULL,
+ * it gets the number of data bytes read.
+ *
+ * points_file_dim returns the dimension of the points in a file.
+ *
+ * All return -1 (with a message) on failure.
+ */
+int points_file_write(const char* fname, layout_t layout, int dim, size_t n,
+                      double (*value)(size_t i, int k));
+int points_file_dim(const char* fname);
+int centroid_file(double* mean, const char* fname, int flags,
+                  size_t chunk_bytes, size_t* nbytes);
 
 #endif /* CENTROID_H */
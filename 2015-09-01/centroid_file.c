@@ -0,0 +1,194 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "centroid.h"
+
+#define POINTS_MAGIC "POINTS01"
+#define POINTS_HEADER 64
+
+
+typedef struct points_header_t {
+    char magic[8];
+    int32_t layout;
+    int32_t dim;
+    int64_t n;
+} points_header_t;
+
+
+int points_file_write(const char* fname, layout_t layout, int dim, size_t n,
+                      double (*value)(size_t i, int k))
+{
+    char header[POINTS_HEADER] = {0};
+    points_header_t h;
+    size_t chunk = (1 << 20) / dim;
+    double* buf = (double*) malloc(chunk * dim * sizeof(double));
+    FILE* fp;
+
+    if (layout != POINTS_AOS && layout != POINTS_SOA) {
+        fprintf(stderr, "Point files must be AoS or SoA\n");
+        free(buf);
+        return -1;
+    }
+    fp = fopen(fname, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open point file: %s\n", fname);
+        free(buf);
+        return -1;
+    }
+
+    memcpy(h.magic, POINTS_MAGIC, 8);
+    h.layout = layout;
+    h.dim = dim;
+    h.n = n;
+    memcpy(header, &h, sizeof(h));
+    fwrite(header, 1, POINTS_HEADER, fp);
+
+    if (layout == POINTS_AOS) {
+        for (size_t i0 = 0; i0 < n; i0 += chunk) {
+            size_t m = (n-i0 < chunk) ? n-i0 : chunk;
+            for (size_t i = 0; i < m; ++i)
+                for (int k = 0; k < dim; ++k)
+                    buf[i*dim+k] = value(i0+i, k);
+            fwrite(buf, sizeof(double), m*dim, fp);
+        }
+    } else {
+        for (int k = 0; k < dim; ++k)
+            for (size_t i0 = 0; i0 < n; i0 += chunk*dim) {
+                size_t m = (n-i0 < chunk*dim) ? n-i0 : chunk*dim;
+                for (size_t i = 0; i < m; ++i)
+                    buf[i] = value(i0+i, k);
+                fwrite(buf, sizeof(double), m, fp);
+            }
+    }
+
+    free(buf);
+    if (ferror(fp) | fclose(fp)) {
+        fprintf(stderr, "Error writing point file: %s\n", fname);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Apply advice to the pages of points [i0, i1) (of every coordinate
+ * array, for SoA); base is the page-aligned start of the mapping
+ */
+static void advise(const points_t* pts, char* base, size_t i0, size_t i1,
+                   int advice)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    int nregions = (pts->layout == POINTS_SOA) ? pts->dim : 1;
+    size_t width = (pts->layout == POINTS_SOA) ? 1 : pts->dim;
+    for (int k = 0; k < nregions; ++k) {
+        char* lo = (char*) (pts->data + points_offset(pts, i0, k));
+        char* hi = lo + (i1-i0) * width * sizeof(double);
+        lo = base + (lo - base) / page * page;
+        if (hi > lo)
+            madvise(lo, hi-lo, advice);
+    }
+}
+
+
+/*
+ * Open a point file and check its header; returns the descriptor
+ */
+static int open_points(const char* fname, points_header_t* h, off_t* size)
+{
+    struct stat st;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Could not open point file: %s\n", fname);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if (st.st_size < POINTS_HEADER ||
+        pread(fd, h, sizeof(*h), 0) != sizeof(*h) ||
+        memcmp(h->magic, POINTS_MAGIC, 8) != 0 ||
+        (h->layout != POINTS_AOS && h->layout != POINTS_SOA) || h->dim < 1 ||
+        (size_t) st.st_size < POINTS_HEADER + h->n*h->dim*sizeof(double)) {
+        fprintf(stderr, "Bad point file: %s\n", fname);
+        close(fd);
+        return -1;
+    }
+    *size = st.st_size;
+    return fd;
+}
+
+
+int points_file_dim(const char* fname)
+{
+    points_header_t h;
+    off_t size;
+    int fd = open_points(fname, &h, &size);
+    if (fd < 0)
+        return -1;
+    close(fd);
+    return h.dim;
+}
+
+
+int centroid_file(double* mean, const char* fname, int flags,
+                  size_t chunk_bytes, size_t* nbytes)
+{
+    points_header_t h;
+    points_t pts;
+    char* base;
+    off_t size;
+    int fd = open_points(fname, &h, &size);
+    if (fd < 0)
+        return -1;
+
+    base = (char*) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map point file: %s\n", fname);
+        return -1;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    pts.layout = (layout_t) h.layout;
+    pts.dim = h.dim;
+    pts.n = h.n;
+    pts.data = (double*) (base + POINTS_HEADER);
+
+    size_t chunk = chunk_bytes / (h.dim * sizeof(double));
+    int kahan = (flags & CENTROID_KAHAN);
+    double* sum = (double*) malloc(3 * h.dim * sizeof(double));
+    double* total = sum + h.dim;
+    double* comp = total + h.dim;
+    if (chunk < 1)
+        chunk = 1;
+    for (int k = 0; k < h.dim; ++k)
+        total[k] = comp[k] = 0;
+
+    if (pts.n > 0)
+        advise(&pts, base, 0, (chunk < pts.n) ? chunk : pts.n,
+               MADV_WILLNEED);
+    for (size_t i0 = 0; i0 < pts.n; i0 += chunk) {
+        size_t i1 = (pts.n-i0 < chunk) ? pts.n : i0+chunk;
+        size_t i2 = (pts.n-i1 < chunk) ? pts.n : i1+chunk;
+        if (i2 > i1)
+            advise(&pts, base, i1, i2, MADV_WILLNEED);
+        points_sum(sum, &pts, i0, i1, flags);
+        /* Compensated across chunks too, not just within each */
+        for (int k = 0; k < h.dim; ++k)
+            sum_add(total+k, comp+k, sum[k], kahan);
+        advise(&pts, base, i0, i1, MADV_DONTNEED);
+    }
+
+    for (int k = 0; k < h.dim; ++k)
+        mean[k] = (total[k] - comp[k]) / pts.n;
+    if (nbytes)
+        *nbytes = pts.n * pts.dim * sizeof(double);
+    free(sum);
+    munmap(base, size);
+    return 0;
+}
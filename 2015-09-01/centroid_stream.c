@@ -0,0 +1,148 @@
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+#include "centroid.h"
+
+
+/* Pseudo-random coordinate value for point i */
+double point_value(size_t i, int k)
+{
+    uint64_t z = ((uint64_t) i << 10) + k + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (double) ((z ^ (z >> 31)) >> 33);
+}
+
+
+/*
+ * Ask the kernel to drop the file from the page cache, so that the
+ * next pass reads from disk
+ */
+void drop_cache(const char* fname)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+
+/*
+ * Time a plain sequential read of the whole file (GB/s)
+ */
+double raw_read_rate(const char* fname)
+{
+    size_t bufsize = 8 << 20;
+    char* buf = (char*) malloc(bufsize);
+    double bytes = 0;
+    ssize_t got;
+    double t0, t1;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        free(buf);
+        return 0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    t0 = omp_get_wtime();
+    while ((got = read(fd, buf, bufsize)) > 0)
+        bytes += got;
+    t1 = omp_get_wtime();
+    close(fd);
+    free(buf);
+    return bytes/(t1-t0)/1e9;
+}
+
+
+void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [-w npoints] [-d dim] [-l aos|soa] [-c chunkMB]"
+            " [-k] file\n", name);
+    exit(-1);
+}
+
+
+/*
+ * Options:
+ *   -w npoints = first write a file of npoints generated points
+ *   -d dim = dimension of the written points (default 2)
+ *   -l layout = layout of the written file, aos or soa (default aos)
+ *   -c chunk = megabytes reduced per chunk (default 64)
+ *   -k = use Kahan summation
+ */
+int main(int argc, char** argv)
+{
+    size_t nwrite = 0;
+    int dim = 2;
+    layout_t layout = POINTS_AOS;
+    size_t chunk = 64;
+    int flags = 0;
+    const char* fname = NULL;
+    int i, k;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-k") == 0)
+            flags |= CENTROID_KAHAN;
+        else if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'w': nwrite = strtoull(argv[++i], NULL, 10); break;
+            case 'd': dim = atoi(argv[++i]); break;
+            case 'c': chunk = strtoull(argv[++i], NULL, 10); break;
+            case 'l':
+                ++i;
+                if (strcmp(argv[i], "soa") == 0)
+                    layout = POINTS_SOA;
+                else if (strcmp(argv[i], "aos") != 0)
+                    print_usage_quit(argv[0]);
+                break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else if (fname == NULL) {
+            fname = argv[i];
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    if (fname == NULL || dim < 1 || chunk < 1)
+        print_usage_quit(argv[0]);
+
+    if (nwrite) {
+        if (points_file_write(fname, layout, dim, nwrite, point_value) < 0)
+            return -1;
+    }
+
+    drop_cache(fname);
+    double raw = raw_read_rate(fname);
+    printf("Raw read: %g GB/s\n", raw);
+
+    dim = points_file_dim(fname);
+    if (dim < 0)
+        return -1;
+
+    drop_cache(fname);
+    double* mean = (double*) malloc(dim * sizeof(double));
+    size_t nbytes;
+    double t0 = omp_get_wtime();
+    if (centroid_file(mean, fname, flags, chunk << 20, &nbytes) < 0)
+        return -1;
+    double t1 = omp_get_wtime();
+    double rate = nbytes/(t1-t0)/1e9;
+
+    printf("Result:");
+    for (k = 0; k < dim; ++k)
+        printf(" %.17g", mean[k]);
+    printf("\n");
+    printf("Streaming centroid: %e s (%g GB/s, %.0f%% of raw read)\n",
+           t1-t0, rate, raw > 0 ? 100*rate/raw : 0);
+    free(mean);
+    return 0;
+}
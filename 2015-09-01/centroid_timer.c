@@ -1,44 +1,188 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
+#include <sched.h>
 #include <omp.h>
 #include "centroid.h"
+#include "bench.h"
 
 
-void time_centroid(const char* name,
-                   void (*mean)(double*, double*, int), 
-                   double* xy, int N)
+#define MAX_SOCKETS 16
+
+
+/*
+ * Pseudo-random coordinate value for entry e, computed from e alone so
+ * that any thread can fill any part of the data
+ */
+double point_value(uint64_t e)
 {
-    int i;
-    int trials = 100; 
-    double tstart, tstop;
-    double xymean[2] = {0, 0};
-    double per_trial;
-    double gflops;
-    tstart = omp_get_wtime();
-    for (i = 0; i < trials; ++i)
-        mean(xymean, xy, N);
-    tstop = omp_get_wtime();
-    per_trial = (tstop-tstart)/trials;
-    gflops = (2*N)/per_trial/1e9;
-    printf("Result: %g %g\n", xymean[0], xymean[1]);
-    printf("Version %s: %e (%g GFLop/s)\n", name, per_trial, gflops);
+    uint64_t z = e + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (double) ((z ^ (z >> 31)) >> 33);
 }
 
 
-int main()
+/*
+ * Fill the points in parallel, each thread writing the range it will
+ * later reduce, so that first touch puts the pages on its socket
+ */
+void fill_points(points_t* pts)
 {
-    int i;
-    int N = 20000000;
-    double* xy = (double*) malloc(2 * N * sizeof(double));
+    #pragma omp parallel
+    {
+        size_t i, i0, i1;
+        int k;
+        points_thread_range(pts, omp_get_thread_num(),
+                            omp_get_num_threads(), &i0, &i1);
+        for (k = 0; k < pts->dim; ++k)
+            for (i = i0; i < i1; ++i)
+                pts->data[points_offset(pts, i, k)] =
+                    point_value(i*pts->dim + k);
+    }
+}
+
+
+/*
+ * Pin each thread to its own CPU (in order) unless the OpenMP runtime
+ * is already binding threads (OMP_PROC_BIND)
+ */
+void pin_threads(void)
+{
+    cpu_set_t mask;
+    if (omp_get_proc_bind() != omp_proc_bind_false ||
+        sched_getaffinity(0, sizeof(mask), &mask) != 0)
+        return;
+
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int ncpu = CPU_COUNT(&mask);
+        int which = t % ncpu;
+        int cpu;
+        for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &mask) && which-- == 0)
+                break;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        sched_setaffinity(0, sizeof(one), &one);
+    }
+}
+
+
+/*
+ * Socket (package) of the CPU the calling thread is running on
+ */
+int current_socket(void)
+{
+    char fname[128];
+    int socket = 0;
+    FILE* fp;
+    snprintf(fname, sizeof(fname),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+             sched_getcpu());
+    fp = fopen(fname, "r");
+    if (fp) {
+        if (fscanf(fp, "%d", &socket) != 1 || socket < 0)
+            socket = 0;
+        fclose(fp);
+    }
+    return socket % MAX_SOCKETS;
+}
+
 
-    for (i = 0; i < 2*N; ++i)
-        xy[i] = random();
+typedef struct centroid_args_t {
+    const points_t* pts;
+    int flags;
+    int parallel;
+    double* mean;
+} centroid_args_t;
+
+
+void run_centroid(void* arg)
+{
+    centroid_args_t* a = (centroid_args_t*) arg;
+    if (a->parallel)
+        centroid_parallel(a->mean, a->pts, a->flags);
+    else
+        centroid(a->mean, a->pts, a->flags);
+}
+
+
+void time_centroid(bench_t* b, const char* name, const points_t* pts,
+                   int flags, int parallel)
+{
+    int k;
+    char fullname[64];
+    double n = (double) pts->dim * pts->n;
+    centroid_args_t args = {pts, flags, parallel, NULL};
+    const bench_result_t* r;
+
+    args.mean = (double*) malloc(pts->dim * sizeof(double));
+    snprintf(fullname, sizeof(fullname), "%s%s%s", name,
+             parallel ? " parallel" : "",
+             (flags & CENTROID_KAHAN) ? " (Kahan)" : "");
+    r = bench_run(b, fullname, run_centroid, &args, n, n * sizeof(double));
+    printf("Result:");
+    for (k = 0; k < pts->dim; ++k)
+        printf(" %.17g", args.mean[k]);
+    printf("\n");
+    free(args.mean);
+
+    if (parallel) {
+        /* Bytes read by the threads on each socket */
+        double bytes[MAX_SOCKETS] = {0};
+        int threads[MAX_SOCKETS] = {0};
+        #pragma omp parallel
+        {
+            size_t i0, i1;
+            int s = current_socket();
+            points_thread_range(pts, omp_get_thread_num(),
+                                omp_get_num_threads(), &i0, &i1);
+            #pragma omp critical
+            {
+                bytes[s] += (double) (i1-i0) * pts->dim * sizeof(double);
+                threads[s] += 1;
+            }
+        }
+        for (k = 0; k < MAX_SOCKETS; ++k)
+            if (threads[k])
+                printf("  Socket %d: %d threads, %g GB/s\n",
+                       k, threads[k], bytes[k]/r->tmedian/1e9);
+    }
+}
+
+
+/*
+ * Usage: centroid [harness options] [npoints [dim]]
+ * (see bench.h for the harness options)
+ */
+int main(int argc, char** argv)
+{
+    bench_t b;
+    bench_init(&b, &argc, argv);
+
+    int N = (argc > 1) ? atoi(argv[1]) : 20000000;
+    int dim = (argc > 2) ? atoi(argv[2]) : 2;
+    const char* names[] = {"AoS", "SoA", "AoSoA"};
+    layout_t layouts[] = {POINTS_AOS, POINTS_SOA, POINTS_AOSOA};
+    int i;
 
-    time_centroid("1", test_mean1, xy, N);
-    time_centroid("2", test_mean2, xy, N);
-    time_centroid("3", test_mean3, xy, N);
+    pin_threads();
+    printf("Threads: %d\n", omp_get_max_threads());
+    for (i = 0; i < 3; ++i) {
+        points_t* pts = points_alloc(layouts[i], dim, N);
+        fill_points(pts);
+        time_centroid(&b, names[i], pts, 0, 0);
+        time_centroid(&b, names[i], pts, CENTROID_KAHAN, 0);
+        time_centroid(&b, names[i], pts, 0, 1);
+        time_centroid(&b, names[i], pts, CENTROID_KAHAN, 1);
+        points_free(pts);
+    }
 
-    free(xy);
+    bench_finish(&b);
     return 0;
 }
@@ -0,0 +1,512 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <omp.h>
+#include "dgemm.h"
+#include "cache_params.h"
+
+/*
+ * Vector layer for the microkernel.  The kernel keeps an MR-by-NR
+ * block of C in MR/VW * NR vector registers, and each step of the k
+ * loop loads MR/VW vectors of packed A, broadcasts NR entries of packed
+ * B, and does MR/VW * NR fused multiply-adds.  The sizes leave room
+ * for the A vectors and a broadcast in the register file (32 zmm
+ * registers with AVX-512, 16 ymm with AVX2).
+ */
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+typedef __m512d vec_t;
+#define VW 8
+#define MR 16
+#define NR 12
+#define vzero()       _mm512_setzero_pd()
+#define vload(p)      _mm512_load_pd(p)
+#define vloadu(p)     _mm512_loadu_pd(p)
+#define vstoreu(p,v)  _mm512_storeu_pd(p,v)
+#define vbroadcast(p) _mm512_set1_pd(*(p))
+#define vadd(a,b)     _mm512_add_pd(a,b)
+#define vfma(a,b,c)   _mm512_fmadd_pd(a,b,c)
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+typedef __m256d vec_t;
+#define VW 4
+#define MR 8
+#define NR 6
+#define vzero()       _mm256_setzero_pd()
+#define vload(p)      _mm256_load_pd(p)
+#define vloadu(p)     _mm256_loadu_pd(p)
+#define vstoreu(p,v)  _mm256_storeu_pd(p,v)
+#define vbroadcast(p) _mm256_broadcast_sd(p)
+#define vadd(a,b)     _mm256_add_pd(a,b)
+#define vfma(a,b,c)   _mm256_fmadd_pd(a,b,c)
+
+#else
+
+typedef double vec_t;
+#define VW 1
+#define MR 4
+#define NR 4
+#define vzero()       0.0
+#define vload(p)      (*(p))
+#define vloadu(p)     (*(p))
+#define vstoreu(p,v)  (*(p) = (v))
+#define vbroadcast(p) (*(p))
+#define vadd(a,b)     ((a)+(b))
+#define vfma(a,b,c)   ((a)*(b)+(c))
+
+#endif
+
+#define MV (MR/VW)
+#define ALIGN 64
+
+#define DEFAULT_L1 (32 << 10)
+#define DEFAULT_L2 (256 << 10)
+#define MAX_NC 4096
+
+static dgemm_blocks_t blocks;
+static int initialized = 0;
+static pthread_once_t blocks_once = PTHREAD_ONCE_INIT;
+
+
+/* Default block sizes, unless they were set before the first use */
+static void blocks_init(void)
+{
+    if (!initialized)
+        dgemm_init(NULL);
+}
+
+
+void dgemm_kernel_shape(int* mr, int* nr)
+{
+    *mr = MR;
+    *nr = NR;
+}
+
+
+/*
+ * C(0:MR, 0:NR) += A*B for an MR-sliver of packed A and an NR-sliver
+ * of packed B, kc deep.  Always inlined into its two callers so that
+ * the accumulators stay in registers.
+ */
+static inline __attribute__((always_inline))
+void kernel(int kc, const double* restrict a, const double* restrict b,
+            double* restrict c, int ldc)
+{
+    vec_t acc[NR][MV];
+    int i, j, p;
+    for (j = 0; j < NR; ++j)
+        for (i = 0; i < MV; ++i)
+            acc[j][i] = vzero();
+    for (p = 0; p < kc; ++p, a += MR, b += NR) {
+        vec_t av[MV];
+        for (i = 0; i < MV; ++i)
+            av[i] = vload(a + i*VW);
+        for (j = 0; j < NR; ++j) {
+            vec_t bj = vbroadcast(b + j);
+            for (i = 0; i < MV; ++i)
+                acc[j][i] = vfma(av[i], bj, acc[j][i]);
+        }
+    }
+    for (j = 0; j < NR; ++j)
+        for (i = 0; i < MV; ++i)
+            vstoreu(c + j*ldc + i*VW,
+                    vadd(vloadu(c + j*ldc + i*VW), acc[j][i]));
+}
+
+
+/* Full tile: update C in place */
+static void kernel_full(int kc, const double* a, const double* b,
+                        double* c, int ldc)
+{
+    kernel(kc, a, b, c, ldc);
+}
+
+
+/* Edge tile: update an m-by-n corner of C through a scratch tile */
+static void kernel_edge(int kc, const double* a, const double* b,
+                        double* c, int ldc, int m, int n)
+{
+    double tile[MR*NR] __attribute__((aligned(ALIGN)));
+    int i, j;
+    memset(tile, 0, sizeof(tile));
+    kernel(kc, a, b, tile, MR);
+    for (j = 0; j < n; ++j)
+        for (i = 0; i < m; ++i)
+            c[j*ldc + i] += tile[j*MR + i];
+}
+
+
+/*
+ * Pack the m-by-k block of A at A into MR-tall slivers, each stored
+ * k columns of MR contiguous entries, padding the last with zeros
+ */
+static void pack_a(int m, int k, const double* A, int lda, double* Ap)
+{
+    int ir, i, p;
+    for (ir = 0; ir < m; ir += MR, Ap += MR*k) {
+        int mr = (m-ir < MR) ? m-ir : MR;
+        for (p = 0; p < k; ++p) {
+            const double* a = A + ir + p*lda;
+            for (i = 0; i < mr; ++i)
+                Ap[p*MR + i] = a[i];
+            for (; i < MR; ++i)
+                Ap[p*MR + i] = 0;
+        }
+    }
+}
+
+
+/*
+ * Pack NR columns of the k-by-n block of B at B, starting at column
+ * jr, into a sliver stored k rows of NR contiguous entries
+ */
+static void pack_b_sliver(int n, int k, int jr, const double* B, int ldb,
+                          double* Bp)
+{
+    int nr = (n-jr < NR) ? n-jr : NR;
+    int j, p;
+    for (j = 0; j < nr; ++j) {
+        const double* b = B + (jr+j)*ldb;
+        for (p = 0; p < k; ++p)
+            Bp[p*NR + j] = b[p];
+    }
+    for (; j < NR; ++j)
+        for (p = 0; p < k; ++p)
+            Bp[p*NR + j] = 0;
+}
+
+
+/*
+ * C += A*B for a packed m-by-k block of A and packed k-by-n panel of B
+ */
+static void macro_kernel(int m, int n, int k, const double* Ap,
+                         const double* Bp, double* C, int ldc)
+{
+    int ir, jr;
+    for (jr = 0; jr < n; jr += NR) {
+        int nr = (n-jr < NR) ? n-jr : NR;
+        for (ir = 0; ir < m; ir += MR) {
+            int mr = (m-ir < MR) ? m-ir : MR;
+            if (mr == MR && nr == NR)
+                kernel_full(k, Ap + ir*k, Bp + jr*k, C + ir + jr*ldc, ldc);
+            else
+                kernel_edge(k, Ap + ir*k, Bp + jr*k, C + ir + jr*ldc, ldc,
+                            mr, nr);
+        }
+    }
+}
+
+
+static int round_up(int n, int m)
+{
+    return (n + m-1) / m * m;
+}
+
+
+/* Packing buffer of n doubles, aligned for the vector loads */
+static double* alloc_packed(size_t n)
+{
+    size_t bytes = (n * sizeof(double) + ALIGN-1) / ALIGN * ALIGN;
+    return (double*) aligned_alloc(ALIGN, bytes);
+}
+
+
+void dgemm(int M, int N, int K,
+           const double* A, int lda, const double* B, int ldb,
+           double* C, int ldc)
+{
+    int mc, kc, nc;
+    int nthreads = omp_get_max_threads();
+    double* Bp;
+
+    pthread_once(&blocks_once, blocks_init);
+    if (M <= 0 || N <= 0 || K <= 0)
+        return;
+
+    kc = (blocks.kc < K) ? blocks.kc : K;
+    nc = (blocks.nc < round_up(N, NR)) ? blocks.nc : round_up(N, NR);
+    mc = (blocks.mc < round_up(M, MR)) ? blocks.mc : round_up(M, MR);
+    /* Make at least one block of A per thread */
+    if ((M + mc-1) / mc < nthreads)
+        mc = round_up((M + nthreads-1) / nthreads, MR);
+
+    Bp = alloc_packed((size_t) kc * nc);
+
+    #pragma omp parallel
+    {
+        double* Ap = alloc_packed((size_t) mc * kc);
+        int ic, jc, pc, jr;
+        for (jc = 0; jc < N; jc += nc) {
+            int nb = (N-jc < nc) ? N-jc : nc;
+            for (pc = 0; pc < K; pc += kc) {
+                int kb = (K-pc < kc) ? K-pc : kc;
+                const double* Bb = B + pc + jc*ldb;
+
+                #pragma omp for schedule(static)
+                for (jr = 0; jr < nb; jr += NR)
+                    pack_b_sliver(nb, kb, jr, Bb, ldb, Bp + jr*kb);
+
+                #pragma omp for schedule(dynamic)
+                for (ic = 0; ic < M; ic += mc) {
+                    int mb = (M-ic < mc) ? M-ic : mc;
+                    pack_a(mb, kb, A + ic + pc*lda, lda, Ap);
+                    macro_kernel(mb, nb, kb, Ap, Bp, C + ic + jc*ldc, ldc);
+                }
+            }
+        }
+        free(Ap);
+    }
+    free(Bp);
+}
+
+
+void square_dgemm(int M, const double* A, const double* B, double* C)
+{
+    dgemm(M, M, M, A, M, B, M, C, M);
+}
+
+
+void dgemm_get_blocks(dgemm_blocks_t* b)
+{
+    pthread_once(&blocks_once, blocks_init);
+    *b = blocks;
+}
+
+
+void dgemm_set_blocks(const dgemm_blocks_t* b)
+{
+    blocks.kc = (b->kc < 1) ? 1 : b->kc;
+    blocks.mc = round_up(b->mc < 1 ? 1 : b->mc, MR);
+    blocks.nc = round_up(b->nc < 1 ? 1 : b->nc, NR);
+    initialized = 1;
+}
+
+
+/*
+ * Block sizes from the cache sizes: a kc-by-NR sliver of B fills half
+ * of L1, an mc-by-kc block of A half of L2, and a kc-by-nc panel of B
+ * half of L3 (when there is one)
+ */
+static void default_blocks(dgemm_blocks_t* b)
+{
+    cache_params_t p;
+    long l1, l2, l3;
+    cache_params_load(&p, NULL);
+    l1 = (p.levels > 0) ? p.size[0] : DEFAULT_L1;
+    l2 = (p.levels > 1) ? p.size[1] : DEFAULT_L2;
+    l3 = (p.levels > 2) ? p.size[2] : 0;
+
+    b->kc = (int) (l1/2 / (NR * sizeof(double))) / 8 * 8;
+    if (b->kc < 64)
+        b->kc = 64;
+    b->mc = (int) (l2/2 / (b->kc * sizeof(double))) / MR * MR;
+    if (b->mc < MR)
+        b->mc = MR;
+    b->nc = (int) (l3/2 / (b->kc * sizeof(double))) / NR * NR;
+    if (b->nc < NR || b->nc > MAX_NC)
+        b->nc = MAX_NC / NR * NR;
+}
+
+
+/*
+ * Identify the tuning: the microkernel, the thread count, and the CPU
+ * model (from /proc/cpuinfo where there is one)
+ */
+static void tuning_key(char* key, size_t len)
+{
+    char line[256];
+    const char* model = "unknown";
+    FILE* fp = fopen("/proc/cpuinfo", "r");
+    while (fp && fgets(line, sizeof(line), fp)) {
+        char* colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon) {
+            model = colon+2;
+            line[strcspn(line, "\n")] = '\0';
+            break;
+        }
+    }
+    snprintf(key, len, "kernel=%dx%d threads=%d cpu=%s",
+             MR, NR, omp_get_max_threads(), model);
+    if (fp)
+        fclose(fp);
+}
+
+
+static const char* tuning_file(const char* fname)
+{
+    if (fname == NULL)
+        fname = getenv("DGEMM_TUNE");
+    return fname ? fname : "dgemm.tune";
+}
+
+
+/*
+ * The tuning file has one line per machine:
+ *   mc=192 kc=256 nc=3072 kernel=16x12 threads=4 cpu=<model name>
+ */
+int dgemm_init(const char* fname)
+{
+    char key[512], line[640];
+    FILE* fp = fopen(tuning_file(fname), "r");
+    int found = 0;
+
+    default_blocks(&blocks);
+    initialized = 1;
+    if (fp == NULL)
+        return -1;
+    tuning_key(key, sizeof(key));
+    while (!found && fgets(line, sizeof(line), fp)) {
+        dgemm_blocks_t b;
+        char* rest = strstr(line, " kernel=");
+        line[strcspn(line, "\n")] = '\0';
+        if (rest && strcmp(rest+1, key) == 0 &&
+            sscanf(line, "mc=%d kc=%d nc=%d", &b.mc, &b.kc, &b.nc) == 3) {
+            dgemm_set_blocks(&b);
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return found ? 0 : -1;
+}
+
+
+/*
+ * Replace this machine's line of the tuning file (keeping the others)
+ */
+static int save_tuning(const char* fname, const dgemm_blocks_t* b)
+{
+    char key[512], line[640];
+    char* kept = NULL;
+    size_t nkept = 0;
+    FILE* fp;
+
+    tuning_key(key, sizeof(key));
+    fp = fopen(fname, "r");
+    while (fp && fgets(line, sizeof(line), fp)) {
+        char* rest = strstr(line, " kernel=");
+        size_t len = strlen(line);
+        if (rest && strncmp(rest+1, key, strlen(key)) == 0 &&
+            (rest[1+strlen(key)] == '\n' || rest[1+strlen(key)] == '\0'))
+            continue;
+        kept = (char*) realloc(kept, nkept + len + 1);
+        memcpy(kept + nkept, line, len + 1);
+        nkept += len;
+    }
+    if (fp)
+        fclose(fp);
+
+    fp = fopen(fname, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not write tuning file: %s\n", fname);
+        free(kept);
+        return -1;
+    }
+    if (nkept)
+        fputs(kept, fp);
+    fprintf(fp, "mc=%d kc=%d nc=%d %s\n", b->mc, b->kc, b->nc, key);
+    free(kept);
+    if (ferror(fp) | fclose(fp)) {
+        fprintf(stderr, "Error writing tuning file: %s\n", fname);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Best GFLop/s of three n-by-n products with block sizes b
+ */
+static double time_blocks(const dgemm_blocks_t* b, int n, const double* A,
+                          const double* B, double* C)
+{
+    double best = 0;
+    int trial;
+    dgemm_set_blocks(b);
+    square_dgemm(n, A, B, C);
+    for (trial = 0; trial < 3; ++trial) {
+        double t0 = omp_get_wtime();
+        square_dgemm(n, A, B, C);
+        double rate = 2.0*n*n*n / (omp_get_wtime()-t0) / 1e9;
+        if (rate > best)
+            best = rate;
+    }
+    return best;
+}
+
+
+/*
+ * Search the block size at offset field of dgemm_blocks_t over scale
+ * factors of its current value, keeping the fastest
+ */
+static void tune_one(dgemm_blocks_t* best, double* best_rate, size_t field,
+                     const char* name, int n, const double* A,
+                     const double* B, double* C, int verbose)
+{
+    static const double scales[] = {0.25, 0.5, 0.75, 1.5, 2, 3};
+    int base = *(int*) ((char*) best + field);
+    int i;
+    for (i = 0; i < (int) (sizeof(scales)/sizeof(scales[0])); ++i) {
+        dgemm_blocks_t b = *best;
+        int* f = (int*) ((char*) &b + field);
+        double rate;
+        *f = (int) (base * scales[i]);
+        if (*f < 1)
+            continue;
+        rate = time_blocks(&b, n, A, B, C);
+        dgemm_get_blocks(&b);
+        if (verbose)
+            printf("  %s=%d: mc=%d kc=%d nc=%d %.2f GFLop/s\n", name, *f,
+                   b.mc, b.kc, b.nc, rate);
+        if (rate > *best_rate) {
+            *best_rate = rate;
+            *best = b;
+        }
+    }
+}
+
+
+int dgemm_tune(int n, const char* fname, int verbose)
+{
+    size_t nn = (size_t) n * n;
+    double* A = (double*) malloc(3 * nn * sizeof(double));
+    double* B = A + nn;
+    double* C = B + nn;
+    dgemm_blocks_t best;
+    double best_rate;
+    size_t i;
+    int round;
+
+    for (i = 0; i < 3*nn; ++i)
+        A[i] = (double) rand() / RAND_MAX - 0.5;
+
+    initialized = 0;
+    default_blocks(&best);
+    best_rate = time_blocks(&best, n, A, B, C);
+    dgemm_get_blocks(&best);
+    if (verbose)
+        printf("Tuning on %d-by-%d: start mc=%d kc=%d nc=%d %.2f GFLop/s\n",
+               n, n, best.mc, best.kc, best.nc, best_rate);
+
+    /* Coordinate search, inner blocks first; twice, since they interact */
+    for (round = 0; round < 2; ++round) {
+        tune_one(&best, &best_rate, offsetof(dgemm_blocks_t, kc), "kc",
+                 n, A, B, C, verbose);
+        tune_one(&best, &best_rate, offsetof(dgemm_blocks_t, mc), "mc",
+                 n, A, B, C, verbose);
+        tune_one(&best, &best_rate, offsetof(dgemm_blocks_t, nc), "nc",
+                 n, A, B, C, verbose);
+    }
+    dgemm_set_blocks(&best);
+    if (verbose)
+        printf("Tuned: mc=%d kc=%d nc=%d %.2f GFLop/s\n",
+               best.mc, best.kc, best.nc, best_rate);
+    free(A);
+    return save_tuning(tuning_file(fname), &best);
+}
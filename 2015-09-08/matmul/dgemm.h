@@ -0,0 +1,59 @@
+#ifndef DGEMM_H
+#define DGEMM_H
+
+/*
+ * Blocked matrix multiply, C += A*B, for column-major matrices (A is
+ * M-by-K, B is K-by-N, C is M-by-N, with leading dimensions lda, ldb,
+ * ldc).  The loops follow the usual Goto/BLIS structure:
+ *
+ *   for each nc-wide panel of B and C
+ *     for each kc-deep slab of A and of that panel
+ *       pack the kc-by-nc block of B into NR-wide slivers
+ *       (in parallel) for each mc-tall block of A
+ *         pack it into MR-tall slivers
+ *         for each NR sliver of B, for each MR sliver of A
+ *           MR-by-NR register-blocked update of C
+ *
+ * so a sliver of B sits in L1, the packed block of A in L2, and the
+ * packed panel of B in L3.  MR and NR depend on the instruction set we
+ * are compiled for (AVX-512, AVX2, or scalar).
+ */
+
+typedef struct dgemm_blocks_t {
+    int mc;     /* Rows of A per packed block (multiple of MR) */
+    int kc;     /* Depth of packed blocks */
+    int nc;     /* Columns of B per packed panel (multiple of NR) */
+} dgemm_blocks_t;
+
+/*
+ * Set the block sizes from a tuning file written by dgemm_tune if there
+ * is one for this machine (fname, or $DGEMM_TUNE, or "dgemm.tune"), and
+ * otherwise from the cache sizes measured by membench.  Called by the
+ * first dgemm if not before (just once, even if several threads make
+ * that first call).  Returns 0 if tuned sizes were found.  dgemm_init,
+ * dgemm_set_blocks and dgemm_tune change the sizes for every caller,
+ * so they must not run while another thread is in dgemm.
+ */
+int dgemm_init(const char* fname);
+
+void dgemm_get_blocks(dgemm_blocks_t* blocks);
+void dgemm_set_blocks(const dgemm_blocks_t* blocks);
+
+/* Register block size of the compiled microkernel */
+void dgemm_kernel_shape(int* mr, int* nr);
+
+void dgemm(int M, int N, int K,
+           const double* A, int lda, const double* B, int ldb,
+           double* C, int ldc);
+
+/* C += A*B for square M-by-M matrices (the matmul assignment interface) */
+void square_dgemm(int M, const double* A, const double* B, double* C);
+
+/*
+ * Search for the fastest block sizes on n-by-n products, make them
+ * current, and cache them in fname for later dgemm_init calls.
+ * Returns 0 on success.
+ */
+int dgemm_tune(int n, const char* fname, int verbose);
+
+#endif /* DGEMM_H */
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "dgemm.h"
+#include "bench.h"
+
+
+/*
+ * Awkward sizes on purpose: odd, prime, and one off powers of two,
+ * where edge tiles and cache conflicts show up
+ */
+static const int default_sizes[] = {
+    31, 32, 33, 63, 64, 65, 96, 127, 128, 129, 191, 255, 256, 257,
+    383, 479, 511, 512, 513, 639, 767, 1023, 1024, 1025, 1279, 1536
+};
+
+
+/*
+ * Theoretical peak in GFLop/s: cores in use times clock times flops per
+ * cycle, taking two FMA pipes of the vector width we are compiled for
+ */
+static double peak_gflops(void)
+{
+#if defined(__AVX512F__)
+    int vw = 8;
+#elif defined(__AVX2__)
+    int vw = 4;
+#else
+    int vw = 1;
+#endif
+    int cores = omp_get_max_threads();
+    double mhz = 0;
+    char line[256];
+    FILE* fp = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq",
+                     "r");
+    if (fp) {
+        if (fscanf(fp, "%lf", &mhz) == 1)
+            mhz /= 1000;
+        fclose(fp);
+    }
+    fp = (mhz > 0) ? NULL : fopen("/proc/cpuinfo", "r");
+    while (fp && fgets(line, sizeof(line), fp))
+        if (strncmp(line, "cpu MHz", 7) == 0 &&
+            sscanf(strchr(line, ':')+1, "%lf", &mhz) == 1)
+            break;
+    if (fp)
+        fclose(fp);
+    if (cores > omp_get_num_procs())
+        cores = omp_get_num_procs();
+    return cores * mhz * 1e-3 * 2 * 2 * vw;
+}
+
+
+typedef struct matmul_args_t {
+    int n;
+    const double* A;
+    const double* B;
+    double* C;
+} matmul_args_t;
+
+
+static void run_dgemm(void* arg)
+{
+    matmul_args_t* a = (matmul_args_t*) arg;
+    square_dgemm(a->n, a->A, a->B, a->C);
+}
+
+
+/*
+ * Relative error of C - C0 = A*B, checked on a random vector:
+ * |(C-C0)x - A(Bx)| / (|A| |B| |x|), in the max norm.  Should be a
+ * small multiple of n times machine epsilon.
+ */
+static double check_product(int n, const double* A, const double* B,
+                            const double* C, const double* C0)
+{
+    double* x = (double*) malloc(3 * n * sizeof(double));
+    double* y = x + n;
+    double* z = y + n;
+    double err = 0, anorm = 0, bnorm = 0;
+    int i, j;
+    for (i = 0; i < n; ++i) {
+        x[i] = (double) rand() / RAND_MAX - 0.5;
+        y[i] = z[i] = 0;
+    }
+    for (j = 0; j < n; ++j)
+        for (i = 0; i < n; ++i) {
+            y[i] += B[i + j*n] * x[j];
+            z[i] += (C[i + j*n] - C0[i + j*n]) * x[j];
+            anorm = fmax(anorm, fabs(A[i + j*n]));
+            bnorm = fmax(bnorm, fabs(B[i + j*n]));
+        }
+    for (j = 0; j < n; ++j)
+        for (i = 0; i < n; ++i)
+            z[i] -= A[i + j*n] * y[j];
+    for (i = 0; i < n; ++i)
+        err = fmax(err, fabs(z[i]));
+    free(x);
+    return err / (n * n * anorm * bnorm * 0.5);
+}
+
+
+static void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [harness options] [-t tune_n] [-f tunefile]"
+            " [-p peakGF] [size ...]\n", name);
+    exit(-1);
+}
+
+
+/*
+ * Options (besides the harness options in bench.h):
+ *   -t n = first tune the block sizes on n-by-n products
+ *   -f file = tuning file (default dgemm.tune)
+ *   -p peak = theoretical peak in GFLop/s (default from the clock rate)
+ *   sizes = matrix sizes to time (default a sweep of awkward sizes)
+ */
+int main(int argc, char** argv)
+{
+    bench_t b;
+    int tune_n = 0;
+    const char* tunefile = NULL;
+    double peak;
+    int* sizes = NULL;
+    int nsizes = 0, ndefault;
+    int i;
+    dgemm_blocks_t blk;
+    int mr, nr;
+
+    bench_init(&b, &argc, argv);
+    peak = peak_gflops();
+    ndefault = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    sizes = (int*) malloc((argc > ndefault ? argc : ndefault) * sizeof(int));
+    for (i = 1; i < argc; ++i) {
+        if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 't': tune_n = atoi(argv[++i]); break;
+            case 'f': tunefile = argv[++i]; break;
+            case 'p': peak = atof(argv[++i]); break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else if (atoi(argv[i]) > 0) {
+            sizes[nsizes++] = atoi(argv[i]);
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    if (nsizes == 0) {
+        nsizes = ndefault;
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+
+    if (tune_n > 0) {
+        if (dgemm_tune(tune_n, tunefile, 1) < 0)
+            return -1;
+    } else if (dgemm_init(tunefile) < 0) {
+        printf("No tuning for this machine; using cache-based blocks\n");
+    }
+    dgemm_get_blocks(&blk);
+    dgemm_kernel_shape(&mr, &nr);
+    printf("Threads: %d, kernel %dx%d, mc=%d kc=%d nc=%d, peak %.1f GFLop/s\n",
+           omp_get_max_threads(), mr, nr, blk.mc, blk.kc, blk.nc, peak);
+
+    for (i = 0; i < nsizes; ++i) {
+        int n = sizes[i];
+        size_t nn = (size_t) n * n;
+        double* A = (double*) malloc(4 * nn * sizeof(double));
+        double* B = A + nn;
+        double* C = B + nn;
+        double* C0 = C + nn;
+        matmul_args_t args = {n, A, B, C};
+        char name[64];
+        const bench_result_t* r;
+        size_t k;
+        double rate, err;
+
+        for (k = 0; k < 3*nn; ++k)
+            A[k] = (double) rand() / RAND_MAX - 0.5;
+        memcpy(C0, C, nn * sizeof(double));
+        snprintf(name, sizeof(name), "dgemm %d", n);
+        r = bench_run(&b, name, run_dgemm, &args, 2.0*n*n*n, 0);
+
+        /* Each run added A*B once more */
+        memcpy(C, C0, nn * sizeof(double));
+        square_dgemm(n, A, B, C);
+        err = check_product(n, A, B, C, C0);
+        rate = 2.0*n*n*n / r->tmedian / 1e9;
+        printf("  %d: %.2f GFLop/s, %.1f%% of peak, error %.1e%s\n", n, rate,
+               peak > 0 ? 100*rate/peak : 0, err,
+               err > 1e-12 * n ? " (WRONG)" : "");
+        free(A);
+    }
+
+    bench_finish(&b);
+    free(sizes);
+    return 0;
+}
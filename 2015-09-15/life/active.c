@@ -0,0 +1,239 @@
+/*
+ * active.c - Activity-tracking implementation of the Game of Life
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "life_common.h"
+
+
+/**
+ * Tile size (in cells per side) for activity tracking.
+ */
+#ifndef TILE_SIZE
+#define TILE_SIZE 32
+#endif
+
+
+/**
+ * We keep two n-by-n boards (previous and current) with one char per
+ * cell, and divide them into TILE_SIZE tiles.  A tile can only change
+ * in the next generation if it or one of its eight neighbors (with
+ * wraparound) changed in the last one, so we keep a list of the tiles
+ * that changed and only recompute those tiles and their neighbors.
+ *
+ * A skipped tile did not change from the previous generation to the
+ * current one, so the previous board (which we are about to overwrite
+ * with the next generation) already holds the right values for it.
+ */
+typedef struct board_t {
+    char* current;     /* Current generation                        */
+    char* previous;    /* Previous generation                       */
+    int ntiles;        /* Number of tiles per side                  */
+    int* changed;      /* Tiles that changed in the last generation */
+    int nchanged;      /* Number of entries in changed              */
+    int* work;         /* Tiles to recompute in this generation     */
+    int* stamp;        /* Generation when a tile was last queued    */
+    int now;           /* Current stamp                             */
+    int reset;         /* Recompute every tile in next generation   */
+    double tiles_done;  /* Tiles recomputed so far                  */
+    double tiles_seen;  /* Tiles visited (done or skipped) so far   */
+} board_t;
+
+
+/**
+ * Assuming the variable n is set to nboard, this macro accesses the (i,j)
+ * entry of either the current or the previous board array.
+ */
+#define B(which,i,j) which[(i)*n+(j)]
+
+
+/**
+ * Create the board for the problem
+ */
+void create_board(problem_t* problem)
+{
+    int n = problem->nboard;
+    int nt = (n + TILE_SIZE-1) / TILE_SIZE;
+    board_t* board = (board_t*) malloc(sizeof(board_t));
+    board->current  = (char*) calloc(n * n, 1);
+    board->previous = (char*) calloc(n * n, 1);
+    board->ntiles   = nt;
+    board->changed  = (int*) malloc(nt * nt * sizeof(int));
+    board->nchanged = 0;
+    board->work     = (int*) malloc(nt * nt * sizeof(int));
+    board->stamp    = (int*) calloc(nt * nt, sizeof(int));
+    board->now      = 0;
+    board->reset    = 1;
+    board->tiles_done = 0;
+    board->tiles_seen = 0;
+    problem->board = board;
+}
+
+
+/**
+ * Free the memory associated with a board (and report activity).  A
+ * recomputed tile reads the current board and writes the previous one,
+ * two bytes per cell; a skipped tile moves nothing.
+ */
+void destroy_board(problem_t* problem)
+{
+    board_t* board = problem->board;
+    if (board->tiles_seen > 0) {
+        double done = board->tiles_done / board->tiles_seen;
+        snprintf(problem->stats, sizeof(problem->stats),
+                 "Tiles skipped: %.2f%%", 100.0 * (1.0 - done));
+        problem->bytes_per_cell = 2.0 * done;
+    }
+    free(board->stamp);
+    free(board->work);
+    free(board->changed);
+    free(board->current);
+    free(board->previous);
+    free(board);
+    problem->board = NULL;
+}
+
+
+/**
+ * Set one cell in the problem
+ */
+void set_cell(problem_t* problem, int i, int j)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    if (i < 0 || i >= n || j < 0 || j >= n)
+        return;
+    B(board->current,i,j) = 1;
+    board->reset = 1;
+}
+
+
+/**
+ * Get one cell in the problem
+ */
+char get_cell(problem_t* problem, int i, int j)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    return B(board->current,i,j);
+}
+
+
+/**
+ * Advance the tile with corner (i0,j0) and size ti-by-tj one generation.
+ * Return nonzero if any cell in the tile changed.
+ */
+static inline __attribute__((always_inline))
+int advance_tile(int n, char* current, const char* previous,
+                 int i0, int j0, int ti, int tj, uint32_t rule)
+{
+    int diff = 0;
+    for (int i = i0; i < i0+ti; ++i) {
+        const char* up = previous + ((i+n-1)%n)*n;
+        const char* md = previous + i*n;
+        const char* dn = previous + ((i+1)%n)*n;
+        char* o = current + i*n;
+        for (int j = j0; j < j0+tj; ++j) {
+            int jm = (j == 0)   ? n-1 : j-1;
+            int jp = (j == n-1) ? 0   : j+1;
+            int x = up[jm] + up[j] + up[jp] +
+                    md[jm]         + md[jp] +
+                    dn[jm] + dn[j] + dn[jp];
+            char y = RULE_NEXT(rule, 2*x + md[j]);
+            diff |= y ^ md[j];
+            o[j] = y;
+        }
+    }
+    return diff;
+}
+
+
+/**
+ * Build the list of tiles to recompute: every tile after a reset,
+ * otherwise the changed tiles and their neighbors.  Return the count.
+ */
+static int build_worklist(board_t* board)
+{
+    int nt = board->ntiles;
+    int nwork = 0;
+
+    if (board->reset) {
+        for (int t = 0; t < nt*nt; ++t)
+            board->work[nwork++] = t;
+        board->reset = 0;
+        return nwork;
+    }
+
+    ++(board->now);
+    for (int c = 0; c < board->nchanged; ++c) {
+        int ti = board->changed[c] / nt;
+        int tj = board->changed[c] % nt;
+        for (int di = -1; di <= 1; ++di)
+            for (int dj = -1; dj <= 1; ++dj) {
+                int t = ((ti+di+nt)%nt)*nt + (tj+dj+nt)%nt;
+                if (board->stamp[t] != board->now) {
+                    board->stamp[t] = board->now;
+                    board->work[nwork++] = t;
+                }
+            }
+    }
+    return nwork;
+}
+
+
+/**
+ * Recompute the tiles on the worklist, recording those that changed.
+ * This is always inlined, so that RULE_DISPATCH in advance_board1
+ * gives a specialized kernel for each common rule.
+ */
+static inline __attribute__((always_inline))
+void advance_work(board_t* board, int n, char* current, const char* previous,
+                  int nwork, uint32_t rule)
+{
+    int nt = board->ntiles;
+    board->nchanged = 0;
+    for (int w = 0; w < nwork; ++w) {
+        int t = board->work[w];
+        int i0 = (t / nt) * TILE_SIZE;
+        int j0 = (t % nt) * TILE_SIZE;
+        int ti = (n-i0 < TILE_SIZE) ? n-i0 : TILE_SIZE;
+        int tj = (n-j0 < TILE_SIZE) ? n-j0 : TILE_SIZE;
+        if (advance_tile(n, current, previous, i0, j0, ti, tj, rule))
+            board->changed[board->nchanged++] = t;
+    }
+}
+
+
+/**
+ * Advance the board by one generation
+ */
+void advance_board1(problem_t* problem)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    char* current = board->previous;
+    char* previous = board->current;
+    int nt = board->ntiles;
+
+    int nwork = build_worklist(board);
+    RULE_DISPATCH(problem->rule, advance_work,
+                  board, n, current, previous, nwork);
+    board->tiles_done += nwork;
+    board->tiles_seen += (double) nt * nt;
+
+    board->current = current;
+    board->previous = previous;
+}
+
+
+/**
+ * Advance the board by steps generations
+ */
+void advance_board(problem_t* problem, int steps)
+{
+    for (int step = 0; step < steps; ++step)
+        advance_board1(problem);
+}
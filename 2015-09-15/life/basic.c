@@ -37,8 +37,8 @@ void create_board(problem_t* problem)
     board_t* board = (board_t*) malloc(sizeof(board_t));
     board->current = (char*) malloc((n+2) * (n+2));
     board->previous = (char*) malloc((n+2) * (n+2));
-    memset(board->current, 0, n*n);
-    memset(board->previous, 0, n*n);
+    memset(board->current, 0, (n+2) * (n+2));
+    memset(board->previous, 0, (n+2) * (n+2));
     problem->board = board;
 }
 
@@ -63,7 +63,7 @@ void set_cell(problem_t* problem, int i, int j)
 {
     int n = problem->nboard;
     board_t* board = problem->board;
-    if (i <= 0 || i >= n)
+    if (i < 0 || i >= n || j < 0 || j >= n)
         return;
     B(board->current,i,j) = 1;
 }
@@ -81,9 +81,12 @@ char get_cell(problem_t* problem, int i, int j)
 
 
 /**
- * Advance the board by one generation
+ * Advance the board by one generation under the given rule.  We always
+ * inline this so that each call from advance_board1 with a constant
+ * rule compiles to a kernel specialized for that rule.
  */
-void advance_board1(problem_t* problem)
+static inline __attribute__((always_inline))
+void advance_rule(problem_t* problem, uint32_t rule)
 {
     int n = problem->nboard;
     board_t* board = problem->board;
@@ -107,7 +110,7 @@ void advance_board1(problem_t* problem)
                 for (int l = -1; l <= 1; ++l)
                     x += B(previous,i+k,j+l);
             x = 2*x-B(previous,i,j);
-            B(current,i,j) = (x >= 5 && x <= 7);
+            B(current,i,j) = RULE_NEXT(rule, x);
         }
 
     board->current = current;
@@ -115,6 +118,15 @@ void advance_board1(problem_t* problem)
 }
 
 
+/**
+ * Advance the board by one generation
+ */
+void advance_board1(problem_t* problem)
+{
+    RULE_DISPATCH(problem->rule, advance_rule, problem);
+}
+
+
 /**
  * Advance the board by steps generations
  */
@@ -0,0 +1,215 @@
+/*
+ * bitpack.c - Bit-packed implementation of the Game of Life
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "life_common.h"
+
+
+/**
+ * In the bit-packed implementation, each row of the board is stored
+ * as nwords = ceil(n/64) 64-bit words, with cell (i,j) in bit j%64 of
+ * word j/64.  Bits past the end of the row in the last word are always
+ * kept at zero.  We update 64 cells at a time by computing neighbor
+ * counts with bit-sliced adders.  As in the basic code, we keep
+ * two boards (previous and current).
+ */
+typedef struct board_t {
+    int nwords;         /* Words per row                 */
+    int nlast;          /* Number of cells in last word  */
+    uint64_t* current;  /* Current generation            */
+    uint64_t* previous; /* Previous generation           */
+} board_t;
+
+
+/**
+ * Create the board for the problem
+ */
+void create_board(problem_t* problem)
+{
+    int n = problem->nboard;
+    int nwords = (n+63)/64;
+    board_t* board = (board_t*) malloc(sizeof(board_t));
+    board->nwords = nwords;
+    board->nlast = n - 64*(nwords-1);
+    board->current  = (uint64_t*) calloc(n * nwords, sizeof(uint64_t));
+    board->previous = (uint64_t*) calloc(n * nwords, sizeof(uint64_t));
+    problem->board = board;
+}
+
+
+/**
+ * Free the memory associated with a board
+ */
+void destroy_board(problem_t* problem)
+{
+    board_t* board = problem->board;
+    free(board->current);
+    free(board->previous);
+    free(board);
+    problem->board = NULL;
+}
+
+
+/**
+ * Set one cell in the problem
+ */
+void set_cell(problem_t* problem, int i, int j)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    if (i < 0 || i >= n || j < 0 || j >= n)
+        return;
+    board->current[i*board->nwords + j/64] |= (uint64_t) 1 << (j%64);
+}
+
+
+/**
+ * Get one cell in the problem
+ */
+char get_cell(problem_t* problem, int i, int j)
+{
+    board_t* board = problem->board;
+    return (board->current[i*board->nwords + j/64] >> (j%64)) & 1;
+}
+
+
+/**
+ * Form the words holding the west (j-1) and east (j+1) neighbors
+ * of the cells in word w of a row, wrapping around at the row ends.
+ */
+static inline uint64_t west_word(const uint64_t* row, int w, int nwords,
+                                 int nlast)
+{
+    uint64_t carry = (w > 0) ?
+        row[w-1] >> 63 :
+        (row[nwords-1] >> (nlast-1)) & 1;
+    return (row[w] << 1) | carry;
+}
+
+static inline uint64_t east_word(const uint64_t* row, int w, int nwords,
+                                 int nlast)
+{
+    uint64_t carry = (w < nwords-1) ?
+        row[w+1] << 63 :
+        (row[0] & 1) << (nlast-1);
+    return (row[w] >> 1) | carry;
+}
+
+
+/**
+ * Advance the board by one generation.
+ *
+ * For each word, we add the eight neighbor bit-planes with full and
+ * half adders.  Writing the neighbor count as ones + 2*t, where ones is
+ * a single bit and t is the sum of four carry bits, a cell lives in the
+ * next generation of Conway's rule iff t == 1 and either ones is set
+ * (three neighbors) or the cell is currently alive (two neighbors).
+ * For other rules, we finish the sum to get the count as four bit
+ * planes and OR together the masks of the cells whose (count, state)
+ * pair is set in the rule.  This is always inlined, so that with a
+ * constant rule the loop over the rule bits is unrolled and folded.
+ */
+static inline __attribute__((always_inline))
+void advance_rule(problem_t* problem, uint32_t rule)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    int nwords = board->nwords;
+    int nlast = board->nlast;
+    uint64_t* current = board->previous;
+    uint64_t* previous = board->current;
+    uint64_t lastmask = (nlast == 64) ? ~(uint64_t) 0 :
+        (((uint64_t) 1 << nlast) - 1);
+
+    for (int i = 0; i < n; ++i) {
+        const uint64_t* up  = previous + ((i+n-1)%n)*nwords;
+        const uint64_t* mid = previous + i*nwords;
+        const uint64_t* dn  = previous + ((i+1)%n)*nwords;
+        uint64_t* out = current + i*nwords;
+
+        for (int w = 0; w < nwords; ++w) {
+            uint64_t a, b, c;
+
+            /* Row above: three cells, full adder */
+            a = west_word(up, w, nwords, nlast);
+            b = up[w];
+            c = east_word(up, w, nwords, nlast);
+            uint64_t s1 = a ^ b ^ c;
+            uint64_t c1 = (a & b) | (c & (a ^ b));
+
+            /* Row below: three cells, full adder */
+            a = west_word(dn, w, nwords, nlast);
+            b = dn[w];
+            c = east_word(dn, w, nwords, nlast);
+            uint64_t s2 = a ^ b ^ c;
+            uint64_t c2 = (a & b) | (c & (a ^ b));
+
+            /* Own row: two cells, half adder */
+            a = west_word(mid, w, nwords, nlast);
+            c = east_word(mid, w, nwords, nlast);
+            uint64_t s3 = a ^ c;
+            uint64_t c3 = a & c;
+
+            /* Combine the ones bits; carry goes into the twos */
+            uint64_t ones = s1 ^ s2 ^ s3;
+            uint64_t c4 = (s1 & s2) | (s3 & (s1 ^ s2));
+
+            uint64_t p = c1 ^ c2, pa = c1 & c2;
+            uint64_t q = c3 ^ c4, qa = c3 & c4;
+
+            if (rule == RULE_CONWAY) {
+                /* t == 1 iff exactly one of c1, c2, c3, c4 is set */
+                uint64_t t1 = (p ^ q) & ~(pa | qa);
+                out[w] = t1 & (ones | mid[w]);
+            } else {
+                /* Count bit planes: count = b0 + 2*b1 + 4*b2 + 8*b3 */
+                uint64_t pq = p & q;
+                uint64_t b0 = ones;
+                uint64_t b1 = p ^ q;
+                uint64_t b2 = pa ^ qa ^ pq;
+                uint64_t b3 = (pa & qa) | (pq & (pa ^ qa));
+                uint64_t next = 0;
+                for (int x = 1; x < 18; ++x) {
+                    if ((rule >> x) & 1) {
+                        int k = x/2;
+                        uint64_t m = (x & 1) ? mid[w] : ~mid[w];
+                        m &= (k & 1) ? b0 : ~b0;
+                        m &= (k & 2) ? b1 : ~b1;
+                        m &= (k & 4) ? b2 : ~b2;
+                        m &= (k & 8) ? b3 : ~b3;
+                        next |= m;
+                    }
+                }
+                out[w] = next;
+            }
+        }
+        out[nwords-1] &= lastmask;
+    }
+
+    board->current = current;
+    board->previous = previous;
+}
+
+
+/**
+ * Advance the board by one generation
+ */
+void advance_board1(problem_t* problem)
+{
+    RULE_DISPATCH(problem->rule, advance_rule, problem);
+}
+
+
+/**
+ * Advance the board by steps generations
+ */
+void advance_board(problem_t* problem, int steps)
+{
+    for (int step = 0; step < steps; ++step)
+        advance_board1(problem);
+}
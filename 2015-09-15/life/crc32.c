@@ -42,6 +42,17 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <pthread.h>
+
+#include "crc32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_HAVE_CLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#define CRC32_POLY 0xedb88320U
 
 static uint32_t crc32_tab[] = {
 	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
@@ -89,16 +100,277 @@ static uint32_t crc32_tab[] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+/*
+ * Faster paths.  The byte-at-a-time loop above needs one table lookup
+ * (and a dependent shift/xor) per byte.  Slicing-by-N keeps N tables,
+ * where crc32_slice[k][b] is the CRC contribution of byte b followed by
+ * k zero bytes, so N bytes can be folded in with N independent lookups.
+ * On CPUs with carry-less multiply (PCLMULQDQ), we instead fold 64-byte
+ * blocks with the method of Gopal et al., "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009), and
+ * finish the tail with slicing.  The tables are built and the path
+ * chosen on first use.
+ */
+
+static uint32_t crc32_slice[16][256];
+static int crc32_use_clmul;
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void
+crc32_init(void)
+{
+	int i, k;
+
+	for (i = 0; i < 256; i++)
+		crc32_slice[0][i] = crc32_tab[i];
+	for (k = 1; k < 16; k++)
+		for (i = 0; i < 256; i++) {
+			uint32_t c = crc32_slice[k-1][i];
+			crc32_slice[k][i] = crc32_tab[c & 0xFF] ^ (c >> 8);
+		}
+
+#ifdef CRC32_HAVE_CLMUL
+	{
+		unsigned int eax, ebx, ecx, edx;
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+			crc32_use_clmul = (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+	}
+#endif
+}
+
+/* Build the tables exactly once, whichever thread gets here first */
+static void
+crc32_ready(void)
+{
+	pthread_once(&crc32_once, crc32_init);
+}
+
+/* Warm-up only, so the first checksum is not charged for the tables */
+#if defined(__GNUC__)
+__attribute__((constructor))
+static void
+crc32_init_ctor(void)
+{
+	crc32_ready();
+}
+#endif
+
+/* Little-endian 32-bit load, one byte at a time */
+#define LOAD32(p) \
+	((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | \
+	 ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+/*
+ * Update an (inverted) CRC register with slicing-by-16 and -by-8,
+ * then one byte at a time for the tail.
+ */
+static uint32_t
+crc32_sliced(uint32_t crc, const uint8_t *p, size_t size)
+{
+	while (size >= 16) {
+		uint32_t a = LOAD32(p) ^ crc;
+		uint32_t b = LOAD32(p + 4);
+		uint32_t c = LOAD32(p + 8);
+		uint32_t d = LOAD32(p + 12);
+		crc = crc32_slice[15][a & 0xFF] ^
+		    crc32_slice[14][(a >> 8) & 0xFF] ^
+		    crc32_slice[13][(a >> 16) & 0xFF] ^
+		    crc32_slice[12][a >> 24] ^
+		    crc32_slice[11][b & 0xFF] ^
+		    crc32_slice[10][(b >> 8) & 0xFF] ^
+		    crc32_slice[9][(b >> 16) & 0xFF] ^
+		    crc32_slice[8][b >> 24] ^
+		    crc32_slice[7][c & 0xFF] ^
+		    crc32_slice[6][(c >> 8) & 0xFF] ^
+		    crc32_slice[5][(c >> 16) & 0xFF] ^
+		    crc32_slice[4][c >> 24] ^
+		    crc32_slice[3][d & 0xFF] ^
+		    crc32_slice[2][(d >> 8) & 0xFF] ^
+		    crc32_slice[1][(d >> 16) & 0xFF] ^
+		    crc32_slice[0][d >> 24];
+		p += 16;
+		size -= 16;
+	}
+	if (size >= 8) {
+		uint32_t a = LOAD32(p) ^ crc;
+		uint32_t b = LOAD32(p + 4);
+		crc = crc32_slice[7][a & 0xFF] ^
+		    crc32_slice[6][(a >> 8) & 0xFF] ^
+		    crc32_slice[5][(a >> 16) & 0xFF] ^
+		    crc32_slice[4][a >> 24] ^
+		    crc32_slice[3][b & 0xFF] ^
+		    crc32_slice[2][(b >> 8) & 0xFF] ^
+		    crc32_slice[1][(b >> 16) & 0xFF] ^
+		    crc32_slice[0][b >> 24];
+		p += 8;
+		size -= 8;
+	}
+	while (size--)
+		crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef CRC32_HAVE_CLMUL
+/*
+ * Fold an (inverted) CRC register over size bytes with PCLMULQDQ.
+ * Requires size >= 64 and size a multiple of 16.  The constants are
+ * x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32), x^64 mod P and
+ * the Barrett reduction constants, all bit-reflected.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+crc32_clmul(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	buf += 64;
+	size -= 64;
+
+	/* Fold four 128-bit lanes at a time */
+	while (size >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		    _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+		    _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+		    _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+		    _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+		buf += 64;
+		size -= 64;
+	}
+
+	/* Fold the four lanes into one */
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Remaining 16-byte blocks */
+	while (size >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)buf);
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		buf += 16;
+		size -= 16;
+	}
+
+	/* Fold 128 bits to 64 */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
 uint32_t
 crc32(uint32_t crc, const void *buf, size_t size)
 {
 	const uint8_t *p;
 
+	crc32_ready();
 	p = buf;
 	crc = crc ^ ~0U;
 
+#ifdef CRC32_HAVE_CLMUL
+	if (crc32_use_clmul && size >= 64) {
+		size_t nfold = size & ~(size_t)15;
+		crc = crc32_clmul(crc, p, nfold);
+		p += nfold;
+		size -= nfold;
+	}
+#endif
+	if (size >= 8)
+		return crc32_sliced(crc, p, size) ^ ~0U;
+
 	while (size--)
 		crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
 
 	return crc ^ ~0U;
 }
+
+/*
+ * CRC combination.  Appending len2 bytes to a message multiplies its
+ * CRC register by x^(8*len2) modulo P, so crc(A B) can be computed
+ * from crc(A), crc(B) and the length of B alone.  We work with
+ * polynomials in the same reflected bit order as the tables.
+ */
+
+/* Multiply a and b modulo P */
+static uint32_t
+crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = 1U << 31;
+	uint32_t p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+	}
+	return p;
+}
+
+/* Compute x^(n * 2^k) modulo P */
+static uint32_t
+crc32_x2nmodp(uint64_t n, unsigned k)
+{
+	uint32_t p = 1U << 31;		/* x^0 */
+	uint32_t x2k = 1U << 30;	/* x^1 */
+
+	for (; k > 0; k--)
+		x2k = crc32_multmodp(x2k, x2k);
+	while (n) {
+		if (n & 1)
+			p = crc32_multmodp(x2k, p);
+		n >>= 1;
+		x2k = crc32_multmodp(x2k, x2k);
+	}
+	return p;
+}
+
+uint32_t
+crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+	crc32_ready();
+	return crc32_multmodp(crc32_x2nmodp(len2, 3), crc1) ^ crc2;
+}
@@ -6,4 +6,7 @@
 
 uint32_t crc32(uint32_t crc, const void *buf, size_t size);
 
+/* CRC of the concatenation AB given crc1 = CRC(A), crc2 = CRC(B) */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
 #endif /* CRC32_H */
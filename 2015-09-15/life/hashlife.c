@@ -0,0 +1,696 @@
+/*
+ * hashlife.c - HashLife implementation of the Game of Life
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "life_common.h"
+
+
+/**
+ * HashLife represents the (infinite) plane as a quadtree.  A node at
+ * level L covers a 2^L-by-2^L square and is made of four level L-1
+ * children; level 0 nodes are single cells.  Nodes are hash-consed,
+ * so identical squares anywhere in space or time are the same node,
+ * and each node memoizes its "result": the central 2^(L-1) square
+ * after 2^j generations, for some j <= L-2.
+ *
+ * Our board is a torus, which we embed in the plane as a periodic
+ * tiling.  The board itself is kept as a root node covering [0,n)^2
+ * (dead beyond n).  To advance 2^j generations, we build a node
+ * covering enough of the tiling that its result contains the whole
+ * board, ask for the result, and crop the board back out as the new
+ * root.  Building reuses the root's subtrees wherever they line up with
+ * the tiling and skips dead regions, and hash-consing collapses the
+ * repeated copies of the board, so a jump costs time in proportion to
+ * the live structure rather than to n^2.  A run of g steps is done as a
+ * few such jumps, largest first.
+ *
+ * The cell array holds the board as set_cell leaves it, until the first
+ * jump builds the root; after that, get_cell fills it in again a row at
+ * a time, as rows are asked for.
+ *
+ * With a memory bound (-m), we garbage collect between jumps: we keep
+ * the nodes of the current board and evict all other cached nodes and
+ * results.  A jump whose working set alone exceeds the bound makes us
+ * use smaller jumps from then on.
+ */
+typedef struct node_t {
+    struct node_t* nw;      /* Children (NULL for cells)              */
+    struct node_t* ne;
+    struct node_t* sw;
+    struct node_t* se;
+    struct node_t* next;    /* Hash chain (or free list)              */
+    struct node_t* result;  /* Memoized center after 2^rstep steps    */
+    int level;              /* Node covers 2^level cells per side     */
+    int rstep;              /* Log2 of steps for the memoized result  */
+    int live;               /* Are there any live cells in the node?  */
+    int mark;               /* Garbage collection mark                */
+} node_t;
+
+
+/**
+ * Entry in the memo table used while building the tiling
+ */
+typedef struct build_entry_t {
+    int level, x, y;
+    node_t* node;
+} build_entry_t;
+
+
+#define MAX_LEVEL 64
+
+typedef struct board_t {
+    int n;                  /* Board size                             */
+    uint32_t rule;          /* Rule mask                              */
+    int m;                  /* Level of the root (2^m >= n)           */
+    node_t* root;           /* Current state (NULL before first jump) */
+    char* cells;            /* Initial state, then rows of the root   */
+    int* rowstamp;          /* Row i of cells is current if ...       */
+    int stamp;              /* ... rowstamp[i] == stamp               */
+    int imin, imax;         /* Bounding box of set_cell calls         */
+    int jmin, jmax;
+
+    node_t dead, alive;     /* Level 0 nodes                          */
+    node_t* empty[MAX_LEVEL];  /* Canonical empty node at each level  */
+
+    node_t** table;         /* Hash table of nodes                    */
+    size_t tsize;           /* Number of buckets (power of 2)         */
+    size_t nnodes;          /* Number of nodes in the table           */
+    node_t* freelist;       /* Recycled nodes                         */
+
+    size_t maxnodes;        /* Node budget (0 for unbounded)          */
+    int maxjump;            /* Log2 of the largest jump to take       */
+    int ngc;                /* Number of garbage collections          */
+
+    build_entry_t* memo;    /* Memo table for building the tiling     */
+    size_t memosize, nmemo;
+} board_t;
+
+
+/**
+ * Hash four child pointers
+ */
+static size_t hash4(node_t* nw, node_t* ne, node_t* sw, node_t* se)
+{
+    uint64_t h = (uintptr_t) nw;
+    h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t) ne;
+    h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t) sw;
+    h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t) se;
+    return (size_t) (h ^ (h >> 29));
+}
+
+
+/**
+ * Double the size of the hash table
+ */
+static void grow_table(board_t* b)
+{
+    size_t tsize = 2*b->tsize;
+    node_t** table = (node_t**) calloc(tsize, sizeof(node_t*));
+    for (size_t k = 0; k < b->tsize; ++k) {
+        node_t* next;
+        for (node_t* p = b->table[k]; p; p = next) {
+            size_t h = hash4(p->nw, p->ne, p->sw, p->se) & (tsize-1);
+            next = p->next;
+            p->next = table[h];
+            table[h] = p;
+        }
+    }
+    free(b->table);
+    b->table = table;
+    b->tsize = tsize;
+}
+
+
+/**
+ * Mark a node and its descendants
+ */
+static void mark_tree(node_t* node)
+{
+    if (node->level == 0 || node->mark)
+        return;
+    node->mark = 1;
+    mark_tree(node->nw);
+    mark_tree(node->ne);
+    mark_tree(node->sw);
+    mark_tree(node->se);
+}
+
+
+/**
+ * Garbage collect: keep only the nodes reachable from root and the
+ * empty nodes, and drop memoized results that point to evicted nodes.
+ * This must only be called between jumps.
+ */
+static void collect_garbage(board_t* b, node_t* root)
+{
+    mark_tree(root);
+    for (int l = 0; l < MAX_LEVEL && b->empty[l]; ++l)
+        mark_tree(b->empty[l]);
+
+    for (size_t k = 0; k < b->tsize; ++k) {
+        node_t** pp = &(b->table[k]);
+        while (*pp) {
+            node_t* p = *pp;
+            if (p->mark) {
+                pp = &(p->next);
+            } else {
+                *pp = p->next;
+                p->next = b->freelist;
+                b->freelist = p;
+                --(b->nnodes);
+            }
+        }
+    }
+
+    for (size_t k = 0; k < b->tsize; ++k)
+        for (node_t* p = b->table[k]; p; p = p->next) {
+            if (p->result && !p->result->mark)
+                p->result = NULL;
+        }
+    for (size_t k = 0; k < b->tsize; ++k)
+        for (node_t* p = b->table[k]; p; p = p->next)
+            p->mark = 0;
+    ++(b->ngc);
+}
+
+
+/**
+ * Get the canonical node with the given children
+ */
+static node_t* join(board_t* b,
+                    node_t* nw, node_t* ne, node_t* sw, node_t* se)
+{
+    size_t h = hash4(nw, ne, sw, se) & (b->tsize-1);
+    for (node_t* p = b->table[h]; p; p = p->next)
+        if (p->nw == nw && p->ne == ne && p->sw == sw && p->se == se)
+            return p;
+
+    if (b->nnodes >= b->tsize) {
+        grow_table(b);
+        h = hash4(nw, ne, sw, se) & (b->tsize-1);
+    }
+
+    node_t* p = b->freelist;
+    if (p)
+        b->freelist = p->next;
+    else
+        p = (node_t*) malloc(sizeof(node_t));
+    p->nw = nw;
+    p->ne = ne;
+    p->sw = sw;
+    p->se = se;
+    p->result = NULL;
+    p->rstep = -1;
+    p->level = nw->level + 1;
+    p->live = nw->live | ne->live | sw->live | se->live;
+    p->mark = 0;
+    p->next = b->table[h];
+    b->table[h] = p;
+    ++(b->nnodes);
+    return p;
+}
+
+
+/**
+ * Get the empty node at a given level
+ */
+static node_t* empty_node(board_t* b, int level)
+{
+    if (!b->empty[level]) {
+        node_t* e = empty_node(b, level-1);
+        b->empty[level] = join(b, e, e, e, e);
+    }
+    return b->empty[level];
+}
+
+
+/**
+ * Get the central level L-1 square of a level L node
+ */
+static node_t* centre(board_t* b, node_t* node)
+{
+    return join(b, node->nw->se, node->ne->sw, node->sw->ne, node->se->nw);
+}
+
+
+/**
+ * Base case: advance the center 2x2 of a 4x4 node by one generation
+ */
+static node_t* successor_base(board_t* b, node_t* node)
+{
+    node_t* q[2][2] = {{node->nw, node->ne}, {node->sw, node->se}};
+    int c[4][4];
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j) {
+            node_t* p = q[i/2][j/2];
+            node_t* r[2][2] = {{p->nw, p->ne}, {p->sw, p->se}};
+            c[i][j] = r[i%2][j%2]->live;
+        }
+
+    node_t* out[2][2];
+    for (int i = 1; i <= 2; ++i)
+        for (int j = 1; j <= 2; ++j) {
+            int x = 0;
+            for (int k = -1; k <= 1; ++k)
+                for (int l = -1; l <= 1; ++l)
+                    x += c[i+k][j+l];
+            x = 2*x-c[i][j];
+            out[i-1][j-1] = RULE_NEXT(b->rule, x) ? &(b->alive) : &(b->dead);
+        }
+    return join(b, out[0][0], out[0][1], out[1][0], out[1][1]);
+}
+
+
+/**
+ * Return the central level L-1 square of a level L node after 2^j
+ * generations (j <= L-2).
+ */
+static node_t* successor(board_t* b, node_t* node, int j)
+{
+    if (!node->live)
+        return empty_node(b, node->level-1);
+    if (node->result && node->rstep == j)
+        return node->result;
+
+    int k = node->level;
+    node_t* r;
+
+    if (k == 2) {
+        r = successor_base(b, node);
+    } else {
+        node_t *nw = node->nw, *ne = node->ne, *sw = node->sw, *se = node->se;
+        node_t* s[3][3];
+        s[0][0] = nw;
+        s[0][1] = join(b, nw->ne, ne->nw, nw->se, ne->sw);
+        s[0][2] = ne;
+        s[1][0] = join(b, nw->sw, nw->se, sw->nw, sw->ne);
+        s[1][1] = join(b, nw->se, ne->sw, sw->ne, se->nw);
+        s[1][2] = join(b, ne->sw, ne->se, se->nw, se->ne);
+        s[2][0] = sw;
+        s[2][1] = join(b, sw->ne, se->nw, sw->se, se->sw);
+        s[2][2] = se;
+
+        /* Either advance the nine pieces (full speed), or just take
+         * their centers and do all the time stepping in the second
+         * half. */
+        int full = (j == k-2);
+        for (int p = 0; p < 3; ++p)
+            for (int q = 0; q < 3; ++q)
+                s[p][q] = full ?
+                    successor(b, s[p][q], k-3) :
+                    centre(b, s[p][q]);
+
+        int jj = full ? k-3 : j;
+        node_t* t[2][2];
+        for (int p = 0; p < 2; ++p)
+            for (int q = 0; q < 2; ++q) {
+                node_t* u = join(b, s[p][q],   s[p][q+1],
+                                    s[p+1][q], s[p+1][q+1]);
+                t[p][q] = successor(b, u, jj);
+            }
+        r = join(b, t[0][0], t[0][1], t[1][0], t[1][1]);
+    }
+
+    node->result = r;
+    node->rstep = j;
+    return r;
+}
+
+
+/**
+ * Find or insert a slot for (level, x, y) in the build memo
+ */
+static build_entry_t* memo_slot(board_t* b, int level, int x, int y)
+{
+    if (2*(b->nmemo+1) > b->memosize) {
+        build_entry_t* old = b->memo;
+        size_t oldsize = b->memosize;
+        b->memosize = oldsize ? 2*oldsize : 1024;
+        b->memo = (build_entry_t*) calloc(b->memosize,
+                                          sizeof(build_entry_t));
+        b->nmemo = 0;
+        for (size_t k = 0; k < oldsize; ++k)
+            if (old[k].node) {
+                build_entry_t* e = memo_slot(b, old[k].level,
+                                             old[k].x, old[k].y);
+                *e = old[k];
+                ++(b->nmemo);
+            }
+        free(old);
+    }
+
+    size_t h = hash4((node_t*) (uintptr_t) level, (node_t*) (uintptr_t) x,
+                     (node_t*) (uintptr_t) y, NULL) & (b->memosize-1);
+    while (b->memo[h].node &&
+           (b->memo[h].level != level ||
+            b->memo[h].x != x || b->memo[h].y != y))
+        h = (h+1) & (b->memosize-1);
+    return b->memo + h;
+}
+
+
+/**
+ * Number of distinct residues mod n of multiples of 2^level
+ */
+static long residues(int n, int level)
+{
+    long r = n;
+    for (int l = 0; l < level && r % 2 == 0; ++l)
+        r /= 2;
+    return r;
+}
+
+
+/**
+ * The level L subtree of the root with top left corner at (x,y), which
+ * must be a multiple of 2^L
+ */
+static node_t* subtree(board_t* b, int level, long x, long y)
+{
+    node_t* node = b->root;
+    for (int l = b->m; l > level && node->live; --l) {
+        long h = 1L << (l-1);
+        int south = (x & h) != 0, east = (y & h) != 0;
+        node = south ? (east ? node->se : node->sw) :
+                       (east ? node->ne : node->nw);
+    }
+    return node->live ? node : empty_node(b, level);
+}
+
+
+/**
+ * Is any cell of rows [i0,i1) and columns [j0,j1) live in the level L
+ * node with top left corner at (x,y)?
+ */
+static int rect_live(node_t* node, int level, long x, long y,
+                     long i0, long i1, long j0, long j1)
+{
+    long s = 1L << level;
+    if (!node->live || x >= i1 || x+s <= i0 || y >= j1 || y+s <= j0)
+        return 0;
+    if (level == 0 || (x >= i0 && x+s <= i1 && y >= j0 && y+s <= j1))
+        return 1;
+    long h = s/2;
+    return rect_live(node->nw, level-1, x,   y,   i0, i1, j0, j1) ||
+           rect_live(node->ne, level-1, x,   y+h, i0, i1, j0, j1) ||
+           rect_live(node->sw, level-1, x+h, y,   i0, i1, j0, j1) ||
+           rect_live(node->se, level-1, x+h, y+h, i0, i1, j0, j1);
+}
+
+
+/**
+ * Is any cell live in the s-by-s square of the torus at (x,y)?  The
+ * square is cut where it wraps around.
+ */
+static int square_live(board_t* b, int x, int y, long s)
+{
+    int n = b->n;
+    if (s >= n)
+        return b->root->live;
+    long i1 = x+s < n ? x+s : n, iw = x+s-n;
+    long j1 = y+s < n ? y+s : n, jw = y+s-n;
+    return rect_live(b->root, b->m, 0, 0, x, i1, y, j1) ||
+        (iw > 0 && rect_live(b->root, b->m, 0, 0, 0, iw, y, j1)) ||
+        (jw > 0 && rect_live(b->root, b->m, 0, 0, x, i1, 0, jw)) ||
+        (iw > 0 && jw > 0 && rect_live(b->root, b->m, 0, 0, 0, iw, 0, jw));
+}
+
+
+/**
+ * Build the level L node of the periodic tiling whose top left corner
+ * is at (x,y) on the torus, as part of a level top node.  Squares that
+ * line up with the root's are taken from it, and dead ones are the
+ * empty node.  We memoize at levels where the same corner position mod
+ * n comes up more than once.
+ */
+static node_t* build(board_t* b, int level, int top, int x, int y)
+{
+    int n = b->n;
+    long s = 1L << level;
+    if (x % s == 0 && y % s == 0 && x+s <= n && y+s <= n)
+        return subtree(b, level, x, y);
+    if (!square_live(b, x, y, s))
+        return empty_node(b, level);
+
+    int use_memo = (top-level < 31 &&
+                    (1L << (top-level)) > residues(n, level));
+    if (use_memo) {
+        build_entry_t* e = memo_slot(b, level, x, y);
+        if (e->node)
+            return e->node;
+    }
+
+    long h = s/2;
+    int x1 = (int) ((x + h) % n);
+    int y1 = (int) ((y + h) % n);
+    node_t* nw = build(b, level-1, top, x,  y);
+    node_t* ne = build(b, level-1, top, x,  y1);
+    node_t* sw = build(b, level-1, top, x1, y);
+    node_t* se = build(b, level-1, top, x1, y1);
+    node_t* node = join(b, nw, ne, sw, se);
+
+    if (use_memo) {
+        build_entry_t* e = memo_slot(b, level, x, y);
+        e->level = level;
+        e->x = x;
+        e->y = y;
+        e->node = node;
+        ++(b->nmemo);
+    }
+    return node;
+}
+
+
+/**
+ * Build the level L node at (x,y) from the cell array, before the first
+ * jump; only the bounding box of the set cells is visited
+ */
+static node_t* build_cells(board_t* b, int level, long x, long y)
+{
+    int n = b->n;
+    long s = 1L << level;
+    if (x > b->imax || x+s <= b->imin || y > b->jmax || y+s <= b->jmin)
+        return empty_node(b, level);
+    if (level == 0)
+        return b->cells[(size_t) x*n + y] ? &(b->alive) : &(b->dead);
+    long h = s/2;
+    return join(b, build_cells(b, level-1, x,   y),
+                   build_cells(b, level-1, x,   y+h),
+                   build_cells(b, level-1, x+h, y),
+                   build_cells(b, level-1, x+h, y+h));
+}
+
+
+/**
+ * The part of a level L node at (x,y) that lies in [0,n)^2, dead
+ * elsewhere
+ */
+static node_t* clip(board_t* b, node_t* node, int level, long x, long y)
+{
+    int n = b->n;
+    long s = 1L << level;
+    if (!node->live || (x+s <= n && y+s <= n))
+        return node;
+    if (x >= n || y >= n)
+        return empty_node(b, level);
+    long h = s/2;
+    return join(b, clip(b, node->nw, level-1, x,   y),
+                   clip(b, node->ne, level-1, x,   y+h),
+                   clip(b, node->sw, level-1, x+h, y),
+                   clip(b, node->se, level-1, x+h, y+h));
+}
+
+
+/**
+ * Copy row i of a level L node at world position (x,y) into the cell
+ * array (which must be clear there)
+ */
+static void extract_row(board_t* b, node_t* node, int level,
+                        long x, long y, int i)
+{
+    int n = b->n;
+    if (!node->live || y >= n)
+        return;
+    if (level == 0) {
+        b->cells[(size_t) i*n + y] = 1;
+        return;
+    }
+    long h = 1L << (level-1);
+    if (i < x+h) {
+        extract_row(b, node->nw, level-1, x, y,   i);
+        extract_row(b, node->ne, level-1, x, y+h, i);
+    } else {
+        extract_row(b, node->sw, level-1, x+h, y,   i);
+        extract_row(b, node->se, level-1, x+h, y+h, i);
+    }
+}
+
+
+/**
+ * Bring row i of the cell array up to date with the root
+ */
+static void materialize_row(board_t* b, int i)
+{
+    int n = b->n;
+    memset(b->cells + (size_t) i*n, 0, n);
+    extract_row(b, b->root, b->m, 0, 0, i);
+    b->rowstamp[i] = b->stamp;
+}
+
+
+/**
+ * Advance the board by 2^j generations
+ */
+static void advance_pow2(board_t* b, int j)
+{
+    int n = b->n;
+    size_t nstart = b->nnodes;
+
+    if (!b->root)
+        b->root = build_cells(b, b->m, 0, 0);
+
+    /* Result (the middle half of the node) must cover the board */
+    int level = (j+2 > b->m+1) ? j+2 : b->m+1;
+
+    /* Put the board origin at the top left of the result */
+    long quarter = 1L << (level-2);
+    int x0 = (int) (((-quarter) % n + n) % n);
+
+    node_t* top = build(b, level, level, x0, x0);
+    free(b->memo);
+    b->memo = NULL;
+    b->memosize = b->nmemo = 0;
+
+    /* The board is the top left 2^m square of the result */
+    node_t* result = successor(b, top, j);
+    for (int l = level-1; l > b->m; --l)
+        result = result->nw;
+    b->root = clip(b, result, b->m, 0, 0);
+    ++(b->stamp);
+
+    if (b->maxnodes && b->nnodes > b->maxnodes) {
+        if (b->nnodes - nstart > b->maxnodes && j > 0)
+            b->maxjump = j-1;
+        collect_garbage(b, b->root);
+    }
+}
+
+
+/**
+ * Create the board for the problem
+ */
+void create_board(problem_t* problem)
+{
+    int n = problem->nboard;
+    board_t* b = (board_t*) calloc(1, sizeof(board_t));
+    b->n = n;
+    b->rule = problem->rule;
+    b->cells = (char*) calloc((size_t) n * n, 1);
+    b->rowstamp = (int*) calloc(n, sizeof(int));
+    while ((1L << b->m) < n)
+        ++(b->m);
+    b->imin = b->jmin = n;
+    b->imax = b->jmax = -1;
+    b->dead.level = 0;
+    b->dead.live = 0;
+    b->alive.level = 0;
+    b->alive.live = 1;
+    b->empty[0] = &(b->dead);
+    b->tsize = 1 << 16;
+    b->table = (node_t**) calloc(b->tsize, sizeof(node_t*));
+    b->maxnodes = (size_t) problem->maxmem * 1024 * 1024 / sizeof(node_t);
+    b->maxjump = 30;
+    problem->board = b;
+}
+
+
+/**
+ * Free the memory associated with a board (and report cache usage)
+ */
+void destroy_board(problem_t* problem)
+{
+    board_t* b = problem->board;
+    snprintf(problem->stats, sizeof(problem->stats),
+             "Nodes: %zu (%d garbage collections)", b->nnodes, b->ngc);
+    for (size_t k = 0; k < b->tsize; ++k) {
+        node_t* next;
+        for (node_t* p = b->table[k]; p; p = next) {
+            next = p->next;
+            free(p);
+        }
+    }
+    while (b->freelist) {
+        node_t* next = b->freelist->next;
+        free(b->freelist);
+        b->freelist = next;
+    }
+    free(b->table);
+    free(b->memo);
+    free(b->cells);
+    free(b->rowstamp);
+    free(b);
+    problem->board = NULL;
+}
+
+
+/**
+ * Set one cell in the problem.  Cells are set in the cell array; if
+ * the board has already been advanced, the array is brought up to date
+ * and the root dropped, to be built again on the next jump.
+ */
+void set_cell(problem_t* problem, int i, int j)
+{
+    int n = problem->nboard;
+    board_t* b = problem->board;
+    if (i < 0 || i >= n || j < 0 || j >= n)
+        return;
+    if (b->root) {
+        for (int k = 0; k < n; ++k)
+            if (b->rowstamp[k] != b->stamp)
+                materialize_row(b, k);
+        b->root = NULL;
+        b->imin = b->jmin = 0;
+        b->imax = b->jmax = n-1;
+    }
+    b->cells[(size_t) i*n + j] = 1;
+    if (i < b->imin) b->imin = i;
+    if (i > b->imax) b->imax = i;
+    if (j < b->jmin) b->jmin = j;
+    if (j > b->jmax) b->jmax = j;
+}
+
+
+/**
+ * Get one cell in the problem.  The first call for a row after a jump
+ * fills that row in from the root, so calls from different threads
+ * must be for different rows (as in board_checksum).
+ */
+char get_cell(problem_t* problem, int i, int j)
+{
+    int n = problem->nboard;
+    board_t* b = problem->board;
+    if (b->root && b->rowstamp[i] != b->stamp)
+        materialize_row(b, i);
+    return b->cells[(size_t) i*n + j];
+}
+
+
+/**
+ * Advance the board by steps generations, in jumps of powers of two
+ */
+void advance_board(problem_t* problem, int steps)
+{
+    board_t* b = problem->board;
+    while (steps > 0) {
+        int j = b->maxjump;
+        while ((1L << j) > steps)
+            --j;
+        advance_pow2(b, j);
+        steps -= 1 << j;
+    }
+}
@@ -0,0 +1,380 @@
+/*
+ * life_bench.c - Benchmark and cross-check harness for Life engines
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "life_common.h"
+#include "life_io.h"
+
+
+/**
+ * Each engine is compiled a second time for the benchmark with its
+ * entry points renamed (e.g. create_board becomes basic_create_board;
+ * see the Makefile), so that all of them can live in one binary.
+ */
+#define ENGINE_DECL(name)                                       \
+    void name##_create_board(problem_t* problem);               \
+    void name##_destroy_board(problem_t* problem);              \
+    void name##_advance_board(problem_t* problem, int steps);   \
+    void name##_set_cell(problem_t* problem, int i, int j);     \
+    char name##_get_cell(problem_t* problem, int i, int j);
+
+ENGINE_DECL(basic)
+ENGINE_DECL(bitpack)
+ENGINE_DECL(tiled)
+ENGINE_DECL(active)
+ENGINE_DECL(hashlife)
+
+
+/**
+ * The `engine_t` type records an engine's entry points together with
+ * a nominal count of the bytes moved to and from memory per cell per
+ * sweep over the board (read the old state, write the new one).
+ * Blocked engines sweep the board once every k generations; engines
+ * for which the count is not meaningful (hashlife) use NAN.  An engine
+ * that measures its traffic (active, which skips quiet tiles) reports
+ * it in problem->bytes_per_cell, and that replaces the nominal count.
+ */
+typedef struct engine_t {
+    const char* name;
+    void (*create_board)(problem_t* problem);
+    void (*destroy_board)(problem_t* problem);
+    void (*advance_board)(problem_t* problem, int steps);
+    void (*set_cell)(problem_t* problem, int i, int j);
+    char (*get_cell)(problem_t* problem, int i, int j);
+    double bytes_per_cell;  /* Nominal traffic per cell per sweep */
+    int blocked;            /* Does a sweep cover k generations? */
+} engine_t;
+
+#define ENGINE(name, bytes, blocked)                            \
+    { #name, name##_create_board, name##_destroy_board,         \
+      name##_advance_board, name##_set_cell, name##_get_cell,   \
+      bytes, blocked }
+
+static engine_t engines[] = {
+    ENGINE(basic,    2.0,  0),
+    ENGINE(bitpack,  0.25, 0),
+    ENGINE(tiled,    2.0,  1),
+    ENGINE(active,   2.0,  0),
+    ENGINE(hashlife, NAN,  0)
+};
+
+#define NENGINES ((int) (sizeof(engines) / sizeof(engines[0])))
+
+
+/**
+ * The life_common.h interface dispatches to the engine being measured,
+ * so the shared loaders and board_checksum work unchanged.
+ */
+static engine_t* engine = &engines[0];
+
+void create_board(problem_t* problem)
+{
+    engine->create_board(problem);
+}
+
+void destroy_board(problem_t* problem)
+{
+    engine->destroy_board(problem);
+}
+
+void advance_board(problem_t* problem, int steps)
+{
+    engine->advance_board(problem, steps);
+}
+
+void set_cell(problem_t* problem, int i, int j)
+{
+    engine->set_cell(problem, i, j);
+}
+
+char get_cell(problem_t* problem, int i, int j)
+{
+    return engine->get_cell(problem, i, j);
+}
+
+
+/**
+ * Look up an engine by name
+ */
+static engine_t* find_engine(const char* name)
+{
+    for (int i = 0; i < NENGINES; ++i)
+        if (strcmp(engines[i].name, name) == 0)
+            return &engines[i];
+    fprintf(stderr, "Unknown engine: %s\n", name);
+    exit(-1);
+}
+
+
+/**
+ * Set up a board from a seed: either "random" (each cell live with
+ * probability 1/3, from a fixed generator so every engine sees the
+ * same board) or a board file in any format load_board accepts.
+ */
+static void seed_board(problem_t* problem, const char* seed)
+{
+    if (strcmp(seed, "random") == 0) {
+        int n = problem->nboard;
+        uint32_t state = 12345u + (uint32_t) n;
+        create_board(problem);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                state = state * 1664525u + 1013904223u;
+                if ((state >> 16) % 3 == 0)
+                    set_cell(problem, i, j);
+            }
+        }
+    } else {
+        load_board(problem, seed, 0);
+    }
+}
+
+
+/**
+ * Run one engine on one configuration and return cells per second,
+ * storing the final checksum.  The engine's own figures are left in
+ * problem->stats and problem->bytes_per_cell.
+ */
+static double run_once(engine_t* e, const char* seed, int n, int g, int k,
+                       uint32_t* checksum, problem_t* problem)
+{
+    memset(problem, 0, sizeof(*problem));
+    problem->nboard = n;
+    problem->g = g;
+    problem->k = k;
+    problem->rule = RULE_CONWAY;
+
+    engine = e;
+    seed_board(problem, seed);
+    double t0 = omp_get_wtime();
+    advance_board(problem, g);
+    double t1 = omp_get_wtime();
+    *checksum = board_checksum(problem);
+    destroy_board(problem);
+    return (double) g * n * n / (t1-t0);
+}
+
+
+/**
+ * Split a comma-separated list in place
+ */
+static int split_list(char* s, char** items, int max)
+{
+    int count = 0;
+    for (char* tok = strtok(s, ","); tok && count < max;
+         tok = strtok(NULL, ","))
+        items[count++] = tok;
+    return count;
+}
+
+static int parse_ints(char* s, int* vals, int max)
+{
+    char* items[64];
+    int count = split_list(s, items, max < 64 ? max : 64);
+    for (int i = 0; i < count; ++i)
+        vals[i] = atoi(items[i]);
+    return count;
+}
+
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * Print a usage message and quit
+ */
+static void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [-e engines] [-n sizes] [-g gens] [-s seeds]"
+            " [-t threads]\n"
+            "       [-k depth] [-r reps] [-o results.csv|results.json]\n",
+            name);
+    exit(-1);
+}
+
+
+/**
+ * Sweep engines, board sizes, generation counts, seeds and thread
+ * counts (each a comma-separated list):
+ *   -e engines = engines to run (default all)
+ *   -n sizes = board sizes
+ *   -g gens = generation counts
+ *   -s seeds = "random" or board files
+ *   -t threads = OpenMP thread counts
+ *   -k depth = generations per halo exchange (blocked engines)
+ *   -r reps = timed repetitions per configuration
+ *   -o file = results file (default life_bench.csv); JSON if it
+ *             ends in .json, else CSV
+ *
+ * Every run's checksum is compared against basic on the same seed,
+ * size and generation count; any mismatch makes the exit status
+ * nonzero.  Engines that report figures of their own (tiles skipped,
+ * hash nodes) have them printed on stdout, one line per configuration.
+ */
+int main(int argc, char** argv)
+{
+    char* enames[NENGINES];
+    char* seeds[64];
+    int sizes[64], gens[64], threads[64];
+    int nengines = 0, nseeds = 1, nsizes = 1, ngens = 1, nthreads = 1;
+    int k = 8, reps = 5;
+    const char* outname = "life_bench.csv";
+
+    seeds[0] = "random";
+    sizes[0] = 1000;
+    gens[0] = 100;
+    threads[0] = omp_get_max_threads();
+
+    for (int i = 1; i < argc; ++i) {
+        if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'e':
+                nengines = split_list(argv[++i], enames, NENGINES);
+                break;
+            case 'n':
+                nsizes = parse_ints(argv[++i], sizes, 64);
+                break;
+            case 'g':
+                ngens = parse_ints(argv[++i], gens, 64);
+                break;
+            case 's':
+                nseeds = split_list(argv[++i], seeds, 64);
+                break;
+            case 't':
+                nthreads = parse_ints(argv[++i], threads, 64);
+                break;
+            case 'k':
+                k = atoi(argv[++i]);
+                break;
+            case 'r':
+                reps = atoi(argv[++i]);
+                break;
+            case 'o':
+                outname = argv[++i];
+                break;
+            default:
+                fprintf(stderr, "Unknown flag: %s", argv[i]);
+                print_usage_quit(argv[0]);
+            }
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    if (k < 1 || reps < 1) {
+        fprintf(stderr, "Halo depth and repetitions must be positive\n");
+        print_usage_quit(argv[0]);
+    }
+
+    engine_t* run[NENGINES];
+    if (nengines == 0) {
+        nengines = NENGINES;
+        for (int i = 0; i < NENGINES; ++i)
+            run[i] = &engines[i];
+    } else {
+        for (int i = 0; i < nengines; ++i)
+            run[i] = find_engine(enames[i]);
+    }
+
+    size_t len = strlen(outname);
+    int json = (len > 5 && strcmp(outname+len-5, ".json") == 0);
+    FILE* fp = fopen(outname, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open results file: %s\n", outname);
+        exit(-2);
+    }
+    if (json)
+        fprintf(fp, "[\n");
+    else
+        fprintf(fp, "engine,seed,n,g,threads,reps,median_cells_per_sec,"
+                "variance,bytes_per_cell,checksum,ok\n");
+
+    double* rates = (double*) malloc(reps * sizeof(double));
+    int nrows = 0, failures = 0;
+    for (int is = 0; is < nseeds; ++is) {
+    for (int in = 0; in < nsizes; ++in) {
+    for (int ig = 0; ig < ngens; ++ig) {
+        const char* seed = seeds[is];
+        int n = sizes[in], g = gens[ig];
+        uint32_t reference;
+        problem_t problem;
+        omp_set_num_threads(1);
+        run_once(&engines[0], seed, n, g, k, &reference, &problem);
+
+        for (int ie = 0; ie < nengines; ++ie) {
+        for (int it = 0; it < nthreads; ++it) {
+            engine_t* e = run[ie];
+            int ok = 1;
+            uint32_t checksum = 0;
+            omp_set_num_threads(threads[it]);
+            for (int r = 0; r < reps; ++r) {
+                rates[r] = run_once(e, seed, n, g, k, &checksum, &problem);
+                ok = ok && (checksum == reference);
+            }
+            if (!ok) {
+                fprintf(stderr, "MISMATCH: %s on %s n=%d g=%d"
+                        " threads=%d: %08X (basic %08X)\n",
+                        e->name, seed, n, g, threads[it],
+                        checksum, reference);
+                ++failures;
+            }
+
+            /* Median and sample variance of the rate */
+            double mean = 0, var = 0;
+            for (int r = 0; r < reps; ++r)
+                mean += rates[r] / reps;
+            for (int r = 0; r < reps; ++r)
+                var += (rates[r]-mean) * (rates[r]-mean);
+            var = (reps > 1) ? var / (reps-1) : 0;
+            qsort(rates, reps, sizeof(double), compare_double);
+            double median = (reps % 2) ? rates[reps/2] :
+                (rates[reps/2-1] + rates[reps/2]) / 2;
+            double bytes = e->bytes_per_cell / (e->blocked ? k : 1);
+            if (problem.bytes_per_cell > 0)
+                bytes = problem.bytes_per_cell;
+            if (problem.stats[0])
+                printf("%s on %s n=%d g=%d threads=%d: %s\n", e->name,
+                       seed, n, g, threads[it], problem.stats);
+
+            if (json) {
+                fprintf(fp, "%s  {\"engine\": \"%s\", \"seed\": \"%s\","
+                        " \"n\": %d, \"g\": %d, \"threads\": %d,"
+                        " \"reps\": %d, \"median_cells_per_sec\": %e,"
+                        " \"variance\": %e, \"bytes_per_cell\": ",
+                        nrows ? ",\n" : "", e->name, seed,
+                        n, g, threads[it], reps, median, var);
+                if (isnan(bytes))
+                    fprintf(fp, "null");
+                else
+                    fprintf(fp, "%g", bytes);
+                fprintf(fp, ", \"checksum\": \"%08X\", \"ok\": %s}",
+                        checksum, ok ? "true" : "false");
+            } else {
+                fprintf(fp, "%s,%s,%d,%d,%d,%d,%e,%e,", e->name, seed,
+                        n, g, threads[it], reps, median, var);
+                if (!isnan(bytes))
+                    fprintf(fp, "%g", bytes);
+                fprintf(fp, ",%08X,%d\n", checksum, ok);
+            }
+            fflush(fp);
+            ++nrows;
+        }}
+    }}}
+    if (json)
+        fprintf(fp, "\n]\n");
+
+    free(rates);
+    fclose(fp);
+    return failures ? 1 : 0;
+}
@@ -1,12 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
 
-#ifdef WITH_TIMING
+#if defined(WITH_TIMING) || defined(_OPENMP)
 #include <omp.h>
 #endif
 
 #include "crc32.h"
 #include "life_common.h"
+#include "life_io.h"
 
 
 /**
@@ -24,36 +26,78 @@ void print_board(problem_t* problem)
 
 
 /**
- * Compute a CRC32 checksum of the board state
+ * Compute a CRC32 checksum of the board state (row by row).  Each
+ * thread checksums a contiguous chunk of rows, and the chunk CRCs are
+ * merged in order with crc32_combine, so the result does not depend
+ * on the number of threads.
  */
 uint32_t board_checksum(problem_t* problem)
 {
     int n = problem->nboard;
-    uint32_t result = 0;
-    for (int i = 0; i < n; ++i)
-        for (int j = 0; j < n; ++j) {
-            char c = get_cell(problem,i,j);
-            result = crc32(result, &c, 1);
+    int nchunks = 1;
+#ifdef _OPENMP
+    nchunks = omp_get_max_threads();
+#endif
+    uint32_t* crcs = (uint32_t*) malloc(nchunks * sizeof(uint32_t));
+
+    #pragma omp parallel for schedule(static,1)
+    for (int c = 0; c < nchunks; ++c) {
+        int i0 = (int) ((long) n * c / nchunks);
+        int i1 = (int) ((long) n * (c+1) / nchunks);
+        char* row = (char*) malloc(n);
+        uint32_t crc = 0;
+        for (int i = i0; i < i1; ++i) {
+            for (int j = 0; j < n; ++j)
+                row[j] = get_cell(problem,i,j);
+            crc = crc32(crc, row, n);
         }
+        crcs[c] = crc;
+        free(row);
+    }
+
+    uint32_t result = 0;
+    for (int c = 0; c < nchunks; ++c) {
+        int i0 = (int) ((long) n * c / nchunks);
+        int i1 = (int) ((long) n * (c+1) / nchunks);
+        result = crc32_combine(result, crcs[c], (size_t) (i1-i0) * n);
+    }
+    free(crcs);
     return result;
 }
 
 
 /**
- * Read a file of (i,j) pairs specifying an initial set of live cells
+ * Parse a B/S rulestring (in either order, case insensitive).  Rules
+ * with B0 are rejected: they make empty space come alive, which the
+ * engines that skip empty regions (active, hashlife) do not handle.
  */
-void read_board(problem_t* problem)
+int parse_rule(const char* s, uint32_t* rule)
 {
-    FILE* fp = fopen(problem->init, "r");
-    int i, j;
-    if (fp == NULL) {
-        fprintf(stderr, "Could not open board file: %s\n", problem->init);
-        exit(-2);
+    uint32_t mask = 0;
+    int seen = 0;
+    while (*s) {
+        int survive;
+        char c = toupper((unsigned char) *s++);
+        if (c == 'B')
+            survive = 0;
+        else if (c == 'S')
+            survive = 1;
+        else
+            return 0;
+        if (seen & (1 << survive))
+            return 0;
+        seen |= 1 << survive;
+        for (; *s >= '0' && *s <= '8'; ++s)
+            mask |= 1u << (2*(*s-'0') + survive);
+        if (*s == '/')
+            ++s;
+        else if (*s)
+            return 0;
     }
-    create_board(problem);
-    while (fscanf(fp, "%d %d", &i, &j) == 2)
-        set_cell(problem, i, j);
-    fclose(fp);
+    if (seen != 3 || (mask & 1))
+        return 0;
+    *rule = mask;
+    return 1;
 }
 
 
@@ -63,7 +107,11 @@ void read_board(problem_t* problem)
 void print_usage_quit(const char* name)
 {
     fprintf(stderr,
-            "Usage: %s [-v] [-f init] [-n boardsize] [-g generations]\n",
+            "Usage: %s [-v] [-f init] [-n boardsize] [-g generations]"
+            " [-k depth] [-m maxmem]\n"
+            "       [-c interval] [-o checkpoint] [-r checkpoint]"
+            " [-p maxperiod]\n"
+            "       [-R rulestring]\n",
             name);
     exit(-1);
 }
@@ -75,6 +123,18 @@ void print_usage_quit(const char* name)
  *   -f init = use init as file to describe start state
  *   -n size = set the board size (always square with wraparound)
  *   -g step = set the number of generations
+ *   -k depth = generations between halo exchanges (blocked engines)
+ *   -m maxmem = bound on cache memory in MB (hashlife)
+ *   -c interval = write a checkpoint every interval generations
+ *   -o file = checkpoint file name (default life.ckpt)
+ *   -r file = restart from a checkpoint (sets board size)
+ *   -p maxperiod = detect cycles of period up to maxperiod and skip them
+ *   -R rule = outer-totalistic rule such as B36/S23 (default B3/S23,
+ *             or the rule recorded in the init file or checkpoint)
+ *
+ * The init file may be a text file of (i,j) pairs, an RLE pattern,
+ * or a binary board (see life_io.h).  On restart, -g is the total
+ * generation count, including those run before the checkpoint.
  */
 void read_options(int argc, char** argv, problem_t* problem)
 {
@@ -82,7 +142,18 @@ void read_options(int argc, char** argv, problem_t* problem)
     problem->verbose = 0;
     problem->nboard = 100;
     problem->g = 100;
+    problem->k = 1;
+    problem->maxmem = 0;
+    problem->maxperiod = 0;
+    problem->rule = RULE_CONWAY;
+    problem->rule_set = 0;
+    problem->gen = 0;
+    problem->ckpt = 0;
+    problem->ckpt_file = "life.ckpt";
+    problem->restart = 0;
     problem->init = NULL;
+    problem->stats[0] = '\0';
+    problem->bytes_per_cell = 0;
 
     for (int i = 1; i < argc; ++i) {
         if (*argv[i] == '-' && i+1 < argc) {
@@ -93,8 +164,35 @@ void read_options(int argc, char** argv, problem_t* problem)
             case 'g':
                 problem->g = atoi(argv[++i]);
                 break;
+            case 'k':
+                problem->k = atoi(argv[++i]);
+                break;
+            case 'm':
+                problem->maxmem = atoi(argv[++i]);
+                break;
+            case 'R':
+                if (!parse_rule(argv[++i], &problem->rule)) {
+                    fprintf(stderr, "Invalid rule: %s\n", argv[i]);
+                    print_usage_quit(argv[0]);
+                }
+                problem->rule_set = 1;
+                break;
+            case 'p':
+                problem->maxperiod = atoi(argv[++i]);
+                break;
+            case 'c':
+                problem->ckpt = atoi(argv[++i]);
+                break;
+            case 'o':
+                problem->ckpt_file = argv[++i];
+                break;
+            case 'r':
+                problem->init = argv[++i];
+                problem->restart = 1;
+                break;
             case 'f':
                 problem->init = argv[++i];
+                problem->restart = 0;
                 break;
             case 'v':
                 problem->verbose = 1;
@@ -107,23 +205,106 @@ void read_options(int argc, char** argv, problem_t* problem)
             print_usage_quit(argv[0]);
         }
     }
+    if (problem->k < 1) {
+        fprintf(stderr, "Halo depth must be positive\n");
+        print_usage_quit(argv[0]);
+    }
+    if (problem->ckpt < 0) {
+        fprintf(stderr, "Checkpoint interval must be nonnegative\n");
+        print_usage_quit(argv[0]);
+    }
+    if (problem->maxperiod < 0) {
+        fprintf(stderr, "Maximum period must be nonnegative\n");
+        print_usage_quit(argv[0]);
+    }
     if (problem->init == NULL) {
         fprintf(stderr, "Initialization file not specified\n");
         print_usage_quit(argv[0]);
     }
-    read_board(problem);
+    load_board(problem, problem->init, problem->restart);
+}
+
+
+/**
+ * Advance the board from the starting generation to generation g,
+ * stopping at each multiple of the checkpoint interval to start a
+ * checkpoint write.  The writes overlap the following generations.
+ *
+ * If maxperiod is set, we step one generation at a time and keep the
+ * board checksums of the last maxperiod+1 generations in a ring.  When
+ * the checksum matches the one p generations back (for the smallest
+ * such p), we take p as a candidate period and confirm it by checking
+ * that the next p generations also repeat; this makes a false match
+ * from a CRC collision vanishingly unlikely.  Once confirmed, we skip
+ * ahead by whole periods and finish the remaining (g-gen) mod p
+ * generations normally.
+ */
+void run_board(problem_t* problem)
+{
+    int gen = problem->gen;
+    int maxp = problem->maxperiod;
+    int nring = maxp+1;
+    uint32_t* hashes = NULL;
+    int detecting = (maxp > 0);
+    int period = 0;         /* Candidate period (0 if none) */
+    int start = 0;          /* Generation where candidate was found */
+
+    if (detecting) {
+        hashes = (uint32_t*) malloc(nring * sizeof(uint32_t));
+        hashes[gen % nring] = board_checksum(problem);
+    }
+
+    while (gen < problem->g) {
+        int steps = problem->g - gen;
+        if (detecting)
+            steps = 1;
+        if (problem->ckpt) {
+            int next = (gen / problem->ckpt + 1) * problem->ckpt;
+            if (next - gen < steps)
+                steps = next - gen;
+        }
+        advance_board(problem, steps);
+        gen += steps;
+
+        if (detecting) {
+            uint32_t h = board_checksum(problem);
+            hashes[gen % nring] = h;
+            if (period && h != hashes[(gen-period) % nring])
+                period = 0;
+            if (!period) {
+                for (int p = 1; p <= maxp && p <= gen-problem->gen; ++p) {
+                    if (hashes[(gen-p) % nring] == h) {
+                        period = p;
+                        start = gen;
+                        break;
+                    }
+                }
+            } else if (gen-start == period) {
+                printf("Transient: %d\n", start-period);
+                printf("Period: %d\n", period);
+                gen += (problem->g - gen) / period * period;
+                detecting = 0;
+            }
+        }
+
+        if (problem->ckpt && (gen % problem->ckpt == 0 || gen == problem->g))
+            write_checkpoint(problem, gen);
+    }
+    wait_checkpoint();
+    free(hashes);
 }
 
 
+#ifndef LIFE_BENCH
 /**
- * Main routine
+ * Main routine (life_bench.c has its own)
  */
 int main(int argc, char** argv)
 {
     problem_t problem;
     read_options(argc, argv, &problem);
     if (problem.verbose) {
-        for (int i = 0; i < problem.g; ++i) {
+        for (int i = problem.gen; i < problem.g; ++i) {
             printf("\nGeneration %d\n", i);
             print_board(&problem);
             advance_board(&problem, 1);
@@ -131,15 +312,20 @@ int main(int argc, char** argv)
     } else {
 #ifdef WITH_TIMING
         double t0 = omp_get_wtime();
-        advance_board(&problem, problem.g);
+        run_board(&problem);
         double t1 = omp_get_wtime();
+        printf("Threads: %d\n", omp_get_max_threads());
         printf("Cells / sec: %e\n",
-               problem.g * problem.nboard * problem.nboard / (t1-t0));
+               (double) (problem.g - problem.gen) *
+               problem.nboard * problem.nboard / (t1-t0));
 #else
-        advance_board(&problem, problem.g);
+        run_board(&problem);
 #endif
     }
     printf("Final checksum: %08X\n", board_checksum(&problem));
     destroy_board(&problem);
+    if (problem.stats[0])
+        printf("%s\n", problem.stats);
     return 0;
 }
+#endif /* LIFE_BENCH */
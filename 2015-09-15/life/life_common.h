@@ -14,6 +14,49 @@
 struct board_t;
 
 
+/**
+ * An outer-totalistic rule (such as Conway's B3/S23) is stored as a
+ * bit mask indexed by x = 2*neighbors + alive: bit 2k is set if a dead
+ * cell with k live neighbors is born, and bit 2k+1 is set if a live
+ * cell with k live neighbors survives.
+ */
+#define RULE_CONWAY   0x000E0u  /* B3/S23       */
+#define RULE_HIGHLIFE 0x010E0u  /* B36/S23      */
+#define RULE_DAYNIGHT 0x3F2C0u  /* B3678/S34678 */
+
+
+/**
+ * Next state of a cell, given x = 2*neighbors + alive.  For the common
+ * rules (when rule is a compile-time constant) this folds to range
+ * tests on x, which vectorize; other rules shift the mask by a variable
+ * amount, which does not.
+ */
+#define RULE_NEXT(rule, x)                                              \
+    ((rule) == RULE_CONWAY ?                                            \
+        ((x) >= 5 && (x) <= 7) :                                        \
+     (rule) == RULE_HIGHLIFE ?                                          \
+        ((x) >= 5 && (x) <= 7) | ((x) == 12) :                          \
+     (rule) == RULE_DAYNIGHT ?                                          \
+        ((x) >= 6 && (x) <= 7) | ((x) == 9) | ((x) >= 12) :             \
+     (int) (((rule) >> (x)) & 1))
+
+
+/**
+ * Call kernel(args, rule) with the rule as a compile-time constant for
+ * the common rules, and with the run-time rule otherwise.  When the
+ * kernel is inlined, this gives a kernel specialized for each common
+ * rule and a generic table-driven kernel for the rest; the switch is
+ * outside the kernel's loops.
+ */
+#define RULE_DISPATCH(rule, kernel, ...)                                \
+    switch (rule) {                                                     \
+    case RULE_CONWAY:   kernel(__VA_ARGS__, RULE_CONWAY);   break;      \
+    case RULE_HIGHLIFE: kernel(__VA_ARGS__, RULE_HIGHLIFE); break;      \
+    case RULE_DAYNIGHT: kernel(__VA_ARGS__, RULE_DAYNIGHT); break;      \
+    default:            kernel(__VA_ARGS__, (rule));        break;      \
+    }
+
+
 /**
  * The `problem_t` type contains the problem parameters (specified
  * mostly by command line options).
@@ -22,8 +65,20 @@ typedef struct problem_t {
     int verbose;            /* Should we print boards? */
     int nboard;             /* Size of the board */
     int g;                  /* Number of generations */
-    const char* init;       /* File with live cell coordinates */
+    int k;                  /* Generations per halo exchange (blocked) */
+    int maxmem;             /* Memory bound in MB, 0 if none (hashlife) */
+    int maxperiod;          /* Longest cycle to detect, 0 if none */
+    uint32_t rule;          /* Rule mask (see RULE_CONWAY) */
+    int rule_set;           /* Was the rule given explicitly (-R)? */
+    int gen;                /* Starting generation (restart) */
+    int ckpt;               /* Generations per checkpoint, 0 if none */
+    const char* ckpt_file;  /* Checkpoint file name */
+    int restart;            /* Is init a checkpoint to restart from? */
+    const char* init;       /* File with initial board */
     struct board_t* board;  /* Board data structure */
+    char stats[128];        /* Engine's own figures, set by destroy_board */
+    double bytes_per_cell;  /* Measured traffic per cell per generation,
+                               set by destroy_board (0 if not measured) */
 } problem_t;
 
 
@@ -38,4 +93,17 @@ void advance_board(problem_t* problem, int steps);
 void set_cell(problem_t* problem, int i, int j);
 char get_cell(problem_t* problem, int i, int j);
 
+
+/**
+ * CRC32 checksum of the board state, row by row (life_common.c)
+ */
+uint32_t board_checksum(problem_t* problem);
+
+
+/**
+ * Parse a B/S rulestring such as "B36/S23" into a rule mask.
+ * Returns zero if the string is not a valid rule (life_common.c).
+ */
+int parse_rule(const char* s, uint32_t* rule);
+
 #endif /* LIFE_COMMON_H */
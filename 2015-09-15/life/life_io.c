@@ -0,0 +1,353 @@
+/*
+ * life_io.c - Board file formats and checkpointing for Game of Life
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "life_io.h"
+
+
+#define BINARY_MAGIC "LIFEBIN2"
+#define BINARY_HEADER 24
+#define BINARY_MAGIC_V1 "LIFEBIN1"  /* Older boards, without the rule */
+#define BINARY_HEADER_V1 16
+
+
+/**
+ * Memory-map a file read-only.  Returns NULL for an empty file.
+ */
+static const char* map_file(const char* fname, size_t* size)
+{
+    struct stat st;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Could not open board file: %s\n", fname);
+        exit(-2);
+    }
+    *size = (size_t) st.st_size;
+    if (*size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Could not map board file: %s\n", fname);
+        exit(-2);
+    }
+    madvise(data, *size, MADV_SEQUENTIAL);
+    return (const char*) data;
+}
+
+
+/**
+ * Parse a (possibly signed) decimal integer, skipping leading white
+ * space.  Returns zero at the end of the data or on a non-number.
+ */
+static int parse_int(const char** pp, const char* end, int* result)
+{
+    const char* p = *pp;
+    int sign = 1, val = 0;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        ++p;
+    if (p < end && (*p == '-' || *p == '+'))
+        sign = (*p++ == '-') ? -1 : 1;
+    if (p == end || *p < '0' || *p > '9')
+        return 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        val = 10*val + (*p++ - '0');
+    *pp = p;
+    *result = sign*val;
+    return 1;
+}
+
+
+/**
+ * Take the rule a board file names, unless it conflicts with one given
+ * on the command line
+ */
+static void use_file_rule(problem_t* problem, uint32_t rule)
+{
+    if (problem->rule_set && problem->rule != rule) {
+        fprintf(stderr, "Rule given with -R differs from the board file's\n");
+        exit(-2);
+    }
+    problem->rule = rule;
+}
+
+
+/**
+ * Parse the rule from an RLE header line ("x = 3, y = 3, rule = B3/S23"),
+ * if it has one.  Also accepts the older S/B form ("23/3").
+ */
+static void parse_rle_rule(problem_t* problem, const char* p, const char* end)
+{
+    char text[64], bs[80];
+    const char* key = NULL;
+    size_t len = 0;
+    uint32_t rule;
+
+    for (; p + 4 <= end && *p != '\n'; ++p)
+        if (memcmp(p, "rule", 4) == 0) {
+            key = p + 4;
+            break;
+        }
+    if (key == NULL)
+        return;
+    while (key < end && (*key == ' ' || *key == '\t' || *key == '='))
+        ++key;
+    while (key < end && len < sizeof(text)-1 && *key != ',' &&
+           *key != '\n' && *key != '\r' && *key != ' ' && *key != '\t')
+        text[len++] = *key++;
+    text[len] = '\0';
+
+    if (!parse_rule(text, &rule)) {
+        const char* slash = strchr(text, '/');
+        int ok = (slash != NULL && strpbrk(text, "BbSs") == NULL);
+        if (ok) {
+            snprintf(bs, sizeof(bs), "B%s/S%.*s", slash+1,
+                     (int) (slash-text), text);
+            ok = parse_rule(bs, &rule);
+        }
+        if (!ok) {
+            fprintf(stderr, "Unsupported rule in RLE header: %s\n", text);
+            exit(-2);
+        }
+    }
+    use_file_rule(problem, rule);
+}
+
+
+/**
+ * Load a text file of (i,j) pairs
+ */
+static void load_pairs(problem_t* problem, const char* data, size_t size)
+{
+    const char* p = data;
+    const char* end = data + size;
+    int i, j;
+    create_board(problem);
+    while (parse_int(&p, end, &i) && parse_int(&p, end, &j))
+        set_cell(problem, i, j);
+}
+
+
+/**
+ * Load an RLE pattern with its top left corner at (0,0)
+ */
+static void load_rle(problem_t* problem, const char* data, size_t size)
+{
+    const char* p = data;
+    const char* end = data + size;
+    int i = 0, j = 0;
+
+    /* Skip comment lines and the header line, taking the rule from it */
+    while (p < end && (*p == '#' || *p == 'x')) {
+        if (*p == 'x')
+            parse_rle_rule(problem, p, end);
+        while (p < end && *p != '\n')
+            ++p;
+        if (p < end)
+            ++p;
+    }
+
+    create_board(problem);
+    while (p < end && *p != '!') {
+        int count = 1;
+        if (*p >= '0' && *p <= '9')
+            parse_int(&p, end, &count);
+        if (p == end)
+            break;
+        char tag = *p++;
+        if (tag == 'b') {
+            j += count;
+        } else if (tag == '$') {
+            i += count;
+            j = 0;
+        } else if (tag >= 'a' && tag <= 'z') {
+            /* 'o' (or any other state letter) is a run of live cells */
+            for (int k = 0; k < count; ++k)
+                set_cell(problem, i, j++);
+        }
+    }
+}
+
+
+/**
+ * Load a binary board, checking the size unless restarting.  The rule
+ * is taken from the header (older boards do not record one).
+ */
+static void load_binary(problem_t* problem, const char* data, size_t size,
+                        int restart)
+{
+    int v1 = (memcmp(data, BINARY_MAGIC_V1, 8) == 0);
+    size_t hsize = v1 ? BINARY_HEADER_V1 : BINARY_HEADER;
+    int32_t header[2];
+    uint32_t rule;
+    if (size < hsize) {
+        fprintf(stderr, "Truncated binary board file\n");
+        exit(-2);
+    }
+    memcpy(header, data+8, sizeof(header));
+    int n = header[0];
+    int nbytes = (n+7)/8;
+    if (n < 1 || size < hsize + (size_t) n * nbytes) {
+        fprintf(stderr, "Truncated binary board file\n");
+        exit(-2);
+    }
+    if (restart) {
+        problem->nboard = n;
+        problem->gen = header[1];
+    } else if (n > problem->nboard) {
+        fprintf(stderr, "Binary board is larger than board size\n");
+        exit(-2);
+    }
+    if (!v1) {
+        memcpy(&rule, data+16, sizeof(rule));
+        use_file_rule(problem, rule);
+    }
+
+    create_board(problem);
+    const unsigned char* rows = (const unsigned char*) data + hsize;
+    for (int i = 0; i < n; ++i) {
+        const unsigned char* row = rows + (size_t) i * nbytes;
+        for (int jb = 0; jb < nbytes; ++jb)
+            if (row[jb])
+                for (int b = 0; b < 8; ++b)
+                    if (row[jb] & (1 << b))
+                        set_cell(problem, i, 8*jb+b);
+    }
+}
+
+
+/**
+ * Load an initial board (see life_io.h)
+ */
+void load_board(problem_t* problem, const char* fname, int restart)
+{
+    size_t size;
+    const char* data = map_file(fname, &size);
+    size_t len = strlen(fname);
+    int is_binary = (size >= 8 &&
+                     (memcmp(data, BINARY_MAGIC, 8) == 0 ||
+                      memcmp(data, BINARY_MAGIC_V1, 8) == 0));
+
+    if (restart && !is_binary) {
+        fprintf(stderr, "Not a checkpoint file: %s\n", fname);
+        exit(-2);
+    }
+
+    if (is_binary)
+        load_binary(problem, data, size, restart);
+    else if ((len > 4 && strcmp(fname+len-4, ".rle") == 0) ||
+             (size > 0 && (data[0] == '#' || data[0] == 'x')))
+        load_rle(problem, data, size);
+    else
+        load_pairs(problem, data, size);
+
+    if (data)
+        munmap((void*) data, size);
+}
+
+
+/**
+ * Checkpoint writer state.  Only one write is in flight at a time.
+ */
+typedef struct checkpoint_t {
+    char* fname;            /* Checkpoint file name            */
+    unsigned char* data;    /* Header and packed board         */
+    size_t size;            /* Bytes of data                   */
+} checkpoint_t;
+
+static pthread_t writer;
+static int writer_active = 0;
+static checkpoint_t pending;
+
+
+/**
+ * Writer thread: write to fname.tmp, then rename over fname so that a
+ * crash during the write leaves the previous checkpoint intact
+ */
+static void* checkpoint_main(void* arg)
+{
+    checkpoint_t* ckpt = (checkpoint_t*) arg;
+    size_t len = strlen(ckpt->fname);
+    char* tmpname = (char*) malloc(len+5);
+    memcpy(tmpname, ckpt->fname, len);
+    strcpy(tmpname+len, ".tmp");
+
+    FILE* fp = fopen(tmpname, "wb");
+    if (fp == NULL ||
+        fwrite(ckpt->data, 1, ckpt->size, fp) != ckpt->size ||
+        fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        fprintf(stderr, "Could not write checkpoint: %s\n", tmpname);
+        if (fp)
+            fclose(fp);
+    } else {
+        fclose(fp);
+        if (rename(tmpname, ckpt->fname) != 0)
+            fprintf(stderr, "Could not rename checkpoint: %s\n", tmpname);
+    }
+    free(tmpname);
+    return NULL;
+}
+
+
+/**
+ * Wait for any checkpoint write in progress to finish
+ */
+void wait_checkpoint(void)
+{
+    if (writer_active) {
+        pthread_join(writer, NULL);
+        free(pending.data);
+        writer_active = 0;
+    }
+}
+
+
+/**
+ * Write a checkpoint in the background (see life_io.h)
+ */
+void write_checkpoint(problem_t* problem, int gen)
+{
+    int n = problem->nboard;
+    int nbytes = (n+7)/8;
+    size_t size = BINARY_HEADER + (size_t) n * nbytes;
+    unsigned char* data = (unsigned char*) calloc(size, 1);
+    int32_t header[2] = {n, gen};
+    memcpy(data, BINARY_MAGIC, 8);
+    memcpy(data+8, header, sizeof(header));
+    memcpy(data+16, &problem->rule, sizeof(problem->rule));
+
+    /* Snapshot the board; this is the only part on the critical path */
+    #pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        unsigned char* row = data + BINARY_HEADER + (size_t) i * nbytes;
+        for (int j = 0; j < n; ++j)
+            if (get_cell(problem,i,j))
+                row[j/8] |= (unsigned char) (1 << (j%8));
+    }
+
+    wait_checkpoint();
+    pending.fname = (char*) problem->ckpt_file;
+    pending.data = data;
+    pending.size = size;
+    if (pthread_create(&writer, NULL, checkpoint_main, &pending) == 0) {
+        writer_active = 1;
+    } else {
+        checkpoint_main(&pending);
+        free(data);
+    }
+}
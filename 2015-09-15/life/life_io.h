@@ -0,0 +1,46 @@
+/*
+ * life_io.h - Board file formats and checkpointing for Game of Life
+ */
+#ifndef LIFE_IO_H
+#define LIFE_IO_H
+
+#include "life_common.h"
+
+
+/**
+ * Load an initial board from a file.  We recognize three formats:
+ *
+ *  - Binary boards (and checkpoints): the magic string "LIFEBIN2",
+ *    the board size and generation as 32-bit ints, the rule mask and
+ *    four reserved bytes, then n rows of ceil(n/8) bytes with cell
+ *    (i,j) in bit j%8 of byte j/8 of row i.  "LIFEBIN1" boards have no
+ *    rule or reserved bytes.
+ *  - RLE patterns (the standard Life format: "x = ..., y = ..." header,
+ *    with an optional "rule = ...", and runs of b/o/$ terminated by !),
+ *    placed at the top left.
+ *  - Text files of (i,j) pairs of live cells.
+ *
+ * Binary files are memory-mapped.  If restart is nonzero, the file must
+ * be a binary board, and the board size and starting generation are
+ * taken from it.  A rule named in the file replaces problem->rule; if
+ * the rule was given explicitly (problem->rule_set) and differs, that
+ * is an error.  The board is created by this call.
+ */
+void load_board(problem_t* problem, const char* fname, int restart);
+
+
+/**
+ * Write the current board to the checkpoint file as a binary board for
+ * generation gen.  The board is copied into a buffer and written (to a
+ * temporary file that is then renamed) by a background thread; a call
+ * waits for any previous write to finish first.
+ */
+void write_checkpoint(problem_t* problem, int gen);
+
+
+/**
+ * Wait for any checkpoint write in progress to finish
+ */
+void wait_checkpoint(void);
+
+#endif /* LIFE_IO_H */
@@ -0,0 +1,447 @@
+/*
+ * life_mpi.c - Domain-decomposed Game of Life with MPI
+ *
+ *   Driver syntax: mpirun -np P ./life_mpi [-f init] [-n size] [-g gens]
+ *
+ * The board is split over a 2D periodic process grid.  Each rank owns a
+ * block of the board plus a one-cell ghost ring.  Every generation, we
+ * post nonblocking receives and sends for the eight neighbor halos,
+ * update the interior of the block (which does not need the ghosts)
+ * while the messages are in flight, and then finish the block edges.
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32.h"
+
+
+/**
+ * Local block and process grid information
+ */
+typedef struct block_t {
+    int n;              /* Global board size                     */
+    int i0, j0;         /* Global index of first owned cell      */
+    int nr, nc;         /* Number of owned rows and columns      */
+    char* current;      /* Current generation (with ghosts)      */
+    char* previous;     /* Previous generation (with ghosts)     */
+
+    MPI_Comm comm;      /* Periodic Cartesian communicator       */
+    int rank, size;     /* Rank and number of ranks              */
+    int dims[2];        /* Process grid dimensions               */
+    int coords[2];      /* Process grid coordinates              */
+    int nbr[8];         /* Neighbor ranks (see dirs below)       */
+} block_t;
+
+
+/**
+ * Neighbor directions (N, S, W, E, NW, NE, SW, SE)
+ */
+static const int dirs[8][2] = {
+    {-1, 0}, { 1, 0}, { 0,-1}, { 0, 1},
+    {-1,-1}, {-1, 1}, { 1,-1}, { 1, 1}
+};
+static const int opposite[8] = {1, 0, 3, 2, 7, 6, 5, 4};
+
+
+/**
+ * Assuming the variable nc is set to the number of local columns, this
+ * macro accesses local entry (i,j) (from -1 to nr/nc) of a block array.
+ */
+#define B(which,i,j) which[((i)+1)*(nc+2)+((j)+1)]
+
+
+/**
+ * Start index of part p of a block distribution of n items over np parts
+ */
+static int part_start(int n, int np, int p)
+{
+    return (int) ((long) n * p / np);
+}
+
+
+/**
+ * Set up the process grid and allocate the local block
+ */
+void block_init(block_t* blk, int n)
+{
+    int periods[2] = {1, 1};
+
+    MPI_Comm_size(MPI_COMM_WORLD, &(blk->size));
+    blk->dims[0] = blk->dims[1] = 0;
+    MPI_Dims_create(blk->size, 2, blk->dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, blk->dims, periods, 1, &(blk->comm));
+    MPI_Comm_rank(blk->comm, &(blk->rank));
+    MPI_Cart_coords(blk->comm, blk->rank, 2, blk->coords);
+
+    for (int d = 0; d < 8; ++d) {
+        int c[2] = {blk->coords[0] + dirs[d][0], blk->coords[1] + dirs[d][1]};
+        MPI_Cart_rank(blk->comm, c, &(blk->nbr[d]));
+    }
+
+    blk->n  = n;
+    blk->i0 = part_start(n, blk->dims[0], blk->coords[0]);
+    blk->j0 = part_start(n, blk->dims[1], blk->coords[1]);
+    blk->nr = part_start(n, blk->dims[0], blk->coords[0]+1) - blk->i0;
+    blk->nc = part_start(n, blk->dims[1], blk->coords[1]+1) - blk->j0;
+    blk->current  = (char*) calloc((blk->nr+2) * (blk->nc+2), 1);
+    blk->previous = (char*) calloc((blk->nr+2) * (blk->nc+2), 1);
+}
+
+
+/**
+ * Free the local block
+ */
+void block_destroy(block_t* blk)
+{
+    free(blk->current);
+    free(blk->previous);
+    MPI_Comm_free(&(blk->comm));
+}
+
+
+/**
+ * Rank of the process that owns global cell (i,j)
+ */
+static int owner(block_t* blk, int i, int j)
+{
+    int c[2], rank;
+    c[0] = (int) (((long) i * blk->dims[0] + blk->dims[0]) / blk->n) - 1;
+    c[1] = (int) (((long) j * blk->dims[1] + blk->dims[1]) / blk->n) - 1;
+    while (part_start(blk->n, blk->dims[0], c[0]+1) <= i) ++c[0];
+    while (part_start(blk->n, blk->dims[1], c[1]+1) <= j) ++c[1];
+    MPI_Cart_rank(blk->comm, c, &rank);
+    return rank;
+}
+
+
+/**
+ * Set the cells in a list of (i,j) pairs that belong to this block
+ */
+static void set_owned_cells(block_t* blk, const int* ij, int npairs)
+{
+    int nc = blk->nc;
+    for (int k = 0; k < npairs; ++k) {
+        int i = ij[2*k+0] - blk->i0;
+        int j = ij[2*k+1] - blk->j0;
+        if (i >= 0 && i < blk->nr && j >= 0 && j < blk->nc)
+            B(blk->current,i,j) = 1;
+    }
+}
+
+
+/**
+ * Read the initial board.  Each rank reads one contiguous byte range of
+ * the file (adjusted to line boundaries), then we pass the parsed cell
+ * lists around a ring with MPI_Sendrecv, as in the ring example, and
+ * each rank keeps the cells that it owns.
+ */
+void read_board(block_t* blk, const char* fname)
+{
+    FILE* fp = fopen(fname, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open board file: %s\n", fname);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+    fseek(fp, 0, SEEK_END);
+    long fsize = ftell(fp);
+    long start = fsize * blk->rank / blk->size;
+    long end   = fsize * (blk->rank+1) / blk->size;
+
+    /* Read our byte range plus the rest of the last line */
+    long nbuf = end-start;
+    char* buf = (char*) malloc(nbuf+1);
+    fseek(fp, start, SEEK_SET);
+    nbuf = (long) fread(buf, 1, nbuf, fp);
+    int c;
+    while (nbuf > 0 && buf[nbuf-1] != '\n' && (c = fgetc(fp)) != EOF) {
+        buf = (char*) realloc(buf, nbuf+2);
+        buf[nbuf++] = (char) c;
+    }
+    buf[nbuf] = 0;
+
+    /* Skip a partial first line (it belongs to the previous rank) */
+    char* s = buf;
+    if (start > 0) {
+        fseek(fp, start-1, SEEK_SET);
+        if (fgetc(fp) != '\n') {
+            while (*s && *s != '\n')
+                ++s;
+        }
+    }
+    fclose(fp);
+
+    /* Parse the pairs in our range */
+    int npairs = 0, maxpairs = 64;
+    int* ij = (int*) malloc(2 * maxpairs * sizeof(int));
+    int i, j, nread;
+    while (sscanf(s, "%d %d%n", &i, &j, &nread) == 2) {
+        if (npairs == maxpairs) {
+            maxpairs *= 2;
+            ij = (int*) realloc(ij, 2 * maxpairs * sizeof(int));
+        }
+        ij[2*npairs+0] = i;
+        ij[2*npairs+1] = j;
+        ++npairs;
+        s += nread;
+    }
+    free(buf);
+
+    /* Ring pass of the cell lists */
+    int next = (blk->rank+1) % blk->size;
+    int prev = (blk->rank+blk->size-1) % blk->size;
+    set_owned_cells(blk, ij, npairs);
+    for (int phase = 0; phase < blk->size-1; ++phase) {
+        int nrecv;
+        MPI_Sendrecv(&npairs, 1, MPI_INT, next, 2*phase,
+                     &nrecv,  1, MPI_INT, prev, 2*phase,
+                     blk->comm, MPI_STATUS_IGNORE);
+        int* recv_buf = (int*) malloc((2*nrecv+1) * sizeof(int));
+        MPI_Sendrecv(ij, 2*npairs, MPI_INT, next, 2*phase+1,
+                     recv_buf, 2*nrecv, MPI_INT, prev, 2*phase+1,
+                     blk->comm, MPI_STATUS_IGNORE);
+        free(ij);
+        ij = recv_buf;
+        npairs = nrecv;
+        set_owned_cells(blk, ij, npairs);
+    }
+    free(ij);
+}
+
+
+/**
+ * Local row and column ranges [lo,hi) for a halo region.  For sends,
+ * direction d selects the edge of the owned block on that side; for
+ * receives, it selects the ghost cells on the opposite side.
+ */
+static void halo_range(int nloc, int dir, int recv, int* lo, int* hi)
+{
+    if (dir == 0) {
+        *lo = 0;
+        *hi = nloc;
+    } else if ((dir < 0) != (recv != 0)) {
+        *lo = recv ? -1 : 0;
+        *hi = *lo + 1;
+    } else {
+        *lo = recv ? nloc : nloc-1;
+        *hi = *lo + 1;
+    }
+}
+
+
+/**
+ * Copy a halo region between a block array and a message buffer
+ */
+static void halo_copy(block_t* blk, char* board, char* buf, int d,
+                      int recv)
+{
+    int nc = blk->nc;
+    int ilo, ihi, jlo, jhi;
+    halo_range(blk->nr, dirs[d][0], recv, &ilo, &ihi);
+    halo_range(blk->nc, dirs[d][1], recv, &jlo, &jhi);
+    for (int i = ilo; i < ihi; ++i)
+        for (int j = jlo; j < jhi; ++j) {
+            if (recv)
+                B(board,i,j) = *buf++;
+            else
+                *buf++ = B(board,i,j);
+        }
+}
+
+
+/**
+ * Update local cells (i,j) in [ilo,ihi) x [jlo,jhi)
+ */
+static void update_range(block_t* blk, char* current, char* previous,
+                         int ilo, int ihi, int jlo, int jhi)
+{
+    int nc = blk->nc;
+    for (int i = ilo; i < ihi; ++i)
+        for (int j = jlo; j < jhi; ++j) {
+            int x = 0;
+            for (int k = -1; k <= 1; ++k)
+                for (int l = -1; l <= 1; ++l)
+                    x += B(previous,i+k,j+l);
+            x = 2*x-B(previous,i,j);
+            B(current,i,j) = (x >= 5 && x <= 7);
+        }
+}
+
+
+/**
+ * Advance the board by one generation, overlapping the halo exchange
+ * with the update of the block interior
+ */
+void advance_block1(block_t* blk, char** sendbuf, char** recvbuf)
+{
+    int nr = blk->nr, nc = blk->nc;
+    char* current = blk->previous;
+    char* previous = blk->current;
+    MPI_Request reqs[16];
+
+    for (int d = 0; d < 8; ++d) {
+        int len = (dirs[d][0] ? 1 : nr) * (dirs[d][1] ? 1 : nc);
+        MPI_Irecv(recvbuf[d], len, MPI_CHAR, blk->nbr[opposite[d]],
+                  d, blk->comm, reqs+d);
+    }
+    for (int d = 0; d < 8; ++d) {
+        int len = (dirs[d][0] ? 1 : nr) * (dirs[d][1] ? 1 : nc);
+        halo_copy(blk, previous, sendbuf[d], d, 0);
+        MPI_Isend(sendbuf[d], len, MPI_CHAR, blk->nbr[d],
+                  d, blk->comm, reqs+8+d);
+    }
+
+    /* Interior cells only need owned data */
+    update_range(blk, current, previous, 1, nr-1, 1, nc-1);
+
+    /* Edge cells need the ghosts */
+    MPI_Waitall(8, reqs, MPI_STATUSES_IGNORE);
+    for (int d = 0; d < 8; ++d)
+        halo_copy(blk, previous, recvbuf[d], d, 1);
+    update_range(blk, current, previous, 0, 1, 0, nc);
+    if (nr > 1)
+        update_range(blk, current, previous, nr-1, nr, 0, nc);
+    update_range(blk, current, previous, 1, nr-1, 0, 1);
+    if (nc > 1)
+        update_range(blk, current, previous, 1, nr-1, nc-1, nc);
+    MPI_Waitall(8, reqs+8, MPI_STATUSES_IGNORE);
+
+    blk->current = current;
+    blk->previous = previous;
+}
+
+
+/**
+ * Advance the board by steps generations
+ */
+void advance_block(block_t* blk, int steps)
+{
+    char* sendbuf[8];
+    char* recvbuf[8];
+    int len = (blk->nr > blk->nc ? blk->nr : blk->nc);
+    for (int d = 0; d < 8; ++d) {
+        sendbuf[d] = (char*) malloc(len);
+        recvbuf[d] = (char*) malloc(len);
+    }
+    for (int step = 0; step < steps; ++step)
+        advance_block1(blk, sendbuf, recvbuf);
+    for (int d = 0; d < 8; ++d) {
+        free(sendbuf[d]);
+        free(recvbuf[d]);
+    }
+}
+
+
+/**
+ * Compute the CRC32 checksum of the global board in row-major order
+ * (the same value as board_checksum in the serial code).  The running
+ * CRC is handed from the owner of each row segment to the owner of the
+ * next one; the final value ends up on rank 0.  Messages between any
+ * two ranks are sent and received in chain order, so one tag suffices.
+ */
+uint32_t block_checksum(block_t* blk)
+{
+    int nc = blk->nc;
+    int n = blk->n;
+    int jlast = blk->j0 + nc - 1;
+    uint32_t crc = 0;
+    for (int i = 0; i < blk->nr; ++i) {
+        int gi = blk->i0 + i;
+        int prev =
+            (blk->j0 > 0) ? owner(blk, gi, blk->j0-1) :
+            (gi > 0)      ? owner(blk, gi-1, n-1) : blk->rank;
+        int next =
+            (jlast < n-1) ? owner(blk, gi, jlast+1) :
+            (gi < n-1)    ? owner(blk, gi+1, 0) : 0;
+        if (prev != blk->rank)
+            MPI_Recv(&crc, 1, MPI_UINT32_T, prev, 0, blk->comm,
+                     MPI_STATUS_IGNORE);
+        crc = crc32(crc, &B(blk->current,i,0), nc);
+        if (next != blk->rank)
+            MPI_Send(&crc, 1, MPI_UINT32_T, next, 0, blk->comm);
+    }
+    if (blk->rank == 0 && owner(blk, n-1, n-1) != 0)
+        MPI_Recv(&crc, 1, MPI_UINT32_T, owner(blk, n-1, n-1), 0, blk->comm,
+                 MPI_STATUS_IGNORE);
+    return crc;
+}
+
+
+/**
+ * Print a usage message and quit
+ */
+void print_usage_quit(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-f init] [-n boardsize] [-g generations]\n",
+            name);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+}
+
+
+/**
+ * Main routine
+ */
+int main(int argc, char** argv)
+{
+    int n = 100;
+    int g = 100;
+    const char* init = NULL;
+    block_t blk;
+
+    MPI_Init(&argc, &argv);
+
+    for (int i = 1; i < argc; ++i) {
+        if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'n':
+                n = atoi(argv[++i]);
+                break;
+            case 'g':
+                g = atoi(argv[++i]);
+                break;
+            case 'f':
+                init = argv[++i];
+                break;
+            default:
+                fprintf(stderr, "Unknown flag: %s", argv[i]);
+                print_usage_quit(argv[0]);
+            }
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    if (init == NULL) {
+        fprintf(stderr, "Initialization file not specified\n");
+        print_usage_quit(argv[0]);
+    }
+
+    block_init(&blk, n);
+    if (blk.nr < 1 || blk.nc < 1) {
+        fprintf(stderr, "Board too small for %d x %d process grid\n",
+                blk.dims[0], blk.dims[1]);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    read_board(&blk, init);
+
+    MPI_Barrier(blk.comm);
+    double t0 = MPI_Wtime();
+    advance_block(&blk, g);
+    MPI_Barrier(blk.comm);
+    double t1 = MPI_Wtime();
+
+    uint32_t crc = block_checksum(&blk);
+    if (blk.rank == 0) {
+        double cells = (double) g * n * n;
+        printf("Ranks: %d (%d x %d)\n", blk.size, blk.dims[0], blk.dims[1]);
+        printf("Time: %e\n", t1-t0);
+        printf("Cells / sec: %e\n", cells / (t1-t0));
+        printf("Cells / sec / rank: %e\n", cells / (t1-t0) / blk.size);
+        printf("Final checksum: %08X\n", crc);
+    }
+
+    block_destroy(&blk);
+    MPI_Finalize();
+    return 0;
+}
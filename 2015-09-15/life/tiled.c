@@ -0,0 +1,202 @@
+/*
+ * tiled.c - Tiled, multithreaded Game of Life with temporal blocking
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "life_common.h"
+
+
+/**
+ * Tile size (in cells per side).  With the default, the two scratch
+ * tiles for each thread (with modest halos) fit comfortably in L2.
+ */
+#ifndef TILE_SIZE
+#define TILE_SIZE 256
+#endif
+
+
+/**
+ * We keep two n-by-n boards (previous and current) with no ghost cells.
+ * To advance by k generations, each thread copies a tile together with
+ * a k-cell-deep halo (with wraparound) into a private scratch buffer,
+ * advances the scratch tile k generations in cache, and writes back the
+ * center.  The valid region shrinks by one cell per generation, so after
+ * k steps exactly the tile itself is correct.  Threads only synchronize
+ * between blocks of k generations.
+ */
+typedef struct board_t {
+    char* current;  /* Current generation  */
+    char* previous; /* Previous generation */
+} board_t;
+
+
+/**
+ * Assuming the variable n is set to nboard, this macro accesses the (i,j)
+ * entry of either the current or the previous board array.
+ */
+#define B(which,i,j) which[(i)*n+(j)]
+
+
+/**
+ * Create the board for the problem
+ */
+void create_board(problem_t* problem)
+{
+    int n = problem->nboard;
+    board_t* board = (board_t*) malloc(sizeof(board_t));
+    board->current = (char*) calloc(n * n, 1);
+    board->previous = (char*) calloc(n * n, 1);
+    problem->board = board;
+}
+
+
+/**
+ * Free the memory associated with a board
+ */
+void destroy_board(problem_t* problem)
+{
+    board_t* board = problem->board;
+    free(board->current);
+    free(board->previous);
+    free(board);
+    problem->board = NULL;
+}
+
+
+/**
+ * Set one cell in the problem
+ */
+void set_cell(problem_t* problem, int i, int j)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    if (i < 0 || i >= n || j < 0 || j >= n)
+        return;
+    B(board->current,i,j) = 1;
+}
+
+
+/**
+ * Get one cell in the problem
+ */
+char get_cell(problem_t* problem, int i, int j)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    return B(board->current,i,j);
+}
+
+
+/**
+ * Advance an m-by-m scratch tile (row stride m) one generation,
+ * updating only the cells at least s cells away from the tile edge.
+ * This is always inlined, so that RULE_DISPATCH in advance_tile gives
+ * a specialized kernel for each common rule.
+ */
+static inline __attribute__((always_inline))
+void advance_scratch(char* restrict out, const char* restrict in,
+                     int mi, int mj, int s, uint32_t rule)
+{
+    for (int i = s; i < mi-s; ++i) {
+        const char* up = in + (i-1)*mj;
+        const char* md = in + i*mj;
+        const char* dn = in + (i+1)*mj;
+        char* o = out + i*mj;
+        for (int j = s; j < mj-s; ++j) {
+            int x = up[j-1] + up[j] + up[j+1] +
+                    md[j-1]         + md[j+1] +
+                    dn[j-1] + dn[j] + dn[j+1];
+            o[j] = RULE_NEXT(rule, 2*x + md[j]);
+        }
+    }
+}
+
+
+/**
+ * Advance the tile with corner (i0,j0) and size ti-by-tj by k generations,
+ * reading from previous and writing to current.  The scratch buffers
+ * must hold (ti+2k)*(tj+2k) cells each.
+ */
+static void advance_tile(int n, char* current, const char* previous,
+                         int i0, int j0, int ti, int tj, int k,
+                         char* s0, char* s1, uint32_t rule)
+{
+    int mi = ti + 2*k;
+    int mj = tj + 2*k;
+
+    /* Load tile and halo with wraparound */
+    for (int i = 0; i < mi; ++i) {
+        int ii = ((i0-k+i) % n + n) % n;
+        const char* row = previous + ii*n;
+        char* srow = s0 + i*mj;
+        int jj = ((j0-k) % n + n) % n;
+        for (int j = 0; j < mj; ++j) {
+            srow[j] = row[jj];
+            if (++jj == n)
+                jj = 0;
+        }
+    }
+
+    /* Advance in cache */
+    for (int s = 1; s <= k; ++s) {
+        RULE_DISPATCH(rule, advance_scratch, s1, s0, mi, mj, s);
+        char* tmp = s0;
+        s0 = s1;
+        s1 = tmp;
+    }
+
+    /* Write back the center */
+    for (int i = 0; i < ti; ++i)
+        memcpy(current + (i0+i)*n + j0, s0 + (i+k)*mj + k, tj);
+}
+
+
+/**
+ * Advance the board by k generations with one sweep over the tiles
+ */
+static void advance_blocked(problem_t* problem, int k)
+{
+    int n = problem->nboard;
+    board_t* board = problem->board;
+    char* current = board->previous;
+    char* previous = board->current;
+    int ntiles = (n + TILE_SIZE-1) / TILE_SIZE;
+    int m = TILE_SIZE + 2*k;
+
+    #pragma omp parallel
+    {
+        char* s0 = (char*) malloc(m * m);
+        char* s1 = (char*) malloc(m * m);
+
+        #pragma omp for collapse(2) schedule(dynamic)
+        for (int bi = 0; bi < ntiles; ++bi)
+            for (int bj = 0; bj < ntiles; ++bj) {
+                int i0 = bi*TILE_SIZE;
+                int j0 = bj*TILE_SIZE;
+                int ti = (n-i0 < TILE_SIZE) ? n-i0 : TILE_SIZE;
+                int tj = (n-j0 < TILE_SIZE) ? n-j0 : TILE_SIZE;
+                advance_tile(n, current, previous, i0, j0, ti, tj, k,
+                             s0, s1, problem->rule);
+            }
+
+        free(s1);
+        free(s0);
+    }
+
+    board->current = current;
+    board->previous = previous;
+}
+
+
+/**
+ * Advance the board by steps generations, k = problem->k at a time
+ */
+void advance_board(problem_t* problem, int steps)
+{
+    int k = problem->k;
+    for (int step = 0; step < steps; step += k)
+        advance_blocked(problem, (steps-step < k) ? steps-step : k);
+}
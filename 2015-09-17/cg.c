@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "cg.h"
+
+#define CG_STRIDE 8  /* Doubles per thread's partial sums (a cache line) */
+
+
+void cg_default_opts(cg_opts_t* opts, int n)
+{
+    opts->variant = CG_FUSED;
+    opts->pc = CG_PC_JACOBI;
+    opts->maxit = n;
+    opts->rtol = 1e-8;
+    opts->record = 0;
+}
+
+
+const char* cg_variant_name(cg_variant_t variant)
+{
+    switch (variant) {
+    case CG_PLAIN:     return "plain";
+    case CG_FUSED:     return "fused";
+    case CG_PIPELINED: return "pipelined";
+    default:           return "?";
+    }
+}
+
+
+const char* cg_pc_name(cg_pc_t pc)
+{
+    switch (pc) {
+    case CG_PC_NONE:   return "none";
+    case CG_PC_JACOBI: return "Jacobi";
+    case CG_PC_SGS:    return "SGS";
+    default:           return "?";
+    }
+}
+
+
+void cg_stats_free(cg_stats_t* stats)
+{
+    free(stats->resid);
+    free(stats->t_iter);
+    stats->resid = NULL;
+    stats->t_iter = NULL;
+}
+
+
+/*
+ * dinv[i] = 1/a_ii (or 1 without a preconditioner), summing duplicate
+ * diagonal entries as sparse_multiply does.  Returns -1 if a
+ * preconditioner needs a diagonal entry that is missing or not positive.
+ */
+static int pc_setup(const csr_t* A, cg_pc_t pc, double* dinv)
+{
+    int i, k, bad = 0;
+    for (i = 0; i < A->n; ++i) {
+        double d = 0;
+        int found = 0;
+        for (k = A->ptr[i]; k < A->ptr[i+1]; ++k)
+            if (A->col[k] == i) {
+                d += A->pr[k];
+                found = 1;
+            }
+        if (pc == CG_PC_NONE)
+            dinv[i] = 1;
+        else if (!found || d <= 0)
+            bad = 1;
+        else
+            dinv[i] = 1 / d;
+    }
+    return bad ? -1 : 0;
+}
+
+
+static inline double row_dot(const csr_t* A, int i, const double* x)
+{
+    const double* restrict pr = A->pr;
+    const int* restrict col = A->col;
+    double sum = 0;
+    int k;
+    for (k = A->ptr[i]; k < A->ptr[i+1]; ++k)
+        sum += pr[k] * x[col[k]];
+    return sum;
+}
+
+
+/*
+ * z = M^-1 r on rows [i0, i1).  For SGS, solve (D+L) y = r forward and
+ * then (D+U) z = D y backward, with L and U restricted to the block.
+ * L and U are picked out by column, so rows need not be sorted.
+ */
+static void pc_block(const csr_t* A, cg_pc_t pc, const double* dinv,
+                     int i0, int i1, const double* r, double* z)
+{
+    const double* pr = A->pr;
+    const int* col = A->col;
+    int i, k;
+    if (pc != CG_PC_SGS) {
+        for (i = i0; i < i1; ++i)
+            z[i] = dinv[i] * r[i];
+        return;
+    }
+    for (i = i0; i < i1; ++i) {
+        double s = r[i];
+        for (k = A->ptr[i]; k < A->ptr[i+1]; ++k)
+            if (col[k] >= i0 && col[k] < i)
+                s -= pr[k] * z[col[k]];
+        z[i] = s * dinv[i];
+    }
+    for (i = i1-1; i >= i0; --i) {
+        double s = 0;
+        for (k = A->ptr[i]; k < A->ptr[i+1]; ++k)
+            if (col[k] > i && col[k] < i1)
+                s += pr[k] * z[col[k]];
+        z[i] -= s * dinv[i];
+    }
+}
+
+
+/* Sum of one slot of every thread's partial sums, in thread order */
+static double sum_part(const double* part, int nt, int slot)
+{
+    double s = 0;
+    int t;
+    for (t = 0; t < nt; ++t)
+        s += part[t*CG_STRIDE + slot];
+    return s;
+}
+
+
+static double dot(const double* x, const double* y, int n)
+{
+    double s = 0;
+    int i;
+    #pragma omp parallel for reduction(+:s)
+    for (i = 0; i < n; ++i)
+        s += x[i] * y[i];
+    return s;
+}
+
+
+static void record(const cg_opts_t* opts, cg_stats_t* stats, int k,
+                   double relres, double* tlast)
+{
+    double now = omp_get_wtime();
+    if (opts->record) {
+        stats->resid[k] = relres;
+        if (k > 0)
+            stats->t_iter[k] = now - *tlast;
+    }
+    *tlast = now;
+}
+
+
+/* The textbook loop, one vector operation at a time */
+static int cg_plain(const csr_t* A, const double* b, double* x,
+                    const cg_opts_t* opts, cg_stats_t* stats,
+                    const double* dinv, double bnorm)
+{
+    int n = A->n, i, k;
+    double* r = (double*) malloc(n * sizeof(double));
+    double* z = (double*) malloc(n * sizeof(double));
+    double* p = (double*) malloc(n * sizeof(double));
+    double* q = (double*) malloc(n * sizeof(double));
+    double rz, rr, tlast;
+
+    sparse_multiply((csr_t*) A, x, q);
+    #pragma omp parallel for
+    for (i = 0; i < n; ++i)
+        r[i] = b[i] - q[i];
+    #pragma omp parallel
+    {
+        int i0, i1;
+        csr_thread_rows(A, omp_get_thread_num(), omp_get_num_threads(),
+                        &i0, &i1);
+        pc_block(A, opts->pc, dinv, i0, i1, r, z);
+    }
+    memcpy(p, z, n * sizeof(double));
+    rz = dot(r, z, n);
+    rr = dot(r, r, n);
+    record(opts, stats, 0, sqrt(rr) / bnorm, &tlast);
+
+    for (k = 0; k < opts->maxit && sqrt(rr) > opts->rtol * bnorm; ) {
+        double alpha, beta, rz_new;
+        sparse_multiply((csr_t*) A, p, q);
+        alpha = rz / dot(p, q, n);
+        #pragma omp parallel for
+        for (i = 0; i < n; ++i)
+            x[i] += alpha * p[i];
+        #pragma omp parallel for
+        for (i = 0; i < n; ++i)
+            r[i] -= alpha * q[i];
+        #pragma omp parallel
+        {
+            int i0, i1;
+            csr_thread_rows(A, omp_get_thread_num(), omp_get_num_threads(),
+                            &i0, &i1);
+            pc_block(A, opts->pc, dinv, i0, i1, r, z);
+        }
+        rz_new = dot(r, z, n);
+        rr = dot(r, r, n);
+        beta = rz_new / rz;
+        rz = rz_new;
+        #pragma omp parallel for
+        for (i = 0; i < n; ++i)
+            p[i] = z[i] + beta * p[i];
+        record(opts, stats, ++k, sqrt(rr) / bnorm, &tlast);
+    }
+
+    stats->relres = sqrt(rr) / bnorm;
+    free(q);
+    free(p);
+    free(z);
+    free(r);
+    return k;
+}
+
+
+/*
+ * Three passes an iteration, each over the thread's own rows:
+ *   1. q = A p, and p'q
+ *   2. x += alpha p, r -= alpha q, z = M^-1 r, and r'z, r'r
+ *   3. p = z + beta p
+ * With Jacobi (or no) preconditioning z is never stored.  The partial
+ * sums of pass 1 go in slot 0 and those of pass 2 in slots 1 and 2, so
+ * that no thread overwrites a slot another may still be reading.
+ */
+static int cg_fused(const csr_t* A, const double* b, double* x,
+                    const cg_opts_t* opts, cg_stats_t* stats,
+                    const double* dinv, double bnorm,
+                    double* part)
+{
+    int n = A->n, iters = 0;
+    int sgs = (opts->pc == CG_PC_SGS);
+    double* r = (double*) malloc(n * sizeof(double));
+    double* p = (double*) malloc(n * sizeof(double));
+    double* q = (double*) malloc(n * sizeof(double));
+    double* z = sgs ? (double*) malloc(n * sizeof(double)) : NULL;
+
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+        double* mine = part + t*CG_STRIDE;
+        double rz, rr, tlast = 0;
+        int i0, i1, i, k = 0;
+        csr_thread_rows(A, t, nt, &i0, &i1);
+
+        for (i = i0; i < i1; ++i)
+            r[i] = b[i] - row_dot(A, i, x);
+        if (sgs)
+            pc_block(A, opts->pc, dinv, i0, i1, r, z);
+        mine[1] = mine[2] = 0;
+        for (i = i0; i < i1; ++i) {
+            double zi = sgs ? z[i] : dinv[i] * r[i];
+            p[i] = zi;
+            mine[1] += r[i] * zi;
+            mine[2] += r[i] * r[i];
+        }
+        #pragma omp barrier
+        rz = sum_part(part, nt, 1);
+        rr = sum_part(part, nt, 2);
+        if (t == 0)
+            record(opts, stats, 0, sqrt(rr) / bnorm, &tlast);
+
+        while (k < opts->maxit && sqrt(rr) > opts->rtol * bnorm) {
+            double alpha, beta, pq = 0, rz_new = 0, rr_new = 0;
+            for (i = i0; i < i1; ++i) {
+                q[i] = row_dot(A, i, p);
+                pq += p[i] * q[i];
+            }
+            mine[0] = pq;
+            #pragma omp barrier
+            alpha = rz / sum_part(part, nt, 0);
+
+            for (i = i0; i < i1; ++i) {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * q[i];
+            }
+            if (sgs)
+                pc_block(A, opts->pc, dinv, i0, i1, r, z);
+            for (i = i0; i < i1; ++i) {
+                double zi = sgs ? z[i] : dinv[i] * r[i];
+                rz_new += r[i] * zi;
+                rr_new += r[i] * r[i];
+            }
+            mine[1] = rz_new;
+            mine[2] = rr_new;
+            #pragma omp barrier
+            rz_new = sum_part(part, nt, 1);
+            rr = sum_part(part, nt, 2);
+            beta = rz_new / rz;
+            rz = rz_new;
+
+            for (i = i0; i < i1; ++i)
+                p[i] = (sgs ? z[i] : dinv[i] * r[i]) + beta * p[i];
+            #pragma omp barrier
+            ++k;
+            if (t == 0)
+                record(opts, stats, k, sqrt(rr) / bnorm, &tlast);
+        }
+        if (t == 0) {
+            iters = k;
+            stats->relres = sqrt(rr) / bnorm;
+        }
+    }
+
+    free(z);
+    free(q);
+    free(p);
+    free(r);
+    return iters;
+}
+
+
+/*
+ * Pipelined CG.  After setting up r = b - A x, u = M^-1 r, w = A u and
+ * m = M^-1 w, each iteration is a barrier, the reduction of the
+ * previous pass's gamma = r'u, delta = w'u and r'r, and then one pass:
+ *   n = A m;  z = n + beta z;  q = m + beta q;  s = w + beta s;
+ *   p = u + beta p;  x += alpha p;  r -= alpha s;  u -= alpha q;
+ *   w -= alpha z;  the next partial sums;  and the next m = M^-1 w.
+ * Other threads read m while this one writes the next, so m and the
+ * partial sums alternate between two copies.
+ */
+static int cg_pipelined(const csr_t* A, const double* b, double* x,
+                        const cg_opts_t* opts, cg_stats_t* stats,
+                        const double* dinv, double bnorm,
+                        double* part)
+{
+    int n = A->n, iters = 0;
+    int sgs = (opts->pc == CG_PC_SGS);
+    double* v = (double*) calloc(9 * (size_t) n, sizeof(double));
+    double* r = v;
+    double* u = v + n;
+    double* w = v + 2*n;
+    double* z = v + 3*n;
+    double* q = v + 4*n;
+    double* s = v + 5*n;
+    double* p = v + 6*n;
+    double* m[2];
+    m[0] = v + 7*n;
+    m[1] = v + 8*n;
+
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+        double gamma_old = 0, alpha_old = 0, tlast = 0;
+        int i0, i1, i, k = 0;
+        csr_thread_rows(A, t, nt, &i0, &i1);
+
+        for (i = i0; i < i1; ++i)
+            r[i] = b[i] - row_dot(A, i, x);
+        pc_block(A, opts->pc, dinv, i0, i1, r, u);
+        #pragma omp barrier
+        {
+            double* mine = part + t*CG_STRIDE;
+            mine[0] = mine[1] = mine[2] = 0;
+            for (i = i0; i < i1; ++i) {
+                w[i] = row_dot(A, i, u);
+                mine[0] += r[i] * u[i];
+                mine[1] += w[i] * u[i];
+                mine[2] += r[i] * r[i];
+            }
+            pc_block(A, opts->pc, dinv, i0, i1, w, m[0]);
+        }
+        #pragma omp barrier
+
+        for (;;) {
+            const double* prev = part + (k & 1) * nt * CG_STRIDE;
+            double* mine = part + (~k & 1) * nt * CG_STRIDE + t*CG_STRIDE;
+            const double* restrict mc = m[k & 1];
+            double* restrict mn = m[~k & 1];
+            double gamma = sum_part(prev, nt, 0);
+            double delta = sum_part(prev, nt, 1);
+            double rr = sum_part(prev, nt, 2);
+            double alpha, beta, g = 0, d = 0, e = 0;
+
+            if (t == 0)
+                record(opts, stats, k, sqrt(rr) / bnorm, &tlast);
+            if (k >= opts->maxit || sqrt(rr) <= opts->rtol * bnorm) {
+                if (t == 0) {
+                    iters = k;
+                    stats->relres = sqrt(rr) / bnorm;
+                }
+                break;
+            }
+            if (k > 0) {
+                beta = gamma / gamma_old;
+                alpha = gamma / (delta - beta * gamma / alpha_old);
+            } else {
+                beta = 0;
+                alpha = gamma / delta;
+            }
+
+            for (i = i0; i < i1; ++i) {
+                z[i] = row_dot(A, i, mc) + beta * z[i];
+                q[i] = mc[i] + beta * q[i];
+                s[i] = w[i] + beta * s[i];
+                p[i] = u[i] + beta * p[i];
+                x[i] += alpha * p[i];
+                r[i] -= alpha * s[i];
+                u[i] -= alpha * q[i];
+                w[i] -= alpha * z[i];
+                g += r[i] * u[i];
+                d += w[i] * u[i];
+                e += r[i] * r[i];
+                if (!sgs)
+                    mn[i] = dinv[i] * w[i];
+            }
+            if (sgs)
+                pc_block(A, opts->pc, dinv, i0, i1, w, mn);
+            mine[0] = g;
+            mine[1] = d;
+            mine[2] = e;
+            gamma_old = gamma;
+            alpha_old = alpha;
+            ++k;
+            #pragma omp barrier
+        }
+    }
+
+    free(v);
+    return iters;
+}
+
+
+int cg_solve(const csr_t* A, const double* b, double* x,
+             const cg_opts_t* opts, cg_stats_t* stats)
+{
+    int n = A->n, i;
+    size_t npart = 2 * CG_STRIDE * omp_get_max_threads();
+    double* dinv = (double*) malloc(n * sizeof(double));
+    void* part;
+    double* res;
+    double bnorm, t0;
+
+    memset(stats, 0, sizeof(cg_stats_t));
+    if (pc_setup(A, opts->pc, dinv) < 0) {
+        free(dinv);
+        return -1;
+    }
+    /* Each thread's partial sums on a cache line of their own */
+    if (posix_memalign(&part, CG_STRIDE * sizeof(double),
+                       npart * sizeof(double)) != 0) {
+        free(dinv);
+        return -1;
+    }
+    memset(part, 0, npart * sizeof(double));
+    if (opts->record) {
+        stats->resid = (double*) calloc(opts->maxit + 1, sizeof(double));
+        stats->t_iter = (double*) calloc(opts->maxit + 1, sizeof(double));
+    }
+    bnorm = sqrt(dot(b, b, n));
+    if (bnorm == 0)
+        bnorm = 1;
+
+    t0 = omp_get_wtime();
+    if (opts->variant == CG_PLAIN)
+        stats->iters = cg_plain(A, b, x, opts, stats, dinv, bnorm);
+    else if (opts->variant == CG_FUSED)
+        stats->iters = cg_fused(A, b, x, opts, stats, dinv, bnorm,
+                                (double*) part);
+    else
+        stats->iters = cg_pipelined(A, b, x, opts, stats, dinv, bnorm,
+                                    (double*) part);
+    stats->time = omp_get_wtime() - t0;
+    stats->converged = (stats->relres <= opts->rtol);
+
+    res = (double*) malloc(n * sizeof(double));
+    sparse_multiply((csr_t*) A, x, res);
+    #pragma omp parallel for
+    for (i = 0; i < n; ++i)
+        res[i] = b[i] - res[i];
+    stats->true_relres = sqrt(dot(res, res, n)) / bnorm;
+
+    free(res);
+    free(part);
+    free(dinv);
+    return stats->converged ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#ifndef CG_H
+#define CG_H
+
+#include "csr.h"
+
+/*
+ * Preconditioned conjugate gradients for symmetric positive definite
+ * csr_t matrices.
+ *
+ * Preconditioners: Jacobi (the diagonal), or symmetric Gauss-Seidel,
+ * M = (D+L) D^-1 (D+U), with one forward and one backward sweep.  The
+ * sweeps are sequential, so each thread sweeps its own block of rows
+ * and ignores the couplings to other blocks (block Jacobi with SGS in
+ * each block); the preconditioner, and so the iteration count, then
+ * depends a little on the number of threads.
+ *
+ * Variants:
+ *   CG_PLAIN      the textbook loop: one call or loop per vector
+ *                 operation, about ten passes over memory an iteration
+ *   CG_FUSED      the product with p fused with p'Ap; the updates of
+ *                 x and r with the preconditioner and both dot
+ *                 products; then the update of p.  Three passes and
+ *                 three barriers an iteration.
+ *   CG_PIPELINED  Ghysels and Vanroose's pipelined CG, rearranged so
+ *                 that the product, all eight vector recurrences, the
+ *                 dot products and a Jacobi preconditioner are one
+ *                 pass, with one barrier an iteration; the product
+ *                 does not wait on the dot products.  Costs four more
+ *                 vectors, and the recurrences limit attainable
+ *                 accuracy somewhat.
+ */
+
+typedef enum cg_pc_t { CG_PC_NONE, CG_PC_JACOBI, CG_PC_SGS } cg_pc_t;
+typedef enum cg_variant_t { CG_PLAIN, CG_FUSED, CG_PIPELINED } cg_variant_t;
+
+typedef struct cg_opts_t {
+    cg_variant_t variant;
+    cg_pc_t pc;
+    int maxit;          /* Iteration limit */
+    double rtol;        /* Stop when ||r|| <= rtol ||b|| */
+    int record;         /* Keep the residual and time of each iteration */
+} cg_opts_t;
+
+typedef struct cg_stats_t {
+    int iters;          /* Iterations taken */
+    int converged;
+    double relres;      /* Final ||r|| / ||b|| from the recurrence */
+    double true_relres; /* ||b - A x|| / ||b||, recomputed at the end */
+    double time;        /* Seconds in the iteration (after setup) */
+    double* resid;      /* If record: ||r_k|| / ||b||, k = 0..iters */
+    double* t_iter;     /* If record: seconds for iteration k = 1..iters */
+} cg_stats_t;
+
+/* Defaults: CG_FUSED, Jacobi, rtol 1e-8, maxit n */
+void cg_default_opts(cg_opts_t* opts, int n);
+
+/*
+ * Solve A x = b from the initial guess in x.  Returns 0 if converged,
+ * 1 if not within maxit, and -1 if a preconditioner needs a positive
+ * diagonal that A does not have (or memory runs out).  Free stats with
+ * cg_stats_free; after -1 there is nothing to free.
+ */
+int cg_solve(const csr_t* A, const double* b, double* x,
+             const cg_opts_t* opts, cg_stats_t* stats);
+void cg_stats_free(cg_stats_t* stats);
+
+const char* cg_variant_name(cg_variant_t variant);
+const char* cg_pc_name(cg_pc_t pc);
+
+#endif /* CG_H */
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <omp.h>
+#include "csr.h"
+#include "cg.h"
+
+
+static void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [-m matrix] [-n rows] [-p pc] [-v variant]"
+            " [-t rtol] [-i maxit] [-r every]\n"
+            "  matrix: banded, laplace, or a Matrix Market or binary"
+            " CSR file (SPD)\n"
+            "  pc: none, jacobi, sgs, all\n"
+            "  variant: plain, fused, pipelined, all\n",
+            name);
+    exit(-1);
+}
+
+
+/* Largest |x - xs| relative to the largest |xs| */
+static double max_error(const double* x, const double* xs, int n)
+{
+    double err = 0, xmax = 0;
+    int i;
+    for (i = 0; i < n; ++i) {
+        err = fmax(err, fabs(x[i] - xs[i]));
+        xmax = fmax(xmax, fabs(xs[i]));
+    }
+    return err / xmax;
+}
+
+
+/*
+ * Options:
+ *   -m matrix = test matrix or SPD matrix file (default laplace)
+ *   -n rows = rows in the test matrix (default 1M)
+ *   -p pc = preconditioner (default all)
+ *   -v variant = solver variant (default all)
+ *   -t rtol = relative residual tolerance (default 1e-8)
+ *   -i maxit = iteration limit (default 10000)
+ *   -r every = also print the residual and iteration time of every
+ *              every-th iteration
+ *
+ * Solves A x = A xs from x = 0 with each preconditioner and variant,
+ * and reports iterations, time per iteration, the recurrence and true
+ * residuals, and the error in x.
+ */
+int main(int argc, char** argv)
+{
+    const char* kind = "laplace";
+    const char* pcs = "all";
+    const char* variants = "all";
+    int n = 1 << 20, every = 0, pc, variant, i;
+    cg_opts_t opts;
+    double *b, *x, *xs;
+    csr_t* A;
+
+    cg_default_opts(&opts, 0);
+    opts.maxit = 10000;
+    for (i = 1; i < argc; ++i) {
+        if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'm': kind = argv[++i]; break;
+            case 'n': n = atoi(argv[++i]); break;
+            case 'p': pcs = argv[++i]; break;
+            case 'v': variants = argv[++i]; break;
+            case 't': opts.rtol = atof(argv[++i]); break;
+            case 'i': opts.maxit = atoi(argv[++i]); break;
+            case 'r': every = atoi(argv[++i]); break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    A = csr_generate(kind, n);
+    if (A == NULL)
+        A = csr_load(kind);
+    if (A == NULL)
+        print_usage_quit(argv[0]);
+    n = A->n;
+    opts.record = (every > 0);
+
+    b = (double*) malloc(n * sizeof(double));
+    x = (double*) malloc(n * sizeof(double));
+    xs = (double*) malloc(n * sizeof(double));
+    for (i = 0; i < n; ++i)
+        xs[i] = 1.0 + (double) (i % 17) / 16;
+    sparse_multiply(A, xs, b);
+
+    printf("Threads: %d, %s: n=%d nnz=%d, rtol %.1e\n",
+           omp_get_max_threads(), kind, n, A->ptr[n], opts.rtol);
+    for (pc = CG_PC_NONE; pc <= CG_PC_SGS; ++pc) {
+        if (strcmp(pcs, "all") != 0 &&
+            strcasecmp(pcs, cg_pc_name((cg_pc_t) pc)) != 0)
+            continue;
+        for (variant = CG_PLAIN; variant <= CG_PIPELINED; ++variant) {
+            cg_stats_t st;
+            int status;
+            if (strcmp(variants, "all") != 0 &&
+                strcmp(variants, cg_variant_name((cg_variant_t) variant)))
+                continue;
+            opts.pc = (cg_pc_t) pc;
+            opts.variant = (cg_variant_t) variant;
+            memset(x, 0, n * sizeof(double));
+            status = cg_solve(A, b, x, &opts, &st);
+            if (status < 0) {
+                printf("%-6s %-9s: needs a positive diagonal\n",
+                       cg_pc_name(opts.pc), cg_variant_name(opts.variant));
+                continue;
+            }
+            printf("%-6s %-9s: %5d its %s, %.3f s (%.3f ms/it),"
+                   " residual %.1e (true %.1e), error %.1e\n",
+                   cg_pc_name(opts.pc), cg_variant_name(opts.variant),
+                   st.iters, status == 0 ? "converged" : "NOT converged",
+                   st.time, st.iters ? 1e3 * st.time / st.iters : 0,
+                   st.relres, st.true_relres, max_error(x, xs, n));
+            if (every > 0)
+                for (i = 0; i <= st.iters; i += every)
+                    printf("  it %5d: residual %.3e, %.3f ms\n", i,
+                           st.resid[i], 1e3 * st.t_iter[i]);
+            cg_stats_free(&st);
+        }
+    }
+
+    free(xs);
+    free(x);
+    free(b);
+    csr_free(A);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <omp.h>
+#include "csr.h"
+
+#define SHORT_ROW 32
+
+
+csr_t* csr_alloc(int n, int nnz)
+{
+    csr_t* A = (csr_t*) malloc(sizeof(csr_t));
+    A->n = n;
+    A->pr = (double*) malloc(nnz * sizeof(double));
+    A->col = (int*) malloc(nnz * sizeof(int));
+    A->ptr = (int*) malloc((n+1) * sizeof(int));
+    A->ptr[0] = 0;
+    A->map = NULL;
+    A->mapsize = 0;
+    return A;
+}
+
+
+void csr_free(csr_t* A)
+{
+    if (A == NULL)
+        return;
+    if (A->map) {
+        munmap(A->map, A->mapsize);
+        free(A);
+        return;
+    }
+    free(A->ptr);
+    free(A->col);
+    free(A->pr);
+    free(A);
+}
+
+
+typedef struct entry_t {
+    int col;
+    double v;
+} entry_t;
+
+static int compare_entry(const void* a, const void* b)
+{
+    const entry_t* x = (const entry_t*) a;
+    const entry_t* y = (const entry_t*) b;
+    return (x->col > y->col) - (x->col < y->col);
+}
+
+
+/* Sort the entries of row i by column */
+void csr_sort_row(csr_t* A, int i)
+{
+    int start = A->ptr[i], end = A->ptr[i+1];
+    int* col = A->col;
+    double* pr = A->pr;
+    int k, m;
+    if (end-start <= SHORT_ROW) {
+        for (k = start+1; k < end; ++k) {
+            int c = col[k];
+            double v = pr[k];
+            for (m = k; m > start && col[m-1] > c; --m) {
+                col[m] = col[m-1];
+                pr[m] = pr[m-1];
+            }
+            col[m] = c;
+            pr[m] = v;
+        }
+    } else {
+        entry_t* e = (entry_t*) malloc((end-start) * sizeof(entry_t));
+        for (k = start; k < end; ++k) {
+            e[k-start].col = col[k];
+            e[k-start].v = pr[k];
+        }
+        qsort(e, end-start, sizeof(entry_t), compare_entry);
+        for (k = start; k < end; ++k) {
+            col[k] = e[k-start].col;
+            pr[k] = e[k-start].v;
+        }
+        free(e);
+    }
+}
+
+
+/* First i in [0, n] with ptr[i] + i >= target */
+static int lower_bound(const int* ptr, int n, long target)
+{
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi-lo)/2;
+        if ((long) ptr[mid] + mid < target)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+void partition_ptr(const int* ptr, int n, int t, int nthreads,
+                   int* i0, int* i1)
+{
+    long total = (long) ptr[n] + n;
+    *i0 = lower_bound(ptr, n, total * t / nthreads);
+    *i1 = (t+1 == nthreads) ? n :
+        lower_bound(ptr, n, total * (t+1) / nthreads);
+}
+
+
+void csr_thread_rows(const csr_t* A, int t, int nthreads, int* i0, int* i1)
+{
+    partition_ptr(A->ptr, A->n, t, nthreads, i0, i1);
+}
+
+
+void sparse_multiply(csr_t* A, double* x, double* result)
+{
+    #pragma omp parallel
+    {
+        const double* restrict pr = A->pr;
+        const int* restrict col = A->col;
+        const int* restrict ptr = A->ptr;
+        int i, j, i0, i1;
+        csr_thread_rows(A, omp_get_thread_num(), omp_get_num_threads(),
+                        &i0, &i1);
+        for (i = i0; i < i1; ++i) {
+            double sum = 0;
+            for (j = ptr[i]; j < ptr[i+1]; ++j)
+                sum += pr[j] * x[col[j]];
+            result[i] = sum;
+        }
+    }
+}
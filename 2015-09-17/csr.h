@@ -0,0 +1,117 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <stddef.h>
+
+typedef struct csr_t {
+    int  n;      /* Dimension of matrix (assume square) */
+    double* pr;  /* Array of matrix nonzeros (row major order) */
+    int* col;    /* Column indices of nonzeros */
+    int* ptr;    /* Offsets of the start of each row in pr
+                    (ptr[n] = number of nonzeros) */
+    void* map;   /* File mapping holding the arrays (csr_map_bin),
+                    or NULL if they were allocated */
+    size_t mapsize;
+} csr_t;
+
+/* Allocate an n-by-n matrix with room for nnz nonzeros */
+csr_t* csr_alloc(int n, int nnz);
+void csr_free(csr_t* A);
+
+/* Sort the entries of row i by column */
+void csr_sort_row(csr_t* A, int i);
+
+/*
+ * Split [0, n) into nthreads ranges of roughly equal weight, where
+ * ptr[i] is the total weight of items before i (ptr[n] of all of them);
+ * thread t gets [*i0, *i1).  Each item also counts one unit, so that
+ * empty rows are not free.
+ */
+void partition_ptr(const int* ptr, int n, int t, int nthreads,
+                   int* i0, int* i1);
+
+/* Rows for thread t, balanced by nonzeros */
+void csr_thread_rows(const csr_t* A, int t, int nthreads, int* i0, int* i1);
+
+/*
+ * result = A*x, in parallel over row ranges with equal numbers of
+ * nonzeros.  Each row is summed in order, so the result does not
+ * depend on the number of threads.
+ */
+void sparse_multiply(csr_t* A, double* x, double* result);
+
+/*
+ * Y = A*X for a block of nv vectors (csr_block.c), reading the matrix
+ * once for every BLOCK_MAX (32) vectors.  In BLOCK_ROW_MAJOR layout,
+ * entry v of row j is X[j*ldx + v], so each row of X is contiguous; in
+ * BLOCK_COL_MAJOR it is X[v*ldx + j], so each vector is.  Likewise for
+ * Y with ldy.  Each width up to 32 has its own kernel.  Row-major is
+ * the faster layout: the entries of X a nonzero needs share a cache
+ * line.  Column-major blocks are done 8 vectors at a time when the
+ * nonzeros stay near the diagonal, and otherwise copied to row-major
+ * scratch in work, which must hold sparse_multiply_block_work doubles.
+ * Pass NULL to have it allocated for the call; a caller that multiplies
+ * repeatedly should keep its own, so the pages are only faulted in
+ * once.  Each column of Y is what sparse_multiply gives for that column
+ * of X.
+ */
+enum { BLOCK_ROW_MAJOR, BLOCK_COL_MAJOR };
+size_t sparse_multiply_block_work(const csr_t* A, int nv, int layout);
+void sparse_multiply_block(const csr_t* A, int nv, int layout,
+                           const double* X, int ldx, double* Y, int ldy,
+                           double* work);
+
+/*
+ * Test matrices (csr_gen.c).  All have a nonzero diagonal; banded and
+ * laplace2d are symmetric and positive definite.
+ */
+csr_t* csr_banded(int n, int bw);             /* Half-bandwidth bw */
+csr_t* csr_laplace2d(int m);                  /* 5-point, m-by-m grid */
+csr_t* csr_random(int n, int per_row, unsigned seed);
+csr_t* csr_powerlaw(int n, int avg, double alpha, unsigned seed);
+csr_t* csr_blocks(int m, int b, int per_row, unsigned seed);
+                                              /* b-by-b dense blocks */
+
+/*
+ * A test matrix with about n rows by name: banded, laplace, random,
+ * powerlaw, or blocks (NULL for anything else)
+ */
+csr_t* csr_generate(const char* kind, int n);
+
+/*
+ * Matrix files (csr_io.c).  csr_read_mtx reads a square real, integer
+ * or pattern Matrix Market coordinate file (general, symmetric or
+ * skew-symmetric), parsing it in parallel straight into CSR; rows come
+ * out sorted by column, and duplicate entries are kept.  The binary
+ * format is a header and the three arrays, which csr_map_bin maps in
+ * place (copy-on-write).  csr_load takes either kind of file; for a
+ * Matrix Market file it keeps a binary copy in fname.csr, and maps
+ * that instead while it is up to date.  All return NULL on error.
+ */
+csr_t* csr_read_mtx(const char* fname);
+int csr_write_mtx(const csr_t* A, const char* fname);
+int csr_write_bin(const csr_t* A, const char* fname);
+csr_t* csr_map_bin(const char* fname);
+csr_t* csr_load(const char* fname);
+
+/*
+ * Bandwidth-reducing orderings (csr_order.c) of the pattern of A + A^T.
+ * A permutation lists, for each new index, the old one: row i of
+ * csr_permute(A, perm) is row perm[i] of A, with its columns renumbered
+ * the same way (P A P^T).  csr_rcm is reverse Cuthill-McKee;
+ * csr_partition_order splits the graph into nparts pieces by recursive
+ * level-structure bisection and numbers each piece in RCM order, so
+ * that each thread's rows touch a compact part of x.  permute_vector
+ * sets xp = P x, and unpermute_vector undoes it.
+ */
+int* csr_rcm(const csr_t* A);
+int* csr_partition_order(const csr_t* A, int nparts);
+int* perm_inverse(const int* perm, int n);
+csr_t* csr_permute(const csr_t* A, const int* perm);
+void permute_vector(const int* perm, int n, const double* x, double* xp);
+void unpermute_vector(const int* perm, int n, const double* xp, double* x);
+
+/* Largest |i-j| over the nonzeros, and the sum over rows of i - min j */
+void csr_profile(const csr_t* A, int* bandwidth, long* profile);
+
+#endif /* CSR_H */
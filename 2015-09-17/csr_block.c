@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <omp.h>
+#include "csr.h"
+
+#define BLOCK_MAX 32          /* Widest block per pass over the matrix */
+#define BLOCK_COL_TILE 8      /* Column-major vectors per pass, unpacked */
+#define BLOCK_SAMPLE 4096     /* Rows sampled to judge locality */
+#define BLOCK_LOCAL_SPAN 2048 /* Mean |i-j| up to which x stays in cache */
+
+
+/*
+ * Y = A*X over rows [i0, i1) for nv <= BLOCK_MAX vectors, in the given
+ * layout.  Always inlined so that each width gets a constant nv, and
+ * the accumulators live in registers.  Each vector's sum runs over
+ * the row in order, as in sparse_multiply.
+ */
+static inline __attribute__((always_inline))
+void block_rows(const csr_t* A, int nv, int layout,
+                const double* restrict X, int ldx,
+                double* restrict Y, int ldy, int i0, int i1)
+{
+    const double* restrict pr = A->pr;
+    const int* restrict col = A->col;
+    const int* restrict ptr = A->ptr;
+    int i, j, v;
+    for (i = i0; i < i1; ++i) {
+        double acc[BLOCK_MAX];
+        for (v = 0; v < nv; ++v)
+            acc[v] = 0;
+        if (layout == BLOCK_ROW_MAJOR) {
+            for (j = ptr[i]; j < ptr[i+1]; ++j) {
+                const double* restrict xj = X + (long) col[j]*ldx;
+                double a = pr[j];
+                #pragma omp simd
+                for (v = 0; v < nv; ++v)
+                    acc[v] += a * xj[v];
+            }
+            for (v = 0; v < nv; ++v)
+                Y[(long) i*ldy + v] = acc[v];
+        } else {
+            for (j = ptr[i]; j < ptr[i+1]; ++j) {
+                const double* restrict xj = X + col[j];
+                double a = pr[j];
+                for (v = 0; v < nv; ++v)
+                    acc[v] += a * xj[(long) v*ldx];
+            }
+            for (v = 0; v < nv; ++v)
+                Y[i + (long) v*ldy] = acc[v];
+        }
+    }
+}
+
+
+static void block_rows_any(const csr_t* A, int nv, int layout,
+                           const double* X, int ldx, double* Y, int ldy,
+                           int i0, int i1)
+{
+    #define BLOCK_CASE(W)                                                 \
+        case W:                                                           \
+            if (layout == BLOCK_ROW_MAJOR)                                \
+                block_rows(A, W, BLOCK_ROW_MAJOR, X, ldx, Y, ldy, i0, i1); \
+            else                                                          \
+                block_rows(A, W, BLOCK_COL_MAJOR, X, ldx, Y, ldy, i0, i1); \
+            break
+    switch (nv) {
+    BLOCK_CASE(1);  BLOCK_CASE(2);  BLOCK_CASE(3);  BLOCK_CASE(4);
+    BLOCK_CASE(5);  BLOCK_CASE(6);  BLOCK_CASE(7);  BLOCK_CASE(8);
+    BLOCK_CASE(9);  BLOCK_CASE(10); BLOCK_CASE(11); BLOCK_CASE(12);
+    BLOCK_CASE(13); BLOCK_CASE(14); BLOCK_CASE(15); BLOCK_CASE(16);
+    BLOCK_CASE(17); BLOCK_CASE(18); BLOCK_CASE(19); BLOCK_CASE(20);
+    BLOCK_CASE(21); BLOCK_CASE(22); BLOCK_CASE(23); BLOCK_CASE(24);
+    BLOCK_CASE(25); BLOCK_CASE(26); BLOCK_CASE(27); BLOCK_CASE(28);
+    BLOCK_CASE(29); BLOCK_CASE(30); BLOCK_CASE(31); BLOCK_CASE(32);
+    }
+    #undef BLOCK_CASE
+}
+
+
+/* Copy rows [i0, i1) of an n-by-w block from one layout to the other */
+static void transpose_rows(const double* src, int lds, double* dst, int ldd,
+                           int w, int i0, int i1, int to_rows)
+{
+    int i, v;
+    if (to_rows) {
+        for (i = i0; i < i1; ++i)
+            for (v = 0; v < w; ++v)
+                dst[(long) i*ldd + v] = src[i + (long) v*lds];
+    } else {
+        for (v = 0; v < w; ++v)
+            for (i = i0; i < i1; ++i)
+                dst[i + (long) v*ldd] = src[(long) i*lds + v];
+    }
+}
+
+
+/*
+ * Do the nonzeros stay near the diagonal?  Then the entries of x a row
+ * needs are in cache for every vector of a column-major block too.
+ * Judged by the mean |i-j| over a sample of rows.
+ */
+static int block_local(const csr_t* A)
+{
+    int step = (A->n > BLOCK_SAMPLE) ? A->n / BLOCK_SAMPLE : 1;
+    double dist = 0, count = 0;
+    int i, k;
+    for (i = 0; i < A->n; i += step)
+        for (k = A->ptr[i]; k < A->ptr[i+1]; ++k) {
+            dist += abs(A->col[k] - i);
+            count += 1;
+        }
+    return dist <= BLOCK_LOCAL_SPAN * count;
+}
+
+
+size_t sparse_multiply_block_work(const csr_t* A, int nv, int layout)
+{
+    int w = (nv < BLOCK_MAX) ? nv : BLOCK_MAX;
+    if (layout == BLOCK_ROW_MAJOR || nv == 1)
+        return 0;
+    return 2 * (size_t) A->n * w;
+}
+
+
+void sparse_multiply_block(const csr_t* A, int nv, int layout,
+                           const double* X, int ldx, double* Y, int ldy,
+                           double* work)
+{
+    int w = (nv < BLOCK_MAX) ? nv : BLOCK_MAX;
+    int pack = (layout == BLOCK_COL_MAJOR && nv > 1 && !block_local(A));
+    int tile = (layout == BLOCK_COL_MAJOR && !pack) ?
+        BLOCK_COL_TILE : BLOCK_MAX;
+    double* own = NULL;
+    double* XR = NULL;
+    double* YR = NULL;
+    if (pack) {
+        /* Row-major copies of each pass's vectors */
+        if (work == NULL)
+            work = own = (double*) malloc(2 * (size_t) A->n * w *
+                                          sizeof(double));
+        XR = work;
+        YR = XR + (size_t) A->n * w;
+    }
+
+    #pragma omp parallel
+    {
+        int i0, i1, v0;
+        csr_thread_rows(A, omp_get_thread_num(), omp_get_num_threads(),
+                        &i0, &i1);
+        for (v0 = 0; v0 < nv; v0 += tile) {
+            int wv = (nv - v0 < tile) ? nv - v0 : tile;
+            if (layout == BLOCK_ROW_MAJOR) {
+                block_rows_any(A, wv, layout, X + v0, ldx, Y + v0, ldy,
+                               i0, i1);
+            } else if (!pack) {
+                block_rows_any(A, wv, layout, X + (long) v0*ldx, ldx,
+                               Y + (long) v0*ldy, ldy, i0, i1);
+            } else {
+                /* Every thread reads all of XR, so wait for all of it */
+                transpose_rows(X + (long) v0*ldx, ldx, XR, wv, wv, i0, i1, 1);
+                #pragma omp barrier
+                block_rows_any(A, wv, BLOCK_ROW_MAJOR, XR, wv, YR, wv,
+                               i0, i1);
+                transpose_rows(YR, wv, Y + (long) v0*ldy, ldy, wv, i0, i1, 0);
+                #pragma omp barrier
+            }
+        }
+    }
+    free(own);
+}
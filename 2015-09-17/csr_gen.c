@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "csr.h"
+
+/*
+ * Test matrix generators.  Each builds its rows in order into a
+ * growing matrix: row_add for each entry of the row (in any order),
+ * then row_end, which sorts the row and merges duplicates.
+ */
+
+typedef struct builder_t {
+    csr_t* A;
+    int nnz, cap;
+    int row;
+} builder_t;
+
+
+static void builder_init(builder_t* b, int n, int cap)
+{
+    b->A = csr_alloc(n, cap);
+    b->nnz = 0;
+    b->cap = cap;
+    b->row = 0;
+}
+
+
+static void row_add(builder_t* b, int j, double v)
+{
+    if (b->nnz == b->cap) {
+        b->cap *= 2;
+        b->A->pr = (double*) realloc(b->A->pr, b->cap * sizeof(double));
+        b->A->col = (int*) realloc(b->A->col, b->cap * sizeof(int));
+    }
+    b->A->col[b->nnz] = j;
+    b->A->pr[b->nnz++] = v;
+}
+
+
+static void row_end(builder_t* b)
+{
+    int* col = b->A->col;
+    double* pr = b->A->pr;
+    int start = b->A->ptr[b->row];
+    int i, j, k;
+
+    /* Insertion sort: rows are short */
+    for (i = start+1; i < b->nnz; ++i) {
+        int c = col[i];
+        double v = pr[i];
+        for (j = i; j > start && col[j-1] > c; --j) {
+            col[j] = col[j-1];
+            pr[j] = pr[j-1];
+        }
+        col[j] = c;
+        pr[j] = v;
+    }
+    for (i = start, k = start; i < b->nnz; ++i) {
+        if (k > start && col[k-1] == col[i])
+            pr[k-1] += pr[i];
+        else {
+            col[k] = col[i];
+            pr[k++] = pr[i];
+        }
+    }
+    b->nnz = k;
+    b->A->ptr[++b->row] = k;
+}
+
+
+/* Trim the arrays to the final number of nonzeros */
+static csr_t* builder_done(builder_t* b)
+{
+    int nnz = (b->nnz > 0) ? b->nnz : 1;
+    b->A->pr = (double*) realloc(b->A->pr, nnz * sizeof(double));
+    b->A->col = (int*) realloc(b->A->col, nnz * sizeof(int));
+    return b->A;
+}
+
+
+static uint64_t hash64(uint64_t z)
+{
+    z += 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+/* Uniform in [0, 1) from a counter */
+static double uniform(uint64_t* state)
+{
+    return (hash64((*state)++) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/* Symmetric value in [-1, 0) for entry (i,j) */
+static double sym_value(int i, int j)
+{
+    uint64_t a = (i < j) ? i : j;
+    uint64_t b = (i < j) ? j : i;
+    return -(double) ((hash64((a << 32) | b) >> 11) + 1) /
+        9007199254740992.0;
+}
+
+
+csr_t* csr_banded(int n, int bw)
+{
+    builder_t b;
+    int i, j;
+    builder_init(&b, n, n * (2*bw+1));
+    for (i = 0; i < n; ++i) {
+        double diag = 1;
+        for (j = i-bw; j <= i+bw; ++j)
+            if (j >= 0 && j < n && j != i)
+                diag -= sym_value(i, j);
+        for (j = i-bw; j <= i+bw; ++j)
+            if (j >= 0 && j < n)
+                row_add(&b, j, (j == i) ? diag : sym_value(i, j));
+        row_end(&b);
+    }
+    return builder_done(&b);
+}
+
+
+csr_t* csr_laplace2d(int m)
+{
+    builder_t b;
+    int i, j;
+    builder_init(&b, m*m, 5*m*m);
+    for (j = 0; j < m; ++j)
+        for (i = 0; i < m; ++i) {
+            int k = i + j*m;
+            if (j > 0)   row_add(&b, k-m, -1);
+            if (i > 0)   row_add(&b, k-1, -1);
+            row_add(&b, k, 4);
+            if (i < m-1) row_add(&b, k+1, -1);
+            if (j < m-1) row_add(&b, k+m, -1);
+            row_end(&b);
+        }
+    return builder_done(&b);
+}
+
+
+csr_t* csr_random(int n, int per_row, unsigned seed)
+{
+    builder_t b;
+    uint64_t state = (uint64_t) seed << 40;
+    int i, k;
+    builder_init(&b, n, n * (per_row+1));
+    for (i = 0; i < n; ++i) {
+        row_add(&b, i, per_row+1);
+        for (k = 0; k < per_row; ++k)
+            row_add(&b, (int) (uniform(&state) * n),
+                    2*uniform(&state)-1);
+        row_end(&b);
+    }
+    return builder_done(&b);
+}
+
+
+/*
+ * Row lengths drawn from a Pareto distribution with exponent alpha > 1
+ * and mean about avg (capped at n/4), so a few rows are very long
+ */
+csr_t* csr_powerlaw(int n, int avg, double alpha, unsigned seed)
+{
+    builder_t b;
+    uint64_t state = (uint64_t) seed << 40;
+    double xm = avg * (alpha-1) / alpha;
+    int i, k;
+    builder_init(&b, n, n * (avg+1));
+    for (i = 0; i < n; ++i) {
+        double len = ceil(xm * pow(1-uniform(&state), -1/alpha));
+        int nk = (len > n/4) ? n/4 : (int) len;
+        row_add(&b, i, nk+1);
+        for (k = 0; k < nk; ++k)
+            row_add(&b, (int) (uniform(&state) * n),
+                    2*uniform(&state)-1);
+        row_end(&b);
+    }
+    return builder_done(&b);
+}
+
+
+/*
+ * m block rows of dense b-by-b blocks: the diagonal block and per_row-1
+ * others near it, as from a finite element mesh with b unknowns per node
+ */
+csr_t* csr_blocks(int m, int bs, int per_row, unsigned seed)
+{
+    builder_t b;
+    uint64_t state = (uint64_t) seed << 40;
+    int* bcols = (int*) malloc(per_row * sizeof(int));
+    int I, i, j, k;
+    builder_init(&b, m*bs, m * per_row * bs*bs);
+    for (I = 0; I < m; ++I) {
+        bcols[0] = I;
+        for (k = 1; k < per_row; ++k) {
+            int J = I + (int) ((uniform(&state)-0.5) * 4 * per_row);
+            bcols[k] = (J < 0) ? 0 : (J >= m) ? m-1 : J;
+        }
+        for (i = 0; i < bs; ++i) {
+            for (k = 0; k < per_row; ++k)
+                for (j = 0; j < bs; ++j)
+                    row_add(&b, bcols[k]*bs + j,
+                            (k == 0 && i == j) ? per_row*bs :
+                            2*uniform(&state)-1);
+            row_end(&b);
+        }
+    }
+    free(bcols);
+    return builder_done(&b);
+}
+
+
+csr_t* csr_generate(const char* kind, int n)
+{
+    if (strcmp(kind, "banded") == 0)
+        return csr_banded(n, 4);
+    if (strcmp(kind, "laplace") == 0)
+        return csr_laplace2d((int) sqrt((double) n));
+    if (strcmp(kind, "random") == 0)
+        return csr_random(n, 15, 1);
+    if (strcmp(kind, "powerlaw") == 0)
+        return csr_powerlaw(n, 16, 1.5, 1);
+    if (strcmp(kind, "blocks") == 0)
+        return csr_blocks(n/3, 3, 9, 1);
+    return NULL;
+}
@@ -0,0 +1,575 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "csr.h"
+
+#define CSR_MAGIC "CSRBIN01"
+#define CSR_HEADER 64
+#define MAX_LINE 256
+#define CHUNKS_PER_THREAD 8
+
+/*
+ * Binary file header; the arrays follow at 8-byte aligned offsets:
+ * ptr (n+1 ints), col (nnz ints), pr (nnz doubles).  For a cache of a
+ * Matrix Market file, the size and modification time (to the
+ * nanosecond) of the source say whether the cache is still good.
+ */
+typedef struct csr_header_t {
+    char magic[8];
+    int64_t n;
+    int64_t nnz;
+    int64_t src_size;
+    int64_t src_mtime;
+    int64_t src_mtime_ns;
+} csr_header_t;
+
+enum { MTX_GENERAL, MTX_SYMMETRIC, MTX_SKEW };
+
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~(size_t) 7;
+}
+
+
+/* Powers of ten that doubles hold exactly */
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/*
+ * Parse a decimal number at p (which must be followed by a newline or
+ * other non-number character before the end of the mapping).  Numbers
+ * with at most 15 significant digits and a small exponent are one
+ * exact multiply or divide, hence correctly rounded (Clinger's fast
+ * path); anything else goes to strtod.
+ */
+static double parse_double(const char* p, const char** endp)
+{
+    const char* s = p;
+    uint64_t mant = 0;
+    int digits = 0, exp10 = 0, neg = 0;
+    if (*s == '-' || *s == '+')
+        neg = (*s++ == '-');
+    while (*s == '0')
+        ++s;
+    for (; *s >= '0' && *s <= '9'; ++s, ++digits)
+        mant = 10*mant + (*s - '0');
+    if (*s == '.') {
+        ++s;
+        if (digits == 0)
+            for (; *s == '0'; ++s)
+                --exp10;
+        for (; *s >= '0' && *s <= '9'; ++s, ++digits, --exp10)
+            mant = 10*mant + (*s - '0');
+    }
+    if (*s == 'e' || *s == 'E') {
+        const char* t = s+1;
+        int eneg = 0, e = 0;
+        if (*t == '-' || *t == '+')
+            eneg = (*t++ == '-');
+        if (*t < '0' || *t > '9')
+            goto slow;
+        for (; *t >= '0' && *t <= '9' && e < 10000; ++t)
+            e = 10*e + (*t - '0');
+        exp10 += eneg ? -e : e;
+        s = t;
+    }
+    if (s == p || digits > 15 || exp10 < -22 || exp10 > 22)
+        goto slow;
+    *endp = s;
+    {
+        double v = (double) mant;
+        v = (exp10 < 0) ? v / exact_pow10[-exp10] : v * exact_pow10[exp10];
+        return neg ? -v : v;
+    }
+slow:
+    return strtod(p, (char**) endp);
+}
+
+
+static const char* skip_blanks(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+
+static const char* parse_index(const char* p, const char* end, long* i)
+{
+    long v = 0;
+    const char* s = skip_blanks(p, end);
+    const char* start = s;
+    for (; s < end && *s >= '0' && *s <= '9' && v < INT32_MAX; ++s)
+        v = 10*v + (*s - '0');
+    *i = (s == start) ? -1 : v-1;
+    return s;
+}
+
+
+/*
+ * Parse one entry line at [p, e), where e is a newline (or the end of
+ * the file), into 0-based (i, j) and, if v is not NULL, a value;
+ * returns 1 for an entry, 0 for a blank or comment line, -1 on error
+ */
+static int parse_entry(const char* p, const char* e, int last, int pattern,
+                       long* i, long* j, double* v)
+{
+    const char* s = skip_blanks(p, e);
+    if (s == e || *s == '%')
+        return 0;
+    s = parse_index(s, e, i);
+    s = parse_index(s, e, j);
+    if (v == NULL)
+        return 1;
+    *v = 1;
+    if (!pattern) {
+        const char* t;
+        s = skip_blanks(s, e);
+        if (s == e)
+            return -1;
+        if (last) {
+            /* The mapping ends here, so parse a terminated copy */
+            char line[MAX_LINE];
+            char* u;
+            size_t len = (e-s < MAX_LINE) ? (size_t) (e-s) : MAX_LINE-1;
+            memcpy(line, s, len);
+            line[len] = '\0';
+            *v = strtod(line, &u);
+            return (u == line) ? -1 : 1;
+        }
+        *v = parse_double(s, &t);
+        if (t == s)
+            return -1;
+    }
+    return 1;
+}
+
+
+/*
+ * Chunk k of K of the data [data, end), with boundaries moved forward
+ * to the start of a line
+ */
+static void chunk_range(const char* data, const char* end, int k, int K,
+                        const char** c0, const char** c1)
+{
+    size_t len = end - data;
+    const char* lo = data + len / K * k;
+    const char* hi = (k+1 == K) ? end : data + len / K * (k+1);
+    if (k > 0) {
+        const char* nl = memchr(lo-1, '\n', end-(lo-1));
+        lo = nl ? nl+1 : end;
+    }
+    if (k+1 < K) {
+        const char* nl = memchr(hi-1, '\n', end-(hi-1));
+        hi = nl ? nl+1 : end;
+    }
+    *c0 = lo;
+    *c1 = (hi > lo) ? hi : lo;
+}
+
+
+/*
+ * One pass over the entries of [c0, c1).  Without a cursor, count each
+ * entry (and its mirror) in its row; with one, store it in the next
+ * free slot of its row.  Returns the number of entries, or -1 on error.
+ */
+static long mtx_pass(const char* c0, const char* c1, const char* end,
+                     int n, int pattern, int symmetry, int* count,
+                     int* cursor, csr_t* A)
+{
+    long nentries = 0;
+    const char* p = c0;
+    while (p < c1) {
+        const char* nl = memchr(p, '\n', c1-p);
+        const char* e = nl ? nl : c1;
+        long i, j;
+        double v;
+        int got = parse_entry(p, e, e == end, pattern, &i, &j,
+                              cursor ? &v : NULL);
+        p = e+1;
+        if (got == 0)
+            continue;
+        if (got < 0 || i < 0 || i >= n || j < 0 || j >= n)
+            return -1;
+        ++nentries;
+        if (cursor == NULL) {
+            #pragma omp atomic
+            count[i]++;
+            if (symmetry != MTX_GENERAL && i != j) {
+                #pragma omp atomic
+                count[j]++;
+            }
+        } else {
+            int slot;
+            #pragma omp atomic capture
+            slot = cursor[i]++;
+            A->col[slot] = (int) j;
+            A->pr[slot] = v;
+            if (symmetry != MTX_GENERAL && i != j) {
+                #pragma omp atomic capture
+                slot = cursor[j]++;
+                A->col[slot] = (int) i;
+                A->pr[slot] = (symmetry == MTX_SKEW) ? -v : v;
+            }
+        }
+    }
+    return nentries;
+}
+
+
+/*
+ * Read the banner and size line; returns the start of the entries, or
+ * NULL if the file is not one we can read
+ */
+static const char* mtx_header(const char* base, const char* end,
+                              int* pattern, int* symmetry,
+                              long* m, long* n, long* nnz)
+{
+    char line[MAX_LINE], object[32], format[32], field[32], sym[32];
+    const char* p = base;
+    const char* nl = memchr(p, '\n', end-p);
+    size_t len = nl ? (size_t) (nl-p) : (size_t) (end-p);
+    if (len >= MAX_LINE)
+        return NULL;
+    memcpy(line, p, len);
+    line[len] = '\0';
+    if (sscanf(line, "%%%%MatrixMarket %31s %31s %31s %31s",
+               object, format, field, sym) != 4 ||
+        strcasecmp(object, "matrix") != 0 ||
+        strcasecmp(format, "coordinate") != 0)
+        return NULL;
+    if (strcasecmp(field, "pattern") == 0)
+        *pattern = 1;
+    else if (strcasecmp(field, "real") == 0 ||
+             strcasecmp(field, "integer") == 0)
+        *pattern = 0;
+    else
+        return NULL;
+    if (strcasecmp(sym, "general") == 0)
+        *symmetry = MTX_GENERAL;
+    else if (strcasecmp(sym, "symmetric") == 0)
+        *symmetry = MTX_SYMMETRIC;
+    else if (strcasecmp(sym, "skew-symmetric") == 0)
+        *symmetry = MTX_SKEW;
+    else
+        return NULL;
+
+    /* Skip comments to the size line */
+    for (p = nl ? nl+1 : end; p < end; p = nl ? nl+1 : end) {
+        nl = memchr(p, '\n', end-p);
+        len = nl ? (size_t) (nl-p) : (size_t) (end-p);
+        if (len >= MAX_LINE)
+            return NULL;
+        memcpy(line, p, len);
+        line[len] = '\0';
+        if (line[strspn(line, " \t\r")] == '%' ||
+            line[strspn(line, " \t\r")] == '\0')
+            continue;
+        if (sscanf(line, "%ld %ld %ld", m, n, nnz) != 3)
+            return NULL;
+        return nl ? nl+1 : end;
+    }
+    return NULL;
+}
+
+
+csr_t* csr_read_mtx(const char* fname)
+{
+    struct stat st;
+    const char* base;
+    const char* data;
+    const char* end;
+    int pattern, symmetry;
+    long m, n, nnz, nentries = 0;
+    int nchunks = CHUNKS_PER_THREAD * omp_get_max_threads();
+    int* count;
+    int error = 0;
+    csr_t* A;
+    int fd, k, i;
+
+    fd = open(fname, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "Could not open matrix file: %s\n", fname);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    base = (const char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                              fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map matrix file: %s\n", fname);
+        return NULL;
+    }
+    madvise((void*) base, st.st_size, MADV_SEQUENTIAL);
+    end = base + st.st_size;
+
+    data = mtx_header(base, end, &pattern, &symmetry, &m, &n, &nnz);
+    if (data == NULL || m != n || n < 1 || n > INT32_MAX ||
+        nnz < 0 || nnz > INT32_MAX / 2) {
+        fprintf(stderr, "Not a square real coordinate Matrix Market"
+                " file: %s\n", fname);
+        munmap((void*) base, st.st_size);
+        return NULL;
+    }
+
+    /* Pass 1: count the entries in each row */
+    count = (int*) calloc(n+1, sizeof(int));
+    #pragma omp parallel for schedule(dynamic) reduction(+:nentries)
+    for (k = 0; k < nchunks; ++k) {
+        const char *c0, *c1;
+        long got;
+        chunk_range(data, end, k, nchunks, &c0, &c1);
+        got = mtx_pass(c0, c1, end, n, pattern, symmetry, count, NULL,
+                       NULL);
+        if (got < 0) {
+            #pragma omp atomic write
+            error = 1;
+        } else {
+            nentries += got;
+        }
+    }
+    if (error || nentries != nnz) {
+        fprintf(stderr, "Bad entries (%ld of %ld read) in: %s\n",
+                nentries, nnz, fname);
+        free(count);
+        munmap((void*) base, st.st_size);
+        return NULL;
+    }
+
+    /* Row pointers; count becomes the next free slot of each row */
+    A = csr_alloc((int) n, 0);
+    for (i = 0; i < n; ++i) {
+        A->ptr[i+1] = A->ptr[i] + count[i];
+        count[i] = A->ptr[i];
+    }
+    A->pr = (double*) realloc(A->pr, (A->ptr[n] + 1) * sizeof(double));
+    A->col = (int*) realloc(A->col, (A->ptr[n] + 1) * sizeof(int));
+
+    /* Pass 2: place the entries, then put each row in column order */
+    #pragma omp parallel for schedule(dynamic)
+    for (k = 0; k < nchunks; ++k) {
+        const char *c0, *c1;
+        chunk_range(data, end, k, nchunks, &c0, &c1);
+        mtx_pass(c0, c1, end, n, pattern, symmetry, count, count, A);
+    }
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (i = 0; i < n; ++i)
+        csr_sort_row(A, i);
+
+    free(count);
+    munmap((void*) base, st.st_size);
+    return A;
+}
+
+
+int csr_write_mtx(const csr_t* A, const char* fname)
+{
+    FILE* fp = fopen(fname, "w");
+    int i, j;
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open matrix file: %s\n", fname);
+        return -1;
+    }
+    fprintf(fp, "%%%%MatrixMarket matrix coordinate real general\n");
+    fprintf(fp, "%d %d %d\n", A->n, A->n, A->ptr[A->n]);
+    for (i = 0; i < A->n; ++i)
+        for (j = A->ptr[i]; j < A->ptr[i+1]; ++j)
+            fprintf(fp, "%d %d %.17g\n", i+1, A->col[j]+1, A->pr[j]);
+    if (ferror(fp) | fclose(fp)) {
+        fprintf(stderr, "Error writing matrix file: %s\n", fname);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Write A with a header recording the source file's size and time.
+ * The data goes to a temporary file that is renamed over fname, so a
+ * reader never maps a partly written file.
+ */
+static int write_bin(const csr_t* A, const char* fname,
+                     int64_t src_size, const struct timespec* src_mtime)
+{
+    static const char zeros[8] = {0};
+    char header[CSR_HEADER] = {0};
+    csr_header_t h;
+    size_t nnz = A->ptr[A->n];
+    char* tmpname = (char*) malloc(strlen(fname) + 32);
+    FILE* fp;
+    int status = 0;
+
+    sprintf(tmpname, "%s.tmp%ld", fname, (long) getpid());
+    fp = fopen(tmpname, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open matrix file: %s\n", tmpname);
+        free(tmpname);
+        return -1;
+    }
+    memcpy(h.magic, CSR_MAGIC, 8);
+    h.n = A->n;
+    h.nnz = nnz;
+    h.src_size = src_size;
+    h.src_mtime = src_mtime ? src_mtime->tv_sec : 0;
+    h.src_mtime_ns = src_mtime ? src_mtime->tv_nsec : 0;
+    memcpy(header, &h, sizeof(h));
+    fwrite(header, 1, CSR_HEADER, fp);
+    fwrite(A->ptr, sizeof(int), A->n+1, fp);
+    fwrite(zeros, 1, align8((A->n+1) * sizeof(int)) -
+           (A->n+1) * sizeof(int), fp);
+    fwrite(A->col, sizeof(int), nnz, fp);
+    fwrite(zeros, 1, align8(nnz * sizeof(int)) - nnz * sizeof(int), fp);
+    fwrite(A->pr, sizeof(double), nnz, fp);
+    if (ferror(fp) | fclose(fp)) {
+        fprintf(stderr, "Error writing matrix file: %s\n", tmpname);
+        unlink(tmpname);
+        status = -1;
+    } else if (rename(tmpname, fname) != 0) {
+        fprintf(stderr, "Could not rename matrix file: %s\n", tmpname);
+        unlink(tmpname);
+        status = -1;
+    }
+    free(tmpname);
+    return status;
+}
+
+
+int csr_write_bin(const csr_t* A, const char* fname)
+{
+    return write_bin(A, fname, 0, NULL);
+}
+
+
+/* Are the row pointers nondecreasing and every column in [0, n)? */
+static int csr_valid(const csr_t* A)
+{
+    int n = A->n, bad = 0, i, k;
+    #pragma omp parallel for reduction(|:bad) private(k)
+    for (i = 0; i < n; ++i) {
+        if (A->ptr[i+1] < A->ptr[i])
+            bad = 1;
+        else
+            for (k = A->ptr[i]; k < A->ptr[i+1]; ++k)
+                bad |= (A->col[k] < 0 || A->col[k] >= n);
+    }
+    return !bad;
+}
+
+
+/*
+ * Map a binary file, checking that it is complete and that the arrays
+ * make a valid matrix; if src_size is nonzero, also check that it was
+ * made from a source of that size and time
+ */
+static csr_t* map_bin(const char* fname, int64_t src_size,
+                      const struct timespec* src_mtime, int quiet)
+{
+    struct stat st;
+    csr_header_t h;
+    size_t ptr_bytes, col_bytes, need;
+    char* base;
+    csr_t* A;
+    int fd = open(fname, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (!quiet)
+            fprintf(stderr, "Could not open matrix file: %s\n", fname);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    if (st.st_size < CSR_HEADER ||
+        pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+        memcmp(h.magic, CSR_MAGIC, 8) != 0 ||
+        h.n < 1 || h.n > INT32_MAX || h.nnz < 0 || h.nnz > INT32_MAX ||
+        (src_size && (h.src_size != src_size ||
+                      h.src_mtime != src_mtime->tv_sec ||
+                      h.src_mtime_ns != src_mtime->tv_nsec))) {
+        if (!quiet)
+            fprintf(stderr, "Bad matrix file: %s\n", fname);
+        close(fd);
+        return NULL;
+    }
+    ptr_bytes = align8((h.n+1) * sizeof(int));
+    col_bytes = align8(h.nnz * sizeof(int));
+    need = CSR_HEADER + ptr_bytes + col_bytes + h.nnz * sizeof(double);
+    if ((size_t) st.st_size < need) {
+        if (!quiet)
+            fprintf(stderr, "Truncated matrix file: %s\n", fname);
+        close(fd);
+        return NULL;
+    }
+
+    base = (char*) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map matrix file: %s\n", fname);
+        return NULL;
+    }
+    A = (csr_t*) malloc(sizeof(csr_t));
+    A->n = (int) h.n;
+    A->ptr = (int*) (base + CSR_HEADER);
+    A->col = (int*) (base + CSR_HEADER + ptr_bytes);
+    A->pr = (double*) (base + CSR_HEADER + ptr_bytes + col_bytes);
+    A->map = base;
+    A->mapsize = st.st_size;
+    if (A->ptr[0] != 0 || A->ptr[A->n] != h.nnz || !csr_valid(A)) {
+        fprintf(stderr, "Bad matrix file: %s\n", fname);
+        csr_free(A);
+        return NULL;
+    }
+    return A;
+}
+
+
+csr_t* csr_map_bin(const char* fname)
+{
+    return map_bin(fname, 0, NULL, 0);
+}
+
+
+csr_t* csr_load(const char* fname)
+{
+    struct stat st;
+    char magic[8];
+    char* cache;
+    csr_t* A;
+    FILE* fp = fopen(fname, "rb");
+
+    if (fp == NULL || stat(fname, &st) < 0) {
+        fprintf(stderr, "Could not open matrix file: %s\n", fname);
+        if (fp)
+            fclose(fp);
+        return NULL;
+    }
+    if (fread(magic, 1, 8, fp) == 8 && memcmp(magic, CSR_MAGIC, 8) == 0) {
+        fclose(fp);
+        return csr_map_bin(fname);
+    }
+    fclose(fp);
+
+    cache = (char*) malloc(strlen(fname) + 5);
+    sprintf(cache, "%s.csr", fname);
+    A = map_bin(cache, st.st_size, &st.st_mtim, 1);
+    if (A == NULL) {
+        A = csr_read_mtx(fname);
+        if (A)
+            write_bin(A, cache, st.st_size, &st.st_mtim);
+    }
+    free(cache);
+    return A;
+}
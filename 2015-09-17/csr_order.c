@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <omp.h>
+#include "csr.h"
+
+#define SHORT_LIST 32
+#define PERIPHERAL_TRIES 8
+
+/*
+ * Bandwidth-reducing orderings.  Both work on the graph of A + A^T
+ * without the diagonal, so unsymmetric matrices are ordered by their
+ * symmetrized pattern.  A permutation maps new indices to old ones:
+ * row i of the reordered matrix is row perm[i] of the original.
+ */
+
+typedef struct graph_t {
+    int n;
+    int* ptr;
+    int* adj;
+} graph_t;
+
+
+static int compare_int(const void* a, const void* b)
+{
+    int x = *(const int*) a, y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+/* Pattern of A + A^T without the diagonal, each list sorted and unique */
+static void graph_build(graph_t* g, const csr_t* A)
+{
+    int n = A->n;
+    int* fill = (int*) calloc(n+1, sizeof(int));
+    int i, k, m;
+
+    g->n = n;
+    g->ptr = (int*) calloc(n+1, sizeof(int));
+    for (i = 0; i < n; ++i)
+        for (k = A->ptr[i]; k < A->ptr[i+1]; ++k)
+            if (A->col[k] != i) {
+                g->ptr[i+1]++;
+                g->ptr[A->col[k]+1]++;
+            }
+    for (i = 0; i < n; ++i)
+        g->ptr[i+1] += g->ptr[i];
+    g->adj = (int*) malloc((g->ptr[n] > 0 ? g->ptr[n] : 1) * sizeof(int));
+    for (i = 0; i < n; ++i)
+        for (k = A->ptr[i]; k < A->ptr[i+1]; ++k) {
+            int j = A->col[k];
+            if (j != i) {
+                g->adj[g->ptr[i] + fill[i]++] = j;
+                g->adj[g->ptr[j] + fill[j]++] = i;
+            }
+        }
+
+    #pragma omp parallel for private(k, m) schedule(dynamic, 256)
+    for (i = 0; i < n; ++i) {
+        int* a = g->adj + g->ptr[i];
+        int len = g->ptr[i+1] - g->ptr[i];
+        if (len <= SHORT_LIST) {
+            for (k = 1; k < len; ++k) {
+                int v = a[k];
+                for (m = k; m > 0 && a[m-1] > v; --m)
+                    a[m] = a[m-1];
+                a[m] = v;
+            }
+        } else {
+            qsort(a, len, sizeof(int), compare_int);
+        }
+        for (k = 0, m = 0; k < len; ++k)
+            if (m == 0 || a[m-1] != a[k])
+                a[m++] = a[k];
+        fill[i] = m;
+    }
+
+    /* Squeeze out the duplicates */
+    for (i = 0, m = 0; i < n; ++i) {
+        int start = g->ptr[i];
+        g->ptr[i] = m;
+        for (k = 0; k < fill[i]; ++k)
+            g->adj[m++] = g->adj[start+k];
+    }
+    g->ptr[n] = m;
+    free(fill);
+}
+
+
+static void graph_free(graph_t* g)
+{
+    free(g->adj);
+    free(g->ptr);
+}
+
+
+static int degree(const graph_t* g, int v)
+{
+    return g->ptr[v+1] - g->ptr[v];
+}
+
+
+/* Sort q[0..len) by increasing degree, ties by index */
+static void sort_by_degree(const graph_t* g, int* q, int len, uint64_t* keys)
+{
+    int k, m;
+    if (len <= SHORT_LIST) {
+        for (k = 1; k < len; ++k) {
+            int v = q[k], d = degree(g, v);
+            for (m = k; m > 0 && (degree(g, q[m-1]) > d ||
+                                  (degree(g, q[m-1]) == d && q[m-1] > v)); --m)
+                q[m] = q[m-1];
+            q[m] = v;
+        }
+        return;
+    }
+    for (k = 0; k < len; ++k)
+        keys[k] = (uint64_t) degree(g, q[k]) << 32 | (uint32_t) q[k];
+    qsort(keys, len, sizeof(uint64_t), compare_u64);
+    for (k = 0; k < len; ++k)
+        q[k] = (int) (uint32_t) keys[k];
+}
+
+
+/*
+ * Breadth-first search from root through the unvisited (level < 0)
+ * nodes labelled lab, appending them to queue at *tail.  With keys
+ * (scratch for the largest degree), the children of each node join in
+ * order of increasing degree, which is the Cuthill-McKee order.
+ * Returns the number of levels.
+ */
+static int bfs(const graph_t* g, const int* label, int lab, int root,
+               int* level, int* queue, int* tail, uint64_t* keys)
+{
+    int head = *tail;
+    level[root] = 0;
+    queue[(*tail)++] = root;
+    while (head < *tail) {
+        int v = queue[head++];
+        int first = *tail, k;
+        for (k = g->ptr[v]; k < g->ptr[v+1]; ++k) {
+            int w = g->adj[k];
+            if (label[w] == lab && level[w] < 0) {
+                level[w] = level[v] + 1;
+                queue[(*tail)++] = w;
+            }
+        }
+        if (keys)
+            sort_by_degree(g, queue + first, *tail - first, keys);
+    }
+    return level[queue[*tail-1]] + 1;
+}
+
+
+/*
+ * A pseudo-peripheral node of the component of root (George and Liu):
+ * move to a lowest-degree node of the last level while that deepens
+ * the level structure.  Leaves the levels of the component at -1.
+ */
+static int peripheral(const graph_t* g, const int* label, int lab, int root,
+                      int* level, int* queue)
+{
+    int depth = 0, tries, k;
+    for (tries = 0; tries < PERIPHERAL_TRIES; ++tries) {
+        int tail = 0, next = root;
+        int d = bfs(g, label, lab, root, level, queue, &tail, NULL);
+        for (k = tail-1; k >= 0 && level[queue[k]] == d-1; --k)
+            if (degree(g, queue[k]) < degree(g, next) || next == root)
+                next = queue[k];
+        for (k = 0; k < tail; ++k)
+            level[queue[k]] = -1;
+        if (d <= depth)
+            break;
+        depth = d;
+        root = next;
+    }
+    return root;
+}
+
+
+/*
+ * Level-structure order of the nodes in seg[0..len), all labelled lab,
+ * one component at a time from a pseudo-peripheral node; Cuthill-McKee
+ * if keys is given.  Written back into seg.
+ */
+static void order_segment(const graph_t* g, const int* label, int lab,
+                          int* seg, int len, int* level, int* queue,
+                          uint64_t* keys)
+{
+    int tail = 0, k;
+    for (k = 0; k < len; ++k)
+        level[seg[k]] = -1;
+    for (k = 0; k < len; ++k)
+        if (level[seg[k]] < 0) {
+            int start = tail;
+            int root = peripheral(g, label, lab, seg[k], level, queue + start);
+            bfs(g, label, lab, root, level, queue, &tail, keys);
+        }
+    for (k = 0; k < len; ++k)
+        seg[k] = queue[k];
+}
+
+
+static void reverse(int* p, int len)
+{
+    int k;
+    for (k = 0; k < len/2; ++k) {
+        int t = p[k];
+        p[k] = p[len-1-k];
+        p[len-1-k] = t;
+    }
+}
+
+
+static uint64_t* degree_scratch(const graph_t* g)
+{
+    int i, dmax = 1;
+    for (i = 0; i < g->n; ++i)
+        if (degree(g, i) > dmax)
+            dmax = degree(g, i);
+    return (uint64_t*) malloc(dmax * sizeof(uint64_t));
+}
+
+
+int* csr_rcm(const csr_t* A)
+{
+    graph_t g;
+    int n = A->n, i;
+    int* perm = (int*) malloc(n * sizeof(int));
+    int* label = (int*) calloc(n, sizeof(int));
+    int* level = (int*) malloc(n * sizeof(int));
+    int* queue = (int*) malloc(n * sizeof(int));
+    uint64_t* keys;
+
+    graph_build(&g, A);
+    keys = degree_scratch(&g);
+    for (i = 0; i < n; ++i)
+        perm[i] = i;
+    order_segment(&g, label, 0, perm, n, level, queue, keys);
+    reverse(perm, n);
+
+    free(keys);
+    free(queue);
+    free(level);
+    free(label);
+    graph_free(&g);
+    return perm;
+}
+
+
+/*
+ * Split the nodes of seg (all labelled first) into nparts parts by
+ * recursive bisection of a level structure: the first share of the
+ * breadth-first order keeps the label, the rest takes first + half.
+ * Each part ends up contiguous in seg.
+ */
+static void bisect(const graph_t* g, int* label, int first, int nparts,
+                   int* seg, int len, int* level, int* queue)
+{
+    int half = nparts / 2, cut, k;
+    if (nparts <= 1 || len <= 1)
+        return;
+    order_segment(g, label, first, seg, len, level, queue, NULL);
+    cut = (int) ((long) len * half / nparts);
+    for (k = cut; k < len; ++k)
+        label[seg[k]] = first + half;
+    bisect(g, label, first, half, seg, cut, level, queue);
+    bisect(g, label, first + half, nparts - half, seg + cut, len - cut,
+           level, queue);
+}
+
+
+int* csr_partition_order(const csr_t* A, int nparts)
+{
+    graph_t g;
+    int n = A->n, i, p, start;
+    int* perm = (int*) malloc(n * sizeof(int));
+    int* label = (int*) calloc(n, sizeof(int));
+    int* level = (int*) malloc(n * sizeof(int));
+    int* queue = (int*) malloc(n * sizeof(int));
+    uint64_t* keys;
+
+    graph_build(&g, A);
+    keys = degree_scratch(&g);
+    for (i = 0; i < n; ++i)
+        perm[i] = i;
+    bisect(&g, label, 0, nparts, perm, n, level, queue);
+
+    /* Reverse Cuthill-McKee within each part */
+    for (start = 0; start < n; ) {
+        int len = 1;
+        p = label[perm[start]];
+        while (start+len < n && label[perm[start+len]] == p)
+            ++len;
+        order_segment(&g, label, p, perm + start, len, level, queue, keys);
+        reverse(perm + start, len);
+        start += len;
+    }
+
+    free(keys);
+    free(queue);
+    free(level);
+    free(label);
+    graph_free(&g);
+    return perm;
+}
+
+
+int* perm_inverse(const int* perm, int n)
+{
+    int* inv = (int*) malloc(n * sizeof(int));
+    int i;
+    for (i = 0; i < n; ++i)
+        inv[perm[i]] = i;
+    return inv;
+}
+
+
+csr_t* csr_permute(const csr_t* A, const int* perm)
+{
+    int n = A->n, i;
+    int* inv = perm_inverse(perm, n);
+    csr_t* B = csr_alloc(n, A->ptr[n]);
+
+    for (i = 0; i < n; ++i)
+        B->ptr[i+1] = B->ptr[i] + A->ptr[perm[i]+1] - A->ptr[perm[i]];
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (i = 0; i < n; ++i) {
+        int k, m = B->ptr[i];
+        for (k = A->ptr[perm[i]]; k < A->ptr[perm[i]+1]; ++k, ++m) {
+            B->col[m] = inv[A->col[k]];
+            B->pr[m] = A->pr[k];
+        }
+        csr_sort_row(B, i);
+    }
+    free(inv);
+    return B;
+}
+
+
+void permute_vector(const int* perm, int n, const double* x, double* xp)
+{
+    int i;
+    #pragma omp parallel for
+    for (i = 0; i < n; ++i)
+        xp[i] = x[perm[i]];
+}
+
+
+void unpermute_vector(const int* perm, int n, const double* xp, double* x)
+{
+    int i;
+    #pragma omp parallel for
+    for (i = 0; i < n; ++i)
+        x[perm[i]] = xp[i];
+}
+
+
+void csr_profile(const csr_t* A, int* bandwidth, long* profile)
+{
+    int bw = 0, i;
+    long env = 0;
+    for (i = 0; i < A->n; ++i) {
+        int k, jmin = i;
+        for (k = A->ptr[i]; k < A->ptr[i+1]; ++k) {
+            int d = abs(A->col[k] - i);
+            if (d > bw)
+                bw = d;
+            if (A->col[k] < jmin)
+                jmin = A->col[k];
+        }
+        env += i - jmin;
+    }
+    *bandwidth = bw;
+    *profile = env;
+}
@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <omp.h>
+#include "stencil.h"
+#include "bench.h"
 
 
 double u(double x, double y)
@@ -11,15 +15,146 @@ double u(double x, double y)
 double laplacian_u(double (*u)(double x, double y),
                    double h, double x, double y)
 {
-    /* Fill in the solution here */
+    return (u(x-h, y) + u(x+h, y) + u(x, y-h) + u(x, y+h) -
+            4 * u(x, y)) / (h*h);
 }
 
 
-int main()
+/* The Laplacian of u, for checking */
+double true_laplacian(double x, double y)
 {
+    return -2 * cos(x) * sin(y);
+}
+
+
+/*
+ * The old way over a whole grid: one laplacian_u call per point, so
+ * five calls through the pointer and five cosines and sines each
+ */
+typedef struct pointwise_args_t {
+    grid_t* out;
+    double x0, y0;
+} pointwise_args_t;
+
+static void run_pointwise(void* arg)
+{
+    pointwise_args_t* a = (pointwise_args_t*) arg;
+    grid_t* g = a->out;
+    int i, j;
+    #pragma omp parallel for private(i)
+    for (j = 0; j < g->ny; ++j)
+        for (i = 0; i < g->nx; ++i)
+            GRID(g, i, j) = laplacian_u(u, g->h, a->x0 + i * g->h,
+                                        a->y0 + j * g->h);
+}
+
+
+typedef struct stencil_args_t {
+    void (*apply)(grid_t* in, grid_t* out, stencil_bc_t bc);
+    grid_t* in;
+    grid_t* out;
+    stencil_bc_t bc;
+} stencil_args_t;
+
+static void run_stencil(void* arg)
+{
+    stencil_args_t* a = (stencil_args_t*) arg;
+    a->apply(a->in, a->out, a->bc);
+}
+
+
+/* Largest difference from the true Laplacian */
+static double max_error(const grid_t* g, double x0, double y0)
+{
+    double err = 0;
+    int i, j;
+    for (j = 0; j < g->ny; ++j)
+        for (i = 0; i < g->nx; ++i)
+            err = fmax(err, fabs(GRID(g, i, j) -
+                                 true_laplacian(x0 + i * g->h,
+                                                y0 + j * g->h)));
+    return err;
+}
+
+
+static void report(const char* name, const bench_result_t* r,
+                   const grid_t* g, double x0, double y0)
+{
+    printf("  %-20s %8.1f Mpoints/s, error %.2e\n", name,
+           (double) g->nx * g->ny / r->tmedian / 1e6,
+           max_error(g, x0, y0));
+}
+
+
+/*
+ * Usage: laplace2d [harness options] [n]
+ *
+ * After the single point, takes the discrete Laplacian of u on an
+ * n-by-n grid (default 2048) over one period, [0, 2 pi)^2, by calling
+ * laplacian_u at each point and with the 5- and 9-point grid stencils
+ * under periodic and Dirichlet boundary conditions, and reports grid
+ * points per second.  The stencils read a grid filled once.
+ */
+int main(int argc, char** argv)
+{
+    static const struct {
+        const char* name;
+        void (*apply)(grid_t* in, grid_t* out, stencil_bc_t bc);
+        stencil_bc_t bc;
+        double flops;
+    } kernels[] = {
+        {"5-point periodic",  laplacian5, BC_PERIODIC,  7},
+        {"5-point Dirichlet", laplacian5, BC_DIRICHLET, 7},
+        {"9-point periodic",  laplacian9, BC_PERIODIC, 12},
+        {"9-point Dirichlet", laplacian9, BC_DIRICHLET, 12}
+    };
+    const double pi = 4 * atan(1.0);
+    bench_t b;
+    grid_t *in, *out;
+    pointwise_args_t pargs;
+    const bench_result_t* r;
+    double h, points;
+    int n = 2048, k;
+
+    bench_init(&b, &argc, argv);
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (n < 4) {
+        fprintf(stderr, "Usage: %s [harness options] [n]\n", argv[0]);
+        return -1;
+    }
+
     printf("Numerical Laplacian at (0.8,0.5) = %g\n",
            laplacian_u(u, 1e-3, 0.8, 0.5));
-    printf("True Laplacian at (0.8,0.5) = %g\n",
-           2 * cos(0.8) * sin(0.5));
+    printf("True Laplacian at (0.8,0.5) = %g\n", true_laplacian(0.8, 0.5));
+
+    h = 2 * pi / n;
+    points = (double) n * n;
+    in = grid_alloc(n, n, h);
+    out = grid_alloc(n, n, h);
+    grid_fill(in, u, 0, 0);
+    printf("Grid %d x %d, h = %.3g, threads: %d\n", n, n, h,
+           omp_get_max_threads());
+
+    pargs.out = out;
+    pargs.x0 = pargs.y0 = 0;
+    r = bench_run(&b, "pointwise laplacian_u", run_pointwise, &pargs,
+                  points * 7, points * sizeof(double));
+    report("pointwise", r, out, 0, 0);
+
+    for (k = 0; k < 4; ++k) {
+        stencil_args_t args = {kernels[k].apply, in, out, kernels[k].bc};
+        /* Dirichlet ghosts hold the true values of u; the periodic
+           ones are overwritten with copies that agree with them */
+        grid_fill(in, u, 0, 0);
+        r = bench_run(&b, kernels[k].name, run_stencil, &args,
+                      points * kernels[k].flops,
+                      2 * points * sizeof(double));
+        report(kernels[k].name, r, out, 0, 0);
+    }
+
+    grid_free(out);
+    grid_free(in);
+    bench_finish(&b);
     return 0;
 }
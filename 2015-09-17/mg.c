@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "mg.h"
+
+#define MG_COARSE_SWEEPS 20  /* Enough to solve the 3x3 coarsest grid */
+#define MG_ALIGN 64
+#define MG_JACOBI_CHECK 50
+
+
+mg_t* mg_create(int n, int nu1, int nu2)
+{
+    mg_t* mg;
+    size_t total = 0, offset = 0;
+    void* mem;
+    int l, m;
+
+    for (m = n; m > 3 && (m & 1); m = (m-1) / 2)
+        ;
+    if (n < 3 || m != 3)
+        return NULL;
+
+    mg = (mg_t*) calloc(1, sizeof(mg_t));
+    mg->nu1 = nu1;
+    mg->nu2 = nu2;
+    for (l = 0, m = n; l < MG_MAXLEVELS; ++l, m = (m-1) / 2) {
+        total += 3 * grid_size(m, m);
+        mg->levels = l+1;
+        if (m == 3)
+            break;
+    }
+    if (posix_memalign(&mem, MG_ALIGN, total * sizeof(double)) != 0) {
+        free(mg);
+        return NULL;
+    }
+    memset(mem, 0, total * sizeof(double));
+    mg->arena = (double*) mem;
+    mg->arena_size = total;
+
+    for (l = 0, m = n; l < mg->levels; ++l, m = (m-1) / 2) {
+        double h = 1.0 / (m+1);
+        grid_place(&mg->u[l], m, m, h, mg->arena + offset);
+        offset += grid_size(m, m);
+        grid_place(&mg->f[l], m, m, h, mg->arena + offset);
+        offset += grid_size(m, m);
+        grid_place(&mg->r[l], m, m, h, mg->arena + offset);
+        offset += grid_size(m, m);
+    }
+    return mg;
+}
+
+
+void mg_free(mg_t* mg)
+{
+    if (mg == NULL)
+        return;
+    free(mg->arena);
+    free(mg);
+}
+
+
+grid_t* mg_solution(mg_t* mg)
+{
+    return &mg->u[0];
+}
+
+
+grid_t* mg_rhs(mg_t* mg)
+{
+    return &mg->f[0];
+}
+
+
+/* Zero a grid's points, leaving the (zero) ghosts alone */
+static void grid_zero(grid_t* g)
+{
+    int j;
+    #pragma omp parallel for
+    for (j = 0; j < g->ny; ++j)
+        memset(&GRID(g, 0, j), 0, g->nx * sizeof(double));
+}
+
+
+static double grid_norm(const grid_t* g)
+{
+    double s = 0;
+    int i, j;
+    #pragma omp parallel for private(i) reduction(+:s)
+    for (j = 0; j < g->ny; ++j)
+        for (i = 0; i < g->nx; ++i)
+            s += GRID(g, i, j) * GRID(g, i, j);
+    return sqrt(s);
+}
+
+
+/*
+ * Red-black Gauss-Seidel: points with i+j even, then odd, each set
+ * to the value that satisfies its own equation
+ */
+static void smooth(grid_t* u, const grid_t* f, int sweeps)
+{
+    const double h2 = u->h * u->h;
+    int s, color, i, j;
+    for (s = 0; s < sweeps; ++s)
+        for (color = 0; color < 2; ++color) {
+            #pragma omp parallel for private(i)
+            for (j = 0; j < u->ny; ++j) {
+                double* restrict m = &GRID(u, 0, j);
+                const double* restrict sb = &GRID(u, 0, j-1);
+                const double* restrict nb = &GRID(u, 0, j+1);
+                const double* restrict fj = &GRID(f, 0, j);
+                for (i = (j + color) & 1; i < u->nx; i += 2)
+                    m[i] = 0.25 * (h2 * fj[i] + m[i-1] + m[i+1] +
+                                   sb[i] + nb[i]);
+            }
+        }
+}
+
+
+/* r = f + lap u, with the 5-point stencil */
+static void residual(grid_t* u, const grid_t* f, grid_t* r)
+{
+    int i, j;
+    laplacian5(u, r, BC_DIRICHLET);
+    #pragma omp parallel for private(i)
+    for (j = 0; j < r->ny; ++j) {
+        double* restrict rj = &GRID(r, 0, j);
+        const double* restrict fj = &GRID(f, 0, j);
+        #pragma omp simd
+        for (i = 0; i < r->nx; ++i)
+            rj[i] += fj[i];
+    }
+}
+
+
+/* Coarse point (I,J) is fine point (2I+1, 2J+1); weights 1/16 [1 2 1;
+   2 4 2; 1 2 1] */
+static void restrict_full(const grid_t* fine, grid_t* coarse)
+{
+    int I, J;
+    #pragma omp parallel for private(I)
+    for (J = 0; J < coarse->ny; ++J) {
+        const double* s = &GRID(fine, 0, 2*J);
+        const double* m = &GRID(fine, 0, 2*J+1);
+        const double* n = &GRID(fine, 0, 2*J+2);
+        double* c = &GRID(coarse, 0, J);
+        for (I = 0; I < coarse->nx; ++I) {
+            int i = 2*I+1;
+            c[I] = (4 * m[i] +
+                    2 * (m[i-1] + m[i+1] + s[i] + n[i]) +
+                    s[i-1] + s[i+1] + n[i-1] + n[i+1]) / 16;
+        }
+    }
+}
+
+
+/* fine += bilinear interpolation of coarse (whose ghosts are zero) */
+static void prolong_add(const grid_t* coarse, grid_t* fine)
+{
+    int i, j;
+    #pragma omp parallel for private(i)
+    for (j = 0; j < fine->ny; ++j) {
+        /* Fine row j lies on coarse row (j-1)/2 if j is odd, else
+           halfway between rows j/2-1 and j/2 */
+        const double* a = &GRID(coarse, 0, (j & 1) ? (j-1)/2 : j/2 - 1);
+        const double* b = &GRID(coarse, 0, (j & 1) ? (j-1)/2 : j/2);
+        double* u = &GRID(fine, 0, j);
+        for (i = 0; i < fine->nx; ++i) {
+            int I = (i & 1) ? (i-1)/2 : i/2 - 1;
+            int I2 = (i & 1) ? I : I+1;
+            u[i] += 0.25 * (a[I] + a[I2] + b[I] + b[I2]);
+        }
+    }
+}
+
+
+static void cycle(mg_t* mg, int l, mg_cycle_t type)
+{
+    if (l == mg->levels-1) {
+        smooth(&mg->u[l], &mg->f[l], MG_COARSE_SWEEPS);
+        return;
+    }
+    smooth(&mg->u[l], &mg->f[l], mg->nu1);
+    residual(&mg->u[l], &mg->f[l], &mg->r[l]);
+    restrict_full(&mg->r[l], &mg->f[l+1]);
+    grid_zero(&mg->u[l+1]);
+    cycle(mg, l+1, type);
+    if (type == MG_F)
+        cycle(mg, l+1, MG_V);
+    prolong_add(&mg->u[l+1], &mg->u[l]);
+    smooth(&mg->u[l], &mg->f[l], mg->nu2);
+}
+
+
+double mg_residual(mg_t* mg)
+{
+    double fnorm = grid_norm(&mg->f[0]);
+    residual(&mg->u[0], &mg->f[0], &mg->r[0]);
+    return grid_norm(&mg->r[0]) / (fnorm > 0 ? fnorm : 1);
+}
+
+
+double mg_cycle(mg_t* mg, mg_cycle_t type)
+{
+    cycle(mg, 0, type);
+    return mg_residual(mg);
+}
+
+
+int mg_solve(mg_t* mg, mg_cycle_t type, double rtol, int maxcycles,
+             double* hist)
+{
+    double res = mg_residual(mg);
+    int k;
+    if (hist)
+        hist[0] = res;
+    for (k = 0; k < maxcycles && res > rtol; ++k) {
+        res = mg_cycle(mg, type);
+        if (hist)
+            hist[k+1] = res;
+    }
+    return k;
+}
+
+
+/*
+ * Each sweep is lap u with the stencil engine, then u += w (f + lap u);
+ * the residual norm is only taken every MG_JACOBI_CHECK sweeps
+ */
+int mg_jacobi(mg_t* mg, double omega, double rtol, int maxit,
+              double tlimit, double* relres)
+{
+    grid_t* u = &mg->u[0];
+    grid_t* f = &mg->f[0];
+    grid_t* lap = &mg->r[0];
+    const double w = omega * u->h * u->h / 4;
+    double fnorm = grid_norm(f), t0 = omp_get_wtime();
+    double res = mg_residual(mg);
+    int k, i, j;
+    if (fnorm == 0)
+        fnorm = 1;
+    for (k = 0; k < maxit && res > rtol; ) {
+        double s = 0;
+        laplacian5(u, lap, BC_DIRICHLET);
+        #pragma omp parallel for private(i) reduction(+:s)
+        for (j = 0; j < u->ny; ++j) {
+            double* restrict uj = &GRID(u, 0, j);
+            const double* restrict lj = &GRID(lap, 0, j);
+            const double* restrict fj = &GRID(f, 0, j);
+            #pragma omp simd reduction(+:s)
+            for (i = 0; i < u->nx; ++i) {
+                double r = fj[i] + lj[i];
+                uj[i] += w * r;
+                s += r * r;
+            }
+        }
+        ++k;
+        if (k % MG_JACOBI_CHECK == 0) {
+            /* s is the residual before this sweep */
+            res = sqrt(s) / fnorm;
+            if (omp_get_wtime() - t0 > tlimit)
+                break;
+        }
+    }
+    *relres = mg_residual(mg);
+    return k;
+}
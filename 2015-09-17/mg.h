@@ -0,0 +1,65 @@
+#ifndef MG_H
+#define MG_H
+
+#include "stencil.h"
+
+/*
+ * Geometric multigrid for the Poisson problem -lap u = f on the unit
+ * square with u = 0 on the boundary, discretized with the 5-point
+ * Laplacian on n-by-n interior points, h = 1/(n+1).  n must be 2^k - 1,
+ * so that each coarser grid, with (n-1)/2 points a side and twice the
+ * spacing, shares every other point of the finer one; coarsening stops
+ * at 3 points.
+ *
+ * Smoothing is red-black Gauss-Seidel, restriction full weighting,
+ * and prolongation bilinear.  All levels' solution, right-hand side
+ * and residual grids live in one block allocated by mg_create, so a
+ * cycle allocates nothing.
+ */
+
+typedef enum mg_cycle_t { MG_V, MG_F } mg_cycle_t;
+
+#define MG_MAXLEVELS 30
+
+typedef struct mg_t {
+    int levels;
+    int nu1, nu2;               /* Pre- and post-smoothing sweeps */
+    grid_t u[MG_MAXLEVELS];     /* Solution (level 0) or correction */
+    grid_t f[MG_MAXLEVELS];     /* Right-hand side */
+    grid_t r[MG_MAXLEVELS];     /* Residual */
+    double* arena;
+    size_t arena_size;          /* In doubles */
+} mg_t;
+
+/* NULL unless n = 2^k - 1 >= 3; u and f start at zero */
+mg_t* mg_create(int n, int nu1, int nu2);
+void mg_free(mg_t* mg);
+
+/* The finest grid's solution and right-hand side, to fill in */
+grid_t* mg_solution(mg_t* mg);
+grid_t* mg_rhs(mg_t* mg);
+
+/* ||f + lap u|| / ||f|| on the finest grid (residual left in r[0]) */
+double mg_residual(mg_t* mg);
+
+/* One cycle on the finest grid; returns the new relative residual */
+double mg_cycle(mg_t* mg, mg_cycle_t type);
+
+/*
+ * Cycle until the relative residual is at most rtol or after maxcycles,
+ * keeping the residual after each cycle in hist[0..maxcycles] if it is
+ * not NULL (hist[0] is the start).  Returns the number of cycles.
+ */
+int mg_solve(mg_t* mg, mg_cycle_t type, double rtol, int maxcycles,
+             double* hist);
+
+/*
+ * Weighted Jacobi on the finest grid, for comparison: at most maxit
+ * sweeps, until the relative residual is at most rtol or tlimit
+ * seconds have passed.  Returns the sweeps done; *relres is the final
+ * relative residual.
+ */
+int mg_jacobi(mg_t* mg, double omega, double rtol, int maxit,
+              double tlimit, double* relres);
+
+#endif /* MG_H */
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#include "mg.h"
+
+#define MAXCYCLES 50
+
+
+/*
+ * A random right-hand side, the same for every run of a given size.
+ * It has every mode in it, so the convergence rate is the solver's
+ * worst case rather than that of one smooth eigenmode.
+ */
+static void random_rhs(grid_t* f)
+{
+    uint64_t state = 12345u + (uint64_t) f->nx;
+    int i, j;
+    for (j = -1; j <= f->ny; ++j)
+        for (i = -1; i <= f->nx; ++i) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            GRID(f, i, j) = (i < 0 || j < 0 || i == f->nx || j == f->ny) ?
+                0 : (double) (state >> 11) / (1ull << 53) - 0.5;
+        }
+}
+
+
+static void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [-c cycle] [-s sweeps] [-t rtol] [-j seconds]"
+            " [-v] [n ...]\n"
+            "  cycle: V, F, or both\n"
+            "  n: grid sizes, each 2^k - 1\n", name);
+    exit(-1);
+}
+
+
+/*
+ * Options:
+ *   -c cycle = V, F, or both (default both)
+ *   -s sweeps = smoothing sweeps before and after the coarse
+ *               correction (default 2)
+ *   -t rtol = relative residual to reach (default 1e-10)
+ *   -j seconds = time limit for each Jacobi run (default 2; 0 skips)
+ *   -v = print the residual after every cycle
+ *   n ... = grid sizes (default 127 255 511 1023 2047)
+ *
+ * For each size, solves with multigrid for a random right-hand side
+ * (random_rhs) and reports the cycles, the mean residual reduction per
+ * cycle, the time to solution and the time per grid point, which
+ * should stay flat as n grows.  Then runs weighted Jacobi (omega 4/5)
+ * from zero for at most the time limit and estimates from its rate
+ * how long it would need.
+ */
+int main(int argc, char** argv)
+{
+    static const int default_sizes[] = {127, 255, 511, 1023, 2047};
+    const char* cycles = "both";
+    int sizes[32], nsizes = 0, sweeps = 2, verbose = 0, i, k;
+    double rtol = 1e-10, jlimit = 2;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'c': cycles = argv[++i]; break;
+            case 's': sweeps = atoi(argv[++i]); break;
+            case 't': rtol = atof(argv[++i]); break;
+            case 'j': jlimit = atof(argv[++i]); break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else if (*argv[i] != '-' && nsizes < 32) {
+            sizes[nsizes++] = atoi(argv[i]);
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    if (nsizes == 0) {
+        nsizes = 5;
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+
+    printf("Threads: %d, rtol %.1e, %d+%d sweeps\n", omp_get_max_threads(),
+           rtol, sweeps, sweeps);
+    for (k = 0; k < nsizes; ++k) {
+        int n = sizes[k], type;
+        double points = (double) n * n;
+        mg_t* mg = mg_create(n, sweeps, sweeps);
+        if (mg == NULL)
+            print_usage_quit(argv[0]);
+        random_rhs(mg_rhs(mg));
+        printf("n = %d (%d levels, %.1f MB arena)\n", n, mg->levels,
+               mg->arena_size * sizeof(double) / 1e6);
+
+        for (type = MG_V; type <= MG_F; ++type) {
+            const char* name = (type == MG_V) ? "V" : "F";
+            double hist[MAXCYCLES+1], t0, t;
+            int ncycles, c;
+            if (strcmp(cycles, "both") != 0 && strcmp(cycles, name) != 0)
+                continue;
+            memset(mg_solution(mg)->mem, 0, grid_size(n, n) * sizeof(double));
+            t0 = omp_get_wtime();
+            ncycles = mg_solve(mg, (mg_cycle_t) type, rtol, MAXCYCLES, hist);
+            t = omp_get_wtime() - t0;
+            printf("  %s-cycle: %2d cycles, %.2e per cycle, %.3f s"
+                   " (%.1f ns/point), relative residual %.2e\n", name,
+                   ncycles, pow(hist[ncycles] / hist[0], 1.0 / ncycles), t,
+                   1e9 * t / points, hist[ncycles] / hist[0]);
+            if (verbose)
+                for (c = 1; c <= ncycles; ++c)
+                    printf("    cycle %2d: residual %.3e (x %.2e)\n", c,
+                           hist[c], hist[c] / hist[c-1]);
+        }
+
+        if (jlimit > 0) {
+            double t0, t, res, rate;
+            int its;
+            memset(mg_solution(mg)->mem, 0, grid_size(n, n) * sizeof(double));
+            t0 = omp_get_wtime();
+            its = mg_jacobi(mg, 0.8, rtol, 1 << 30, jlimit, &res);
+            t = omp_get_wtime() - t0;
+            rate = pow(res, 1.0 / its);
+            printf("  Jacobi:  %d sweeps in %.3f s to residual %.2e",
+                   its, t, res);
+            if (res > rtol)
+                printf("; at %.6f per sweep, needs ~%.3g sweeps (~%.3g s)",
+                       rate, log(rtol) / log(rate),
+                       t / its * log(rtol) / log(rate));
+            printf("\n");
+        }
+        mg_free(mg);
+    }
+    return 0;
+}
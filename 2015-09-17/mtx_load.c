@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "csr.h"
+
+
+/*
+ * The straightforward reader, for comparison: fscanf the entries into
+ * coordinate arrays, then count and scatter them into CSR.  Handles
+ * general real matrices only.
+ */
+csr_t* naive_read_mtx(const char* fname)
+{
+    char line[256];
+    int m, n, nnz, k, i;
+    int* ii;
+    int* jj;
+    double* vv;
+    int* next;
+    csr_t* A;
+    FILE* fp = fopen(fname, "r");
+    if (fp == NULL)
+        return NULL;
+    do {
+        if (fgets(line, sizeof(line), fp) == NULL) {
+            fclose(fp);
+            return NULL;
+        }
+    } while (line[0] == '%');
+    if (sscanf(line, "%d %d %d", &m, &n, &nnz) != 3 || m != n) {
+        fclose(fp);
+        return NULL;
+    }
+
+    ii = (int*) malloc(nnz * sizeof(int));
+    jj = (int*) malloc(nnz * sizeof(int));
+    vv = (double*) malloc(nnz * sizeof(double));
+    for (k = 0; k < nnz; ++k)
+        if (fscanf(fp, "%d %d %lf", ii+k, jj+k, vv+k) != 3)
+            break;
+    fclose(fp);
+
+    A = csr_alloc(n, nnz);
+    next = (int*) calloc(n+1, sizeof(int));
+    for (k = 0; k < nnz; ++k)
+        next[ii[k]]++;
+    for (i = 0; i < n; ++i) {
+        A->ptr[i+1] = A->ptr[i] + next[i+1];
+        next[i+1] = A->ptr[i];
+    }
+    for (k = 0; k < nnz; ++k) {
+        int slot = next[ii[k]]++;
+        A->col[slot] = jj[k]-1;
+        A->pr[slot] = vv[k];
+    }
+    free(next);
+    free(vv);
+    free(jj);
+    free(ii);
+    return A;
+}
+
+
+/* Same matrix, entry for entry? */
+int csr_equal(const csr_t* A, const csr_t* B)
+{
+    int nnz = A->ptr[A->n];
+    return A->n == B->n &&
+        memcmp(A->ptr, B->ptr, (A->n+1) * sizeof(int)) == 0 &&
+        memcmp(A->col, B->col, nnz * sizeof(int)) == 0 &&
+        memcmp(A->pr, B->pr, nnz * sizeof(double)) == 0;
+}
+
+
+/* Touch every page, so that lazily mapped files are counted */
+double csr_touch(const csr_t* A)
+{
+    double s = 0;
+    int i;
+    for (i = 0; i < A->ptr[A->n]; i += 512)
+        s += A->pr[i] + A->col[i];
+    for (i = 0; i < A->n; i += 1024)
+        s += A->ptr[i];
+    return s;
+}
+
+
+void print_usage_quit(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-w matrix -n rows] file.mtx\n", name);
+    exit(-1);
+}
+
+
+/*
+ * Options:
+ *   -w matrix = first write the named test matrix (see csr_generate)
+ *   -n rows = rows in the test matrix (default 1M)
+ *
+ * Times the naive reader, the parallel reader, and csr_load twice: the
+ * first time it parses and writes the binary cache, the second it maps
+ * the cache.
+ */
+int main(int argc, char** argv)
+{
+    const char* kind = NULL;
+    const char* fname = NULL;
+    int n = 1 << 20;
+    char cache[4096];
+    csr_t *A0, *A1, *A2, *A3;
+    double t0, t1, t2, t3, t4;
+    struct stat st;
+    int i;
+
+    for (i = 1; i < argc; ++i) {
+        if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'w': kind = argv[++i]; break;
+            case 'n': n = atoi(argv[++i]); break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else if (fname == NULL) {
+            fname = argv[i];
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    if (fname == NULL)
+        print_usage_quit(argv[0]);
+
+    if (kind) {
+        csr_t* A = csr_generate(kind, n);
+        if (A == NULL || csr_write_mtx(A, fname) < 0)
+            print_usage_quit(argv[0]);
+        csr_free(A);
+    }
+    snprintf(cache, sizeof(cache), "%s.csr", fname);
+    unlink(cache);
+    if (stat(fname, &st) < 0)
+        print_usage_quit(argv[0]);
+    printf("Threads: %d, file %.1f MB\n", omp_get_max_threads(),
+           st.st_size / 1e6);
+
+    t0 = omp_get_wtime();
+    A0 = naive_read_mtx(fname);
+    t1 = omp_get_wtime();
+    A1 = csr_read_mtx(fname);
+    t2 = omp_get_wtime();
+    A2 = csr_load(fname);
+    t3 = omp_get_wtime();
+    A3 = csr_load(fname);
+    csr_touch(A3);
+    t4 = omp_get_wtime();
+    if (A1 == NULL || A2 == NULL || A3 == NULL)
+        return -1;
+
+    printf("Naive fscanf:  %.3f s (%.0f MB/s)\n", t1-t0,
+           st.st_size / (t1-t0) / 1e6);
+    printf("Parallel mmap: %.3f s (%.0f MB/s)\n", t2-t1,
+           st.st_size / (t2-t1) / 1e6);
+    printf("Load + cache:  %.3f s\n", t3-t2);
+    printf("Cached load:   %.3f s (%.0fx the naive reader)\n", t4-t3,
+           (t1-t0) / (t4-t3));
+    printf("n=%d nnz=%d; readers agree: %s\n", A1->n, A1->ptr[A1->n],
+           (A0 == NULL || csr_equal(A0, A1)) &&
+           csr_equal(A1, A2) && csr_equal(A1, A3) ? "yes" : "NO");
+
+    csr_free(A3);
+    csr_free(A2);
+    csr_free(A1);
+    csr_free(A0);
+    return 0;
+}
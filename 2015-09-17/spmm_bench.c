@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "csr.h"
+#include "bench.h"
+
+
+typedef struct spmm_args_t {
+    csr_t* A;
+    int nv, layout;
+    double* X;
+    double* Y;
+    double* work;
+} spmm_args_t;
+
+
+/* nv separate products, the way the solver did it before */
+static void run_loop(void* arg)
+{
+    spmm_args_t* a = (spmm_args_t*) arg;
+    int n = a->A->n, v;
+    for (v = 0; v < a->nv; ++v)
+        sparse_multiply(a->A, a->X + (long) v*n, a->Y + (long) v*n);
+}
+
+
+static void run_block(void* arg)
+{
+    spmm_args_t* a = (spmm_args_t*) arg;
+    int n = a->A->n;
+    int ld = (a->layout == BLOCK_ROW_MAJOR) ? a->nv : n;
+    sparse_multiply_block(a->A, a->nv, a->layout, a->X, ld, a->Y, ld,
+                          a->work);
+}
+
+
+/* Bytes of one pass over the matrix, and of one vector in and out */
+static double matrix_bytes(const csr_t* A)
+{
+    return A->ptr[A->n] * (sizeof(double) + sizeof(int)) +
+        (A->n + 1.0) * sizeof(int);
+}
+
+static double vector_bytes(const csr_t* A)
+{
+    return 2.0 * A->n * sizeof(double);
+}
+
+
+static void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [harness options] [-m matrix] [-n rows] [-v widths]\n"
+            "  matrix: banded, laplace, random, powerlaw, blocks,\n"
+            "          or a Matrix Market (.mtx) or binary CSR file\n"
+            "  widths: comma-separated block widths (default 1,4,8,16,32)\n",
+            name);
+    exit(-1);
+}
+
+
+/*
+ * Options (besides the harness options in bench.h):
+ *   -m matrix = test matrix or matrix file (default laplace)
+ *   -n rows = rows in the test matrix (default 1M)
+ *   -v widths = block widths to time
+ *
+ * For each width, times nv calls of sparse_multiply against one
+ * sparse_multiply_block in each layout, and checks that every column
+ * agrees bit for bit.  GB/s counts the bytes actually needed: the
+ * matrix once per block and each vector in and out.  The last column
+ * is the time per vector relative to a single sparse_multiply.
+ */
+int main(int argc, char** argv)
+{
+    bench_t b;
+    const char* kind = "laplace";
+    char widths[256] = "1,4,8,16,32";
+    int n = 1 << 20;
+    double t1 = 0;
+    csr_t* A;
+    char* w;
+    int i;
+
+    bench_init(&b, &argc, argv);
+    for (i = 1; i < argc; ++i) {
+        if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'm': kind = argv[++i]; break;
+            case 'n': n = atoi(argv[++i]); break;
+            case 'v':
+                snprintf(widths, sizeof(widths), "%s", argv[++i]);
+                break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    A = csr_generate(kind, n);
+    if (A == NULL)
+        A = csr_load(kind);
+    if (A == NULL)
+        print_usage_quit(argv[0]);
+    n = A->n;
+
+    printf("Threads: %d, %s: n=%d nnz=%d\n", omp_get_max_threads(), kind,
+           n, A->ptr[n]);
+    for (w = strtok(widths, ","); w; w = strtok(NULL, ",")) {
+        int nv = atoi(w), layout, v, j;
+        double* X = (double*) malloc((long) n * nv * sizeof(double));
+        double* Y0 = (double*) malloc((long) n * nv * sizeof(double));
+        double* Y = (double*) malloc((long) n * nv * sizeof(double));
+        double* XR = (double*) malloc((long) n * nv * sizeof(double));
+        double* work = (double*) malloc(
+            sparse_multiply_block_work(A, nv, BLOCK_COL_MAJOR) *
+            sizeof(double));
+        double flops = 2.0 * A->ptr[n] * nv;
+        double bytes = matrix_bytes(A) + nv * vector_bytes(A);
+        spmm_args_t args = {A, nv, BLOCK_COL_MAJOR, X, Y0, work};
+        const bench_result_t* r;
+        char name[64];
+        if (nv < 1)
+            print_usage_quit(argv[0]);
+
+        /* Column-major X, and the same vectors row-major in XR */
+        for (v = 0; v < nv; ++v)
+            for (j = 0; j < n; ++j) {
+                X[(long) v*n + j] = 1.0 + (double) ((j + 3*v) % 17) / 16;
+                XR[(long) j*nv + v] = X[(long) v*n + j];
+            }
+
+        snprintf(name, sizeof(name), "%d x sparse_multiply", nv);
+        r = bench_run(&b, name, run_loop, &args, flops,
+                      nv * (matrix_bytes(A) + vector_bytes(A)));
+        if (nv == 1 || t1 == 0)
+            t1 = r->tmedian / nv;
+        printf("  %2d loop:      %6.2f GB/s needed, %.2fx per vector\n", nv,
+               bytes / r->tmedian / 1e9, r->tmedian / nv / t1);
+
+        for (layout = BLOCK_ROW_MAJOR; layout <= BLOCK_COL_MAJOR; ++layout) {
+            int same = 1;
+            args.layout = layout;
+            args.X = (layout == BLOCK_ROW_MAJOR) ? XR : X;
+            args.Y = Y;
+            snprintf(name, sizeof(name), "block %d %s", nv,
+                     layout == BLOCK_ROW_MAJOR ? "row-major" : "col-major");
+            r = bench_run(&b, name, run_block, &args, flops, bytes);
+            for (v = 0; v < nv; ++v)
+                for (j = 0; j < n; ++j) {
+                    double y = (layout == BLOCK_ROW_MAJOR) ?
+                        Y[(long) j*nv + v] : Y[(long) v*n + j];
+                    same = same && (y == Y0[(long) v*n + j]);
+                }
+            printf("  %2d %s: %6.2f GB/s needed, %.2fx per vector%s\n", nv,
+                   layout == BLOCK_ROW_MAJOR ? "row-major" : "col-major",
+                   bytes / r->tmedian / 1e9, r->tmedian / nv / t1,
+                   same ? "" : " (MISMATCH)");
+        }
+        free(work);
+        free(XR);
+        free(Y);
+        free(Y0);
+        free(X);
+    }
+
+    csr_free(A);
+    bench_finish(&b);
+    return 0;
+}
@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#include "spmv.h"
+
+/*
+ * SELL chunk height: the number of doubles in a vector register, so
+ * the C rows of a chunk map onto the lanes of one vector
+ */
+#if defined(__AVX512F__)
+#define SELL_C 8
+#else
+#define SELL_C 4
+#endif
+
+#define CSR_SHORT_ROW (4*SELL_C)  /* Rows shorter than this underuse SIMD */
+#define CSR_SHORT_PENALTY 1.25
+#define BCSR_MARGIN 0.85          /* BCSR must save this much traffic */
+#define CCSR_MARGIN 0.90          /* And CCSR, for its decoding */
+#define CCSR_HEADER 6             /* Segment base, length and width */
+#define CCSR_SEG_COST 16          /* Bytes-equivalent to start a segment */
+#define CCSR_MARK 64              /* Rows between index stream marks */
+
+
+/* Row index and length, for sorting rows by length */
+typedef struct row_len_t {
+    int row, len;
+} row_len_t;
+
+static int compare_len(const void* a, const void* b)
+{
+    const row_len_t* x = (const row_len_t*) a;
+    const row_len_t* y = (const row_len_t*) b;
+    if (x->len != y->len)
+        return y->len - x->len;
+    return x->row - y->row;
+}
+
+
+/*
+ * Rows of A in SELL order: sorted by decreasing length within each
+ * window of sigma rows
+ */
+static row_len_t* sell_order(const csr_t* A, int sigma)
+{
+    size_t n = (A->n > 0) ? A->n : 1;
+    row_len_t* order = (row_len_t*) malloc(n * sizeof(row_len_t));
+    int i;
+    for (i = 0; i < A->n; ++i) {
+        order[i].row = i;
+        order[i].len = A->ptr[i+1] - A->ptr[i];
+    }
+    for (i = 0; i < A->n; i += sigma) {
+        int m = (A->n-i < sigma) ? A->n-i : sigma;
+        qsort(order + i, m, sizeof(row_len_t), compare_len);
+    }
+    return order;
+}
+
+
+sell_t* csr_to_sell(const csr_t* A, int sigma)
+{
+    sell_t* S = (sell_t*) malloc(sizeof(sell_t));
+    const int C = SELL_C;
+    row_len_t* order;
+    int k, j;
+
+    if (sigma < C)
+        sigma = C;
+    sigma = sigma / C * C;
+    S->n = A->n;
+    S->C = C;
+    S->sigma = sigma;
+    S->nchunks = (A->n + C-1) / C;
+    S->cptr = (int*) malloc((S->nchunks+1) * sizeof(int));
+    S->clen = (int*) malloc(S->nchunks * sizeof(int));
+    S->perm = (int*) malloc(S->nchunks * C * sizeof(int));
+
+    order = sell_order(A, sigma);
+    S->cptr[0] = 0;
+    for (k = 0; k < S->nchunks; ++k) {
+        /* Sorted within windows, so the first row of a chunk is longest */
+        S->clen[k] = order[k*C].len;
+        S->cptr[k+1] = S->cptr[k] + S->clen[k] * C;
+    }
+    S->col = (int*) malloc((S->cptr[S->nchunks] + 1) * sizeof(int));
+    S->val = (double*) malloc((S->cptr[S->nchunks] + 1) * sizeof(double));
+
+    #pragma omp parallel for private(j) schedule(static)
+    for (k = 0; k < S->nchunks; ++k) {
+        int r;
+        for (r = 0; r < C; ++r) {
+            int slot = k*C + r;
+            int i = (slot < A->n) ? order[slot].row : -1;
+            int len = (i >= 0) ? order[slot].len : 0;
+            int pad = (i >= 0 && len > 0) ? A->col[A->ptr[i+1]-1] : 0;
+            S->perm[slot] = i;
+            for (j = 0; j < S->clen[k]; ++j) {
+                int e = S->cptr[k] + j*C + r;
+                if (j < len) {
+                    S->col[e] = A->col[A->ptr[i] + j];
+                    S->val[e] = A->pr[A->ptr[i] + j];
+                } else {
+                    S->col[e] = pad;
+                    S->val[e] = 0;
+                }
+            }
+        }
+    }
+    free(order);
+    return S;
+}
+
+
+void sell_free(sell_t* S)
+{
+    if (S == NULL)
+        return;
+    free(S->val);
+    free(S->col);
+    free(S->perm);
+    free(S->clen);
+    free(S->cptr);
+    free(S);
+}
+
+
+void sell_multiply(const sell_t* S, const double* x, double* y)
+{
+    #pragma omp parallel
+    {
+        const double* restrict val = S->val;
+        const int* restrict col = S->col;
+        int k0, k1, k, j, r;
+        partition_ptr(S->cptr, S->nchunks, omp_get_thread_num(),
+                      omp_get_num_threads(), &k0, &k1);
+        for (k = k0; k < k1; ++k) {
+            const double* restrict v = val + S->cptr[k];
+            const int* restrict c = col + S->cptr[k];
+            double acc[SELL_C];
+            for (r = 0; r < SELL_C; ++r)
+                acc[r] = 0;
+            for (j = 0; j < S->clen[k]; ++j) {
+                #pragma omp simd
+                for (r = 0; r < SELL_C; ++r)
+                    acc[r] += v[j*SELL_C + r] * x[c[j*SELL_C + r]];
+            }
+            for (r = 0; r < SELL_C; ++r) {
+                int i = S->perm[k*SELL_C + r];
+                if (i >= 0)
+                    y[i] = acc[r];
+            }
+        }
+    }
+}
+
+
+/*
+ * Number of r-by-c blocks covering A, counting distinct block columns
+ * in each block row with a marker array
+ */
+static long count_blocks(const csr_t* A, int r, int c, int* bptr)
+{
+    int nbrows = (A->n + r-1) / r;
+    int nbcols = (A->n + c-1) / c;
+    int* mark = (int*) malloc(nbcols * sizeof(int));
+    long nblocks = 0;
+    int I, i, j;
+    for (j = 0; j < nbcols; ++j)
+        mark[j] = -1;
+    for (I = 0; I < nbrows; ++I) {
+        int iend = (I*r + r < A->n) ? I*r + r : A->n;
+        if (bptr)
+            bptr[I] = (int) nblocks;
+        for (i = I*r; i < iend; ++i)
+            for (j = A->ptr[i]; j < A->ptr[i+1]; ++j) {
+                int J = A->col[j] / c;
+                if (mark[J] != I) {
+                    mark[J] = I;
+                    ++nblocks;
+                }
+            }
+    }
+    if (bptr)
+        bptr[nbrows] = (int) nblocks;
+    free(mark);
+    return nblocks;
+}
+
+
+double bcsr_fill(const csr_t* A, int r, int c)
+{
+    int nnz = A->ptr[A->n];
+    return nnz ? (double) count_blocks(A, r, c, NULL) * r * c / nnz : 1;
+}
+
+
+bcsr_t* csr_to_bcsr(const csr_t* A, int r, int c)
+{
+    bcsr_t* B;
+    long nblocks;
+    int nbcols = (A->n + c-1) / c;
+    int* slot;
+    int I, i, j;
+
+    if (r < 1 || r > BCSR_MAX || c < 1) {
+        fprintf(stderr, "Bad BCSR block size %dx%d\n", r, c);
+        return NULL;
+    }
+    B = (bcsr_t*) malloc(sizeof(bcsr_t));
+    B->n = A->n;
+    B->r = r;
+    B->c = c;
+    B->nbrows = (A->n + r-1) / r;
+    B->bptr = (int*) malloc((B->nbrows+1) * sizeof(int));
+    nblocks = count_blocks(A, r, c, B->bptr);
+    B->bcol = (int*) malloc((nblocks+1) * sizeof(int));
+    B->val = (double*) calloc(nblocks * r * c + 1, sizeof(double));
+
+    /* slot[J] = position of block column J in the current block row */
+    slot = (int*) malloc(nbcols * sizeof(int));
+    for (j = 0; j < nbcols; ++j)
+        slot[j] = -1;
+    for (I = 0; I < B->nbrows; ++I) {
+        int next = B->bptr[I];
+        int iend = (I*r + r < A->n) ? I*r + r : A->n;
+        for (i = I*r; i < iend; ++i)
+            for (j = A->ptr[i]; j < A->ptr[i+1]; ++j) {
+                int J = A->col[j] / c;
+                int b = slot[J];
+                if (b < B->bptr[I]) {
+                    b = slot[J] = next++;
+                    B->bcol[b] = J;
+                }
+                B->val[(long) b*r*c + (i - I*r)*c + A->col[j] - J*c] +=
+                    A->pr[j];
+            }
+    }
+    free(slot);
+    return B;
+}
+
+
+void bcsr_free(bcsr_t* B)
+{
+    if (B == NULL)
+        return;
+    free(B->val);
+    free(B->bcol);
+    free(B->bptr);
+    free(B);
+}
+
+
+/*
+ * y = A*x over block rows [I0, I1), where x is padded to whole blocks.
+ * Always inlined so that the common block sizes get constant r and c,
+ * and fully unrolled block products.
+ */
+static inline __attribute__((always_inline))
+void bcsr_rows(const bcsr_t* B, const double* restrict x,
+               double* restrict y, int I0, int I1, int r, int c)
+{
+    const double* restrict val = B->val;
+    const int* restrict bcol = B->bcol;
+    int I, b, i, j;
+    for (I = I0; I < I1; ++I) {
+        double acc[BCSR_MAX];
+        int iend = (I*r + r < B->n) ? r : B->n - I*r;
+        for (i = 0; i < r; ++i)
+            acc[i] = 0;
+        for (b = B->bptr[I]; b < B->bptr[I+1]; ++b) {
+            const double* v = val + (long) b*r*c;
+            const double* xb = x + bcol[b]*c;
+            for (i = 0; i < r; ++i)
+                for (j = 0; j < c; ++j)
+                    acc[i] += v[i*c + j] * xb[j];
+        }
+        for (i = 0; i < iend; ++i)
+            y[I*r + i] = acc[i];
+    }
+}
+
+
+void bcsr_multiply(const bcsr_t* B, const double* x, double* y)
+{
+    double* xpad = NULL;
+    if (B->n % B->c) {
+        /* The last block column reads past the end of x */
+        int npad = (B->n + B->c-1) / B->c * B->c;
+        xpad = (double*) calloc(npad, sizeof(double));
+        memcpy(xpad, x, B->n * sizeof(double));
+        x = xpad;
+    }
+
+    #pragma omp parallel
+    {
+        int I0, I1;
+        partition_ptr(B->bptr, B->nbrows, omp_get_thread_num(),
+                      omp_get_num_threads(), &I0, &I1);
+        if (B->r == 2 && B->c == 2)
+            bcsr_rows(B, x, y, I0, I1, 2, 2);
+        else if (B->r == 3 && B->c == 3)
+            bcsr_rows(B, x, y, I0, I1, 3, 3);
+        else if (B->r == 4 && B->c == 4)
+            bcsr_rows(B, x, y, I0, I1, 4, 4);
+        else
+            bcsr_rows(B, x, y, I0, I1, B->r, B->c);
+    }
+    free(xpad);
+}
+
+
+/*
+ * Compressed-index CSR.  Each row is cut into segments; a segment
+ * stores a 4-byte base column, a byte for its length less one, a byte
+ * for its offset width (1 or 2), and then one offset from the base per
+ * nonzero.  A segment ends after CCSR_SEG nonzeros, or where the next
+ * column would be too far from the base for 16 bits, which is the
+ * escape for wide jumps.  Segments start at even bytes, so the 16-bit
+ * offsets are aligned.
+ */
+
+/* Length and offset width of the segment starting at col[0] */
+static int ccsr_segment(const int* col, int len, int* base, int* width)
+{
+    int lo = col[0], hi = col[0], k;
+    for (k = 1; k < len && k < CCSR_SEG; ++k) {
+        int l = (col[k] < lo) ? col[k] : lo;
+        int h = (col[k] > hi) ? col[k] : hi;
+        if (h - l > UINT16_MAX)
+            break;
+        lo = l;
+        hi = h;
+    }
+    *base = lo;
+    *width = (hi - lo <= UINT8_MAX) ? 1 : 2;
+    return k;
+}
+
+
+static long ccsr_segment_bytes(int len, int width)
+{
+    return CCSR_HEADER + ((long) len * width + 1) / 2 * 2;
+}
+
+
+/*
+ * Bytes of index data for one row; written to out unless it is NULL.
+ * The number of segments is added to *nseg unless it is NULL.
+ */
+static long ccsr_encode_row(const int* col, int len, unsigned char* out,
+                            long* nseg)
+{
+    long bytes = 0;
+    int k = 0;
+    while (k < len) {
+        int base, width, m;
+        int seg = ccsr_segment(col + k, len - k, &base, &width);
+        if (out) {
+            unsigned char* p = out + bytes;
+            uint32_t b = (uint32_t) base;
+            memcpy(p, &b, 4);
+            p[4] = (unsigned char) (seg - 1);
+            p[5] = (unsigned char) width;
+            p += CCSR_HEADER;
+            for (m = 0; m < seg; ++m) {
+                if (width == 1) {
+                    p[m] = (unsigned char) (col[k+m] - base);
+                } else {
+                    uint16_t d = (uint16_t) (col[k+m] - base);
+                    memcpy(p + 2*m, &d, 2);
+                }
+            }
+        }
+        bytes += ccsr_segment_bytes(seg, width);
+        k += seg;
+        if (nseg)
+            ++*nseg;
+    }
+    return bytes;
+}
+
+
+/* Index bytes and number of segments of the whole matrix */
+static long ccsr_measure(const csr_t* A, long* nseg)
+{
+    long bytes = 0, segs = 0;
+    int i;
+    #pragma omp parallel for reduction(+:bytes, segs) schedule(dynamic, 1024)
+    for (i = 0; i < A->n; ++i)
+        bytes += ccsr_encode_row(A->col + A->ptr[i],
+                                 A->ptr[i+1] - A->ptr[i], NULL, &segs);
+    if (nseg)
+        *nseg = segs;
+    return bytes;
+}
+
+
+long ccsr_index_bytes(const csr_t* A)
+{
+    return ccsr_measure(A, NULL);
+}
+
+
+ccsr_t* csr_to_ccsr(const csr_t* A, int single)
+{
+    ccsr_t* C = (ccsr_t*) calloc(1, sizeof(ccsr_t));
+    int n = A->n, nnz = A->ptr[n], i;
+    long* start = (long*) malloc((n+1) * sizeof(long));
+
+    C->n = n;
+    C->single = single;
+    C->ptr = (int*) malloc((n+1) * sizeof(int));
+    memcpy(C->ptr, A->ptr, (n+1) * sizeof(int));
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (i = 0; i < n; ++i)
+        start[i+1] = ccsr_encode_row(A->col + A->ptr[i],
+                                     A->ptr[i+1] - A->ptr[i], NULL, NULL);
+    start[0] = 0;
+    for (i = 0; i < n; ++i)
+        start[i+1] += start[i];
+    C->nbytes = start[n];
+    C->idx = (unsigned char*) malloc(start[n] > 0 ? start[n] : 1);
+    C->mark = (long*) malloc((n / CCSR_MARK + 1) * sizeof(long));
+    for (i = 0; i <= n; i += CCSR_MARK)
+        C->mark[i / CCSR_MARK] = start[i];
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (i = 0; i < n; ++i)
+        ccsr_encode_row(A->col + A->ptr[i], A->ptr[i+1] - A->ptr[i],
+                        C->idx + start[i], NULL);
+    if (single) {
+        C->fval = (float*) malloc((nnz > 0 ? nnz : 1) * sizeof(float));
+        #pragma omp parallel for
+        for (i = 0; i < nnz; ++i)
+            C->fval[i] = (float) A->pr[i];
+    } else {
+        C->val = (double*) malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+        memcpy(C->val, A->pr, nnz * sizeof(double));
+    }
+    free(start);
+    return C;
+}
+
+
+void ccsr_free(ccsr_t* C)
+{
+    if (C == NULL)
+        return;
+    free(C->fval);
+    free(C->val);
+    free(C->mark);
+    free(C->idx);
+    free(C->ptr);
+    free(C);
+}
+
+
+/*
+ * y = A*x over rows [i0, i1), where i0 is a multiple of CCSR_MARK.
+ * The offsets are decoded in the address arithmetic (x + base + d),
+ * and each row is summed in order, as sparse_multiply does, so in
+ * double precision the result is the same to the bit.  Always inlined
+ * so that the precision is a constant.
+ */
+static inline __attribute__((always_inline))
+void ccsr_rows(const ccsr_t* C, const double* restrict x,
+               double* restrict y, int i0, int i1, int single)
+{
+    const unsigned char* p = C->idx + C->mark[i0 / CCSR_MARK];
+    const double* restrict val = C->val;
+    const float* restrict fval = C->fval;
+    const int* restrict ptr = C->ptr;
+    int i, k, m;
+    for (i = i0; i < i1; ++i) {
+        double sum = 0;
+        for (k = ptr[i]; k < ptr[i+1]; ) {
+            const double* restrict xb;
+            uint32_t base;
+            int len = p[4] + 1, width = p[5];
+            memcpy(&base, p, 4);
+            xb = x + base;
+            if (width == 1) {
+                const uint8_t* restrict d = p + CCSR_HEADER;
+                if (single)
+                    for (m = 0; m < len; ++m)
+                        sum += (double) fval[k+m] * xb[d[m]];
+                else
+                    for (m = 0; m < len; ++m)
+                        sum += val[k+m] * xb[d[m]];
+            } else {
+                const uint16_t* restrict d =
+                    (const uint16_t*) (p + CCSR_HEADER);
+                if (single)
+                    for (m = 0; m < len; ++m)
+                        sum += (double) fval[k+m] * xb[d[m]];
+                else
+                    for (m = 0; m < len; ++m)
+                        sum += val[k+m] * xb[d[m]];
+            }
+            p += ccsr_segment_bytes(len, width);
+            k += len;
+        }
+        y[i] = sum;
+    }
+}
+
+
+void ccsr_multiply(const ccsr_t* C, const double* x, double* y)
+{
+    #pragma omp parallel
+    {
+        int i0, i1;
+        partition_ptr(C->ptr, C->n, omp_get_thread_num(),
+                      omp_get_num_threads(), &i0, &i1);
+        /* Start each range at a marked row */
+        i0 = i0 / CCSR_MARK * CCSR_MARK;
+        if (i1 < C->n)
+            i1 = i1 / CCSR_MARK * CCSR_MARK;
+        if (C->single)
+            ccsr_rows(C, x, y, i0, i1, 1);
+        else
+            ccsr_rows(C, x, y, i0, i1, 0);
+    }
+}
+
+
+void csr_stats(const csr_t* A, csr_stats_t* s)
+{
+    row_len_t* order;
+    double var = 0;
+    long stored = 0, nseg;
+    int i, b;
+
+    s->n = A->n;
+    s->nnz = A->ptr[A->n];
+    s->mean = A->n ? (double) s->nnz / A->n : 0;
+    s->min = s->max = A->n ? A->ptr[1] - A->ptr[0] : 0;
+    for (i = 0; i < A->n; ++i) {
+        int len = A->ptr[i+1] - A->ptr[i];
+        var += (len - s->mean) * (len - s->mean);
+        if (len < s->min) s->min = len;
+        if (len > s->max) s->max = len;
+    }
+    s->cv = (A->n && s->mean > 0) ? sqrt(var / A->n) / s->mean : 0;
+
+    /* SELL padding: each chunk is as long as its first (longest) row */
+    order = sell_order(A, SPMV_SIGMA / SELL_C * SELL_C);
+    for (i = 0; i < A->n; i += SELL_C)
+        stored += (long) order[i].len * SELL_C;
+    free(order);
+    s->sell_fill = s->nnz ? (double) stored / s->nnz : 1;
+
+    /* Best square block size by modeled traffic */
+    s->block = 1;
+    s->bcsr_fill = 1;
+    for (b = 2; b <= 4; ++b) {
+        double fill = bcsr_fill(A, b, b);
+        if (fill * (8 + 4.0/(b*b)) <
+            s->bcsr_fill * (8 + 4.0/(s->block*s->block))) {
+            s->block = b;
+            s->bcsr_fill = fill;
+        }
+    }
+
+    nseg = 0;
+    s->ccsr_index = s->nnz ? (double) ccsr_measure(A, &nseg) / s->nnz : 0;
+    s->ccsr_segs = s->nnz ? (double) nseg / s->nnz : 0;
+}
+
+
+/*
+ * Matrix bytes per nonzero (values and indices) plus the per-row
+ * costs (row pointer or its equivalent, and writing y) spread over the
+ * nonzeros; x is taken to come from cache
+ */
+double spmv_bytes_per_nonzero(const csr_stats_t* s, spmv_format_t format)
+{
+    double per_row = (s->mean > 0) ? 1 / s->mean : 1;
+    int b = s->block;
+    switch (format) {
+    case SPMV_SELL:
+        return s->sell_fill * 12 + 8 * per_row;
+    case SPMV_BCSR:
+        return s->bcsr_fill * (8 + 4.0/(b*b)) + (4.0/b + 8) * per_row;
+    case SPMV_CCSR:
+        return 8 + s->ccsr_index + CCSR_SEG_COST * s->ccsr_segs +
+            12 * per_row;
+    case SPMV_CCSR_FLOAT:
+        return 4 + s->ccsr_index + CCSR_SEG_COST * s->ccsr_segs +
+            12 * per_row;
+    default:
+        return 12 + 12 * per_row;
+    }
+}
+
+
+spmv_format_t spmv_choose(const csr_stats_t* s)
+{
+    double csr = spmv_bytes_per_nonzero(s, SPMV_CSR);
+    double sell = spmv_bytes_per_nonzero(s, SPMV_SELL);
+    double bcsr = spmv_bytes_per_nonzero(s, SPMV_BCSR);
+    double ccsr = spmv_bytes_per_nonzero(s, SPMV_CCSR);
+    if (s->mean < CSR_SHORT_ROW) {
+        csr *= CSR_SHORT_PENALTY;
+        ccsr *= CSR_SHORT_PENALTY;
+    }
+    /* The block kernel has less regular loops, so only take it for
+       a clear saving in traffic */
+    if (s->block > 1 && bcsr <= BCSR_MARGIN * csr &&
+        bcsr <= BCSR_MARGIN * sell)
+        return SPMV_BCSR;
+    if (ccsr <= CCSR_MARGIN * csr && ccsr <= CCSR_MARGIN * sell)
+        return SPMV_CCSR;
+    return (sell < csr) ? SPMV_SELL : SPMV_CSR;
+}
+
+
+const char* spmv_format_name(spmv_format_t format)
+{
+    switch (format) {
+    case SPMV_CSR:  return "CSR";
+    case SPMV_SELL: return "SELL";
+    case SPMV_BCSR: return "BCSR";
+    case SPMV_CCSR: return "CCSR";
+    case SPMV_CCSR_FLOAT: return "CCSR-float";
+    default:        return "auto";
+    }
+}
+
+
+spmv_t* spmv_create(csr_t* A, spmv_format_t format)
+{
+    spmv_t* M = (spmv_t*) calloc(1, sizeof(spmv_t));
+    csr_stats_t s;
+    csr_stats(A, &s);
+    if (format == SPMV_AUTO)
+        format = spmv_choose(&s);
+    M->format = format;
+    M->csr = A;
+    if (format == SPMV_SELL)
+        M->sell = csr_to_sell(A, SPMV_SIGMA);
+    else if (format == SPMV_BCSR)
+        M->bcsr = csr_to_bcsr(A, s.block, s.block);
+    else if (format == SPMV_CCSR || format == SPMV_CCSR_FLOAT)
+        M->ccsr = csr_to_ccsr(A, format == SPMV_CCSR_FLOAT);
+    return M;
+}
+
+
+void spmv_apply(const spmv_t* M, const double* x, double* y)
+{
+    if (M->format == SPMV_SELL)
+        sell_multiply(M->sell, x, y);
+    else if (M->format == SPMV_BCSR)
+        bcsr_multiply(M->bcsr, x, y);
+    else if (M->ccsr)
+        ccsr_multiply(M->ccsr, x, y);
+    else
+        sparse_multiply(M->csr, (double*) x, y);
+}
+
+
+void spmv_free(spmv_t* M)
+{
+    if (M == NULL)
+        return;
+    sell_free(M->sell);
+    bcsr_free(M->bcsr);
+    ccsr_free(M->ccsr);
+    free(M);
+}
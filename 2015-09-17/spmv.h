@@ -0,0 +1,135 @@
+#ifndef SPMV_H
+#define SPMV_H
+
+#include "csr.h"
+
+/*
+ * Alternative storage formats for y = A*x, converted from csr_t.
+ *
+ * SELL-C-sigma (sliced ELLPACK): rows are sorted by length within
+ * windows of sigma rows, then cut into chunks of C rows, and each chunk
+ * is padded to its longest row and stored column by column, so that the
+ * inner loop does C independent rows with unit-stride loads of values
+ * and indices.  C is the vector width (in doubles) we are compiled for.
+ *
+ * BCSR (block CSR): the matrix is covered with dense r-by-c blocks
+ * aligned to multiples of r and c, storing one column index per block
+ * rather than per nonzero.  Good when the nonzeros come in small dense
+ * blocks (several unknowns per mesh node); explicit zeros fill the
+ * rest of each block.
+ *
+ * CCSR (compressed-index CSR): the column indices of each row are
+ * stored as 8- or 16-bit offsets from a base column, in segments of up
+ * to CCSR_SEG nonzeros; a jump too wide for 16 bits starts a new
+ * segment.  Row pointers and values are as in CSR, or the values may
+ * be single precision.  With double values the products are the same
+ * to the bit as sparse_multiply.
+ */
+
+typedef struct sell_t {
+    int n;          /* Number of rows */
+    int C;          /* Chunk height */
+    int sigma;      /* Sorting window (a multiple of C) */
+    int nchunks;
+    int* cptr;      /* Offset of each chunk in val and col (nchunks+1) */
+    int* clen;      /* Padded row length of each chunk */
+    int* perm;      /* Original row of each stored row */
+    int* col;       /* Column indices (padding repeats a valid column) */
+    double* val;    /* Values (padding is zero) */
+} sell_t;
+
+typedef struct bcsr_t {
+    int n;          /* Dimension of matrix */
+    int r, c;       /* Block size */
+    int nbrows;     /* Number of block rows, ceil(n/r) */
+    int* bptr;      /* Offset of each block row in bcol (nbrows+1) */
+    int* bcol;      /* Block column of each block */
+    double* val;    /* r*c values per block, row major */
+} bcsr_t;
+
+typedef struct ccsr_t {
+    int n;          /* Number of rows */
+    int single;     /* Values stored as float (fval) rather than val */
+    int* ptr;       /* Offsets of the rows in val, as in csr_t */
+    long* mark;     /* Offset in idx of every CCSR_MARK-th row */
+    long nbytes;    /* Size of idx */
+    unsigned char* idx;  /* Segments of column offsets */
+    double* val;
+    float* fval;
+} ccsr_t;
+
+sell_t* csr_to_sell(const csr_t* A, int sigma);
+void sell_free(sell_t* S);
+void sell_multiply(const sell_t* S, const double* x, double* y);
+
+/* Returns NULL unless 1 <= r <= BCSR_MAX and c >= 1 */
+bcsr_t* csr_to_bcsr(const csr_t* A, int r, int c);
+void bcsr_free(bcsr_t* B);
+void bcsr_multiply(const bcsr_t* B, const double* x, double* y);
+
+/* Single precision values lose accuracy, so are the caller's choice */
+ccsr_t* csr_to_ccsr(const csr_t* A, int single);
+void ccsr_free(ccsr_t* C);
+void ccsr_multiply(const ccsr_t* C, const double* x, double* y);
+
+/* Bytes of CCSR index data (segments) for A */
+long ccsr_index_bytes(const csr_t* A);
+
+/* Stored entries per true nonzero with r-by-c blocks */
+double bcsr_fill(const csr_t* A, int r, int c);
+
+/*
+ * Row length statistics, and the padding each alternative format
+ * would add, from which spmv_choose picks a format
+ */
+typedef struct csr_stats_t {
+    int n, nnz;
+    int min, max;       /* Shortest and longest row */
+    double mean, cv;    /* Mean row length and coefficient of variation */
+    double sell_fill;   /* Stored entries per nonzero in SELL-C-sigma */
+    int block;          /* Best square BCSR block size */
+    double bcsr_fill;   /* Stored entries per nonzero at that size */
+    double ccsr_index;  /* CCSR index bytes per nonzero */
+    double ccsr_segs;   /* CCSR segments per nonzero */
+} csr_stats_t;
+
+void csr_stats(const csr_t* A, csr_stats_t* s);
+
+typedef enum spmv_format_t {
+    SPMV_AUTO, SPMV_CSR, SPMV_SELL, SPMV_BCSR, SPMV_CCSR, SPMV_CCSR_FLOAT
+} spmv_format_t;
+
+/*
+ * Modeled bytes moved per nonzero in each format.  CCSR is also
+ * charged for each segment it starts (the header, a width dispatch and
+ * a fresh inner loop), so it loses on short scattered runs even when
+ * its index is small.  spmv_choose takes
+ * the cheapest, counting a penalty for CSR on short rows (which do not
+ * fill the vector units) and asking BCSR and CCSR for a clear saving.
+ * It never picks single precision values.
+ */
+double spmv_bytes_per_nonzero(const csr_stats_t* s, spmv_format_t format);
+spmv_format_t spmv_choose(const csr_stats_t* s);
+const char* spmv_format_name(spmv_format_t format);
+
+/*
+ * A matrix in some format, for callers that do not care which.  The
+ * csr_t is borrowed, not copied, and must outlive the spmv_t.
+ */
+typedef struct spmv_t {
+    spmv_format_t format;
+    csr_t* csr;
+    sell_t* sell;
+    bcsr_t* bcsr;
+    ccsr_t* ccsr;
+} spmv_t;
+
+spmv_t* spmv_create(csr_t* A, spmv_format_t format);
+void spmv_apply(const spmv_t* M, const double* x, double* y);
+void spmv_free(spmv_t* M);
+
+#define SPMV_SIGMA 256  /* Default SELL sorting window */
+#define BCSR_MAX 8      /* Largest BCSR block height */
+#define CCSR_SEG 64     /* Longest CCSR segment (at most 256) */
+
+#endif /* SPMV_H */
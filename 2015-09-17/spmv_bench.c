@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#include "csr.h"
+#include "spmv.h"
+#include "bench.h"
+
+#define PARTS_PER_THREAD 4
+
+
+/*
+ * Bytes a CSR product must move at least: values and column indices,
+ * row pointers, reading x once and writing y
+ */
+static double csr_traffic(const csr_t* A)
+{
+    double nnz = A->ptr[A->n];
+    return nnz * (sizeof(double) + sizeof(int)) +
+        (A->n + 1.0) * sizeof(int) + 2.0 * A->n * sizeof(double);
+}
+
+
+typedef struct spmv_args_t {
+    const spmv_t* M;
+    const double* x;
+    double* y;
+} spmv_args_t;
+
+
+static void run_spmv(void* arg)
+{
+    spmv_args_t* a = (spmv_args_t*) arg;
+    spmv_apply(a->M, a->x, a->y);
+}
+
+
+/* Largest difference from y0, relative to the largest entry of y0 */
+static double rel_error(const double* y, const double* y0, int n)
+{
+    double err = 0, ymax = 0;
+    int i;
+    for (i = 0; i < n; ++i) {
+        err = fmax(err, fabs(y[i] - y0[i]));
+        ymax = fmax(ymax, fabs(y0[i]));
+    }
+    return ymax > 0 ? err / ymax : err;
+}
+
+
+static void time_matrix(bench_t* b, const char* kind, csr_t* A)
+{
+    static const spmv_format_t formats[] = {
+        SPMV_CSR, SPMV_SELL, SPMV_BCSR, SPMV_CCSR, SPMV_CCSR_FLOAT
+    };
+    double* x = (double*) malloc(A->n * sizeof(double));
+    double* y = (double*) malloc(A->n * sizeof(double));
+    double* y0 = (double*) malloc(A->n * sizeof(double));
+    double bytes = csr_traffic(A);
+    spmv_format_t choice;
+    double gbs[5], gbs_choice = 0;
+    csr_stats_t s;
+    int i, k;
+
+    for (i = 0; i < A->n; ++i)
+        x[i] = 1.0 + (double) (i % 17) / 16;
+    sparse_multiply(A, x, y0);
+
+    csr_stats(A, &s);
+    choice = spmv_choose(&s);
+    printf("%s: n=%d nnz=%d rows %d..%d mean %.1f cv %.2f;"
+           " SELL fill %.2f, BCSR %dx%d fill %.2f,"
+           " CCSR index %.2f bytes, %.3f segments/nnz -> %s\n",
+           kind, s.n, s.nnz, s.min, s.max, s.mean, s.cv, s.sell_fill,
+           s.block, s.block, s.bcsr_fill, s.ccsr_index, s.ccsr_segs,
+           spmv_format_name(choice));
+
+    for (k = 0; k < 5; ++k) {
+        spmv_t* M = spmv_create(A, formats[k]);
+        spmv_args_t args = {M, x, y};
+        const bench_result_t* r;
+        char name[64];
+        snprintf(name, sizeof(name), "%s %s%s", kind,
+                 spmv_format_name(formats[k]),
+                 formats[k] == choice ? " (chosen)" : "");
+        r = bench_run(b, name, run_spmv, &args, 2.0 * s.nnz, bytes);
+        gbs[k] = bytes / r->tmedian / 1e9;
+        if (formats[k] == choice)
+            gbs_choice = gbs[k];
+        printf("  %s: %.2f GB/s effective (%.1f modeled bytes/nnz),"
+               " error %.1e\n", spmv_format_name(formats[k]), gbs[k],
+               spmv_bytes_per_nonzero(&s, formats[k]),
+               rel_error(y, y0, A->n));
+        spmv_free(M);
+    }
+    /* formats[0] is CSR */
+    printf("  chosen %s: %.2fx CSR%s\n", spmv_format_name(choice),
+           gbs_choice / gbs[0],
+           gbs_choice < 0.95 * gbs[0] ? " (slower than CSR)" : "");
+
+    free(y0);
+    free(y);
+    free(x);
+}
+
+
+/* A random permutation (Fisher-Yates with an LCG) */
+static int* random_perm(int n, unsigned seed)
+{
+    int* perm = (int*) malloc(n * sizeof(int));
+    uint64_t state = seed * 2654435761u + 1;
+    int i;
+    for (i = 0; i < n; ++i)
+        perm[i] = i;
+    for (i = n-1; i > 0; --i) {
+        int j, t;
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        j = (int) ((state >> 33) % (uint64_t) (i+1));
+        t = perm[i];
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+    return perm;
+}
+
+
+/*
+ * Returns A reordered, freeing A: shuffled first if seed is
+ * nonzero, then put in the named order (none, rcm, or part).  Prints
+ * the bandwidth and profile before and after, and checks that the
+ * product in the new order, mapped back, matches the original.
+ */
+static csr_t* reorder(csr_t* A, const char* order, unsigned seed)
+{
+    int n = A->n, bw0, bw1, i;
+    long prof0, prof1;
+    int* perm = NULL;
+    csr_t* B;
+    double *x, *xp, *y0, *yp, *y, t0, t1;
+
+    if (seed) {
+        int* shuffle = random_perm(n, seed);
+        B = csr_permute(A, shuffle);
+        free(shuffle);
+        csr_free(A);
+        A = B;
+    }
+    if (strcmp(order, "rcm") == 0) {
+        t0 = omp_get_wtime();
+        perm = csr_rcm(A);
+        t1 = omp_get_wtime();
+    } else if (strcmp(order, "part") == 0) {
+        t0 = omp_get_wtime();
+        perm = csr_partition_order(A, omp_get_max_threads() * PARTS_PER_THREAD);
+        t1 = omp_get_wtime();
+    } else {
+        return A;
+    }
+
+    B = csr_permute(A, perm);
+    csr_profile(A, &bw0, &prof0);
+    csr_profile(B, &bw1, &prof1);
+    printf("%s ordering (%.3f s): bandwidth %d -> %d, profile %ld -> %ld\n",
+           order, t1-t0, bw0, bw1, prof0, prof1);
+
+    x = (double*) malloc(n * sizeof(double));
+    xp = (double*) malloc(n * sizeof(double));
+    y0 = (double*) malloc(n * sizeof(double));
+    yp = (double*) malloc(n * sizeof(double));
+    y = (double*) malloc(n * sizeof(double));
+    for (i = 0; i < n; ++i)
+        x[i] = 1.0 + (double) (i % 17) / 16;
+    sparse_multiply(A, x, y0);
+    permute_vector(perm, n, x, xp);
+    sparse_multiply(B, xp, yp);
+    unpermute_vector(perm, n, yp, y);
+    printf("  reordered product, mapped back: error %.1e\n",
+           rel_error(y, y0, n));
+
+    free(y);
+    free(yp);
+    free(y0);
+    free(xp);
+    free(x);
+    free(perm);
+    csr_free(A);
+    return B;
+}
+
+
+static void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [harness options] [-m matrix] [-n rows]"
+            " [-s seed] [-r order]\n"
+            "  matrix: banded, laplace, random, powerlaw, blocks, all,\n"
+            "          or a Matrix Market (.mtx) or binary CSR file\n"
+            "  order: none, rcm, part\n",
+            name);
+    exit(-1);
+}
+
+
+/*
+ * Options (besides the harness options in bench.h):
+ *   -m matrix = test matrix or matrix file (default all)
+ *   -n rows = rows in each test matrix (default 1M)
+ *   -s seed = randomly renumber the matrix first, like a mesh with
+ *             no useful numbering (default 0, keep it)
+ *   -r order = reorder before timing: none (default), rcm, or part
+ *              (partitioned, PARTS_PER_THREAD pieces per thread)
+ *
+ * Effective GB/s counts the bytes of the CSR traffic model (csr_traffic)
+ * whatever the format, so the formats are compared on time alone and
+ * a format that moves fewer bytes can beat the memory bandwidth.
+ * After each matrix, the chosen format's speed is given relative to
+ * CSR, and flagged if it is more than 5% (timing noise) slower.
+ */
+int main(int argc, char** argv)
+{
+    static const char* kinds[] = {
+        "banded", "laplace", "random", "powerlaw", "blocks"
+    };
+    bench_t b;
+    const char* kind = "all";
+    const char* order = "none";
+    unsigned seed = 0;
+    int n = 1 << 20;
+    int i, found = 0;
+
+    bench_init(&b, &argc, argv);
+    for (i = 1; i < argc; ++i) {
+        if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'm': kind = argv[++i]; break;
+            case 'n': n = atoi(argv[++i]); break;
+            case 's': seed = (unsigned) atoi(argv[++i]); break;
+            case 'r': order = argv[++i]; break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    if (n < 16)
+        print_usage_quit(argv[0]);
+
+    printf("Threads: %d\n", omp_get_max_threads());
+    for (i = 0; i < 5; ++i)
+        if (strcmp(kind, "all") == 0 || strcmp(kind, kinds[i]) == 0) {
+            csr_t* A = reorder(csr_generate(kinds[i], n), order, seed);
+            time_matrix(&b, kinds[i], A);
+            csr_free(A);
+            found = 1;
+        }
+    if (!found) {
+        csr_t* A = csr_load(kind);
+        if (A == NULL)
+            return -1;
+        A = reorder(A, order, seed);
+        time_matrix(&b, kind, A);
+        csr_free(A);
+    }
+
+    bench_finish(&b);
+    return 0;
+}
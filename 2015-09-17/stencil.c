@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stencil.h"
+
+#define GRID_ALIGN 8  /* Row alignment, in doubles (64 bytes) */
+
+
+static int grid_ld(int nx)
+{
+    /* Row j starts GRID_ALIGN doubles into its slot, leaving room for
+       the left ghost; the right ghost is at nx */
+    return (nx + 1 + GRID_ALIGN + GRID_ALIGN-1) / GRID_ALIGN * GRID_ALIGN;
+}
+
+
+size_t grid_size(int nx, int ny)
+{
+    return (size_t) grid_ld(nx) * (ny + 2);
+}
+
+
+void grid_place(grid_t* g, int nx, int ny, double h, double* mem)
+{
+    g->nx = nx;
+    g->ny = ny;
+    g->h = h;
+    g->ld = grid_ld(nx);
+    g->mem = mem;
+    g->u = mem + g->ld + GRID_ALIGN;
+}
+
+
+grid_t* grid_alloc(int nx, int ny, double h)
+{
+    grid_t* g = (grid_t*) malloc(sizeof(grid_t));
+    size_t size = grid_size(nx, ny) * sizeof(double);
+    void* mem;
+    if (posix_memalign(&mem, GRID_ALIGN * sizeof(double), size) != 0) {
+        free(g);
+        return NULL;
+    }
+    memset(mem, 0, size);
+    grid_place(g, nx, ny, h, (double*) mem);
+    return g;
+}
+
+
+void grid_free(grid_t* g)
+{
+    if (g == NULL)
+        return;
+    free(g->mem);
+    free(g);
+}
+
+
+void grid_fill(grid_t* g, double (*f)(double x, double y),
+               double x0, double y0)
+{
+    int i, j;
+    #pragma omp parallel for private(i)
+    for (j = -1; j <= g->ny; ++j)
+        for (i = -1; i <= g->nx; ++i)
+            GRID(g, i, j) = f(x0 + i * g->h, y0 + j * g->h);
+}
+
+
+void grid_boundary(grid_t* g, stencil_bc_t bc)
+{
+    int nx = g->nx, ny = g->ny, j;
+    if (bc != BC_PERIODIC)
+        return;
+    for (j = 0; j < ny; ++j) {
+        GRID(g, -1, j) = GRID(g, nx-1, j);
+        GRID(g, nx, j) = GRID(g, 0, j);
+    }
+    /* Whole rows, so the corners come along */
+    memcpy(&GRID(g, -1, -1), &GRID(g, -1, ny-1), (nx+2) * sizeof(double));
+    memcpy(&GRID(g, -1, ny), &GRID(g, -1, 0), (nx+2) * sizeof(double));
+}
+
+
+STENCIL_DEFINE(laplacian5, -4.0, 1.0, 0.0)
+STENCIL_DEFINE(laplacian9, -20.0/6, 4.0/6, 1.0/6)
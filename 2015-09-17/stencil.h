@@ -0,0 +1,115 @@
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <stddef.h>
+#include <omp.h>
+
+/*
+ * Whole-grid stencils on 2D arrays.  A grid_t holds nx-by-ny points
+ * with spacing h, surrounded by one layer of ghost points that hold
+ * the boundary values: fixed values for Dirichlet conditions, or
+ * copies of the opposite edge for periodic ones.  Each row starts on a
+ * 64-byte boundary and is padded, so that the kernels vectorize over i
+ * with aligned loads.
+ */
+
+typedef struct grid_t {
+    int nx, ny;     /* Points in each direction, not counting ghosts */
+    int ld;         /* Distance between rows */
+    double h;       /* Grid spacing */
+    double* mem;    /* The allocation */
+    double* u;      /* Point (0,0); ghosts are at i, j = -1 and nx, ny */
+} grid_t;
+
+#define GRID(g, i, j) ((g)->u[(long) (j) * (g)->ld + (i)])
+
+typedef enum stencil_bc_t { BC_DIRICHLET, BC_PERIODIC } stencil_bc_t;
+
+/* Zeroed, ghosts included */
+grid_t* grid_alloc(int nx, int ny, double h);
+void grid_free(grid_t* g);
+
+/*
+ * For grids carved out of a larger block: grid_size is the doubles a
+ * grid takes, and grid_place sets g up on mem, which must be aligned
+ * to 64 bytes (as are all multiples of grid_size past such a start).
+ * grid_free is not for placed grids.
+ */
+size_t grid_size(int nx, int ny);
+void grid_place(grid_t* g, int nx, int ny, double h, double* mem);
+
+/* Point (i,j) is at (x0 + i*h, y0 + j*h); fills the ghosts too */
+void grid_fill(grid_t* g, double (*f)(double x, double y),
+               double x0, double y0);
+
+/* Periodic: copy each edge into the opposite ghosts.  Dirichlet: leave
+   the ghosts as they are. */
+void grid_boundary(grid_t* g, stencil_bc_t bc);
+
+/* Tile of the kernels' loops: a strip of BX points, BY rows deep */
+#define STENCIL_BX 512
+#define STENCIL_BY 32
+
+/*
+ * out = (cc u + ce (edge neighbours) + cd (corner neighbours)) / h^2 at
+ * every point of in.  Always inlined into each instantiation, so that
+ * the coefficients are constants: the corner terms vanish when cd is
+ * zero, and the arithmetic is scheduled for the actual values.  Tiles
+ * of STENCIL_BX by STENCIL_BY points are shared among the threads.
+ */
+static inline __attribute__((always_inline))
+void stencil_apply(grid_t* in, grid_t* out, stencil_bc_t bc,
+                   const double cc, const double ce, const double cd)
+{
+    const int nx = in->nx, ny = in->ny, ld = in->ld, ldo = out->ld;
+    const double scale = 1 / (in->h * in->h);
+    const double a = cc * scale, b = ce * scale, c = cd * scale;
+    const int ntx = (nx + STENCIL_BX-1) / STENCIL_BX;
+    const int nty = (ny + STENCIL_BY-1) / STENCIL_BY;
+    int tx, ty;
+
+    grid_boundary(in, bc);
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (ty = 0; ty < nty; ++ty)
+        for (tx = 0; tx < ntx; ++tx) {
+            int i0 = tx * STENCIL_BX;
+            int i1 = (i0 + STENCIL_BX < nx) ? i0 + STENCIL_BX : nx;
+            int j1 = (ty+1) * STENCIL_BY < ny ? (ty+1) * STENCIL_BY : ny;
+            int i, j;
+            for (j = ty * STENCIL_BY; j < j1; ++j) {
+                const double* restrict s = in->u + (long) (j-1) * ld;
+                const double* restrict m = in->u + (long) j * ld;
+                const double* restrict n = in->u + (long) (j+1) * ld;
+                double* restrict o = out->u + (long) j * ldo;
+                if (cd != 0) {
+                    #pragma omp simd aligned(s, m, n, o : 64)
+                    for (i = i0; i < i1; ++i)
+                        o[i] = a * m[i] +
+                            b * (m[i-1] + m[i+1] + s[i] + n[i]) +
+                            c * (s[i-1] + s[i+1] + n[i-1] + n[i+1]);
+                } else {
+                    #pragma omp simd aligned(s, m, n, o : 64)
+                    for (i = i0; i < i1; ++i)
+                        o[i] = a * m[i] +
+                            b * (m[i-1] + m[i+1] + s[i] + n[i]);
+                }
+            }
+        }
+}
+
+/*
+ * Define void name(grid_t* in, grid_t* out, stencil_bc_t bc) applying
+ * the stencil with the given constant coefficients
+ */
+#define STENCIL_DEFINE(name, cc, ce, cd)                          \
+    void name(grid_t* in, grid_t* out, stencil_bc_t bc)           \
+    {                                                             \
+        stencil_apply(in, out, bc, (cc), (ce), (cd));             \
+    }
+
+/* The standard 5-point Laplacian, and the compact 9-point one
+   (weights 4 on edges and 1 on corners, over 6h^2) */
+void laplacian5(grid_t* in, grid_t* out, stencil_bc_t bc);
+void laplacian9(grid_t* in, grid_t* out, stencil_bc_t bc);
+
+#endif /* STENCIL_H */
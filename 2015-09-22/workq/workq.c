@@ -1,22 +1,33 @@
 /* workq.c --
  *
  *   Driver syntax: ./workq [nthreads]
+ *                  ./workq -s nproducers nconsumers nitems [batch [size]]
  *   Defaults to nthreads = 1
  *
- * Example of a multi-threaded work queue.  This implementation does
- * not have proper synchronization -- your job is to add it in!  Search
- * for the TODO comments below.
+ * Example of a multi-threaded work queue.  The queue is a bounded ring
+ * buffer that any number of producers and consumers share without
+ * locks: each slot carries a sequence number saying whether it is
+ * ready to be filled or emptied on the current pass around the ring,
+ * and a thread claims a run of slots with one compare-and-swap on the
+ * head or tail index.
  *
- * We do provide some convenience functions to wrap the pthread library
- * calls, if you'd like to use them.
+ * With -s, the driver runs a stress test instead of the demo: each
+ * producer puts nitems distinct items (batch at a time) into a queue
+ * with room for size items, and the consumers check that every item
+ * comes out exactly once and that each producer's items arrive in
+ * order.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
+#include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 
 /************************* I/O ******************************/
@@ -43,44 +54,64 @@ void lprintf(const char* format, ...)
 
 /************************* Work queue ******************************/
 
-/* 
- * Each task consists of a pointer to user-managed data and a next
- * task.  If this was a C++ program, I would use a template here to
- * allow different data types.
+#define CACHE_LINE 64
+
+/*
+ * Each slot holds a pointer to user-managed data and a sequence
+ * number.  Slot i of the ring is used for positions i, i+size,
+ * i+2*size, ...; for position pos, seq == pos means the slot is free
+ * for the producer that claims pos, and seq == pos+1 means the data is
+ * in and waiting for the consumer that claims pos.  The consumer then
+ * sets seq to pos+size, freeing the slot for the next pass.
  */
 typedef struct task_t {
+    atomic_size_t seq;
     void* data;
-    struct task_t* next;
 } task_t;
 
 
 /*
- * The work queue consists not only of the head of a linked lisk of tasks,
- * but also a lock and condition variable for synchronizing the interaction
- * of producers (who put items on the queue) and consumers (who pull items).
- * 
+ * The work queue consists of the ring of slots and the positions of
+ * the next slot to fill (tail) and to empty (head).  Producers only
+ * touch tail and consumers only touch head, so each sits on its own
+ * cache line, away from the fields that are read-only after setup.
+ *
  * For the moment, we assume that there is some logic in place to decide
  * when no more work will be produced, and that some entity can run this
  * logic and set the "done" flag.  In very dynamic situations, deciding
  * when no more tasks will be produced is itself not trivial.
  */
 typedef struct workq_t {
-    pthread_mutex_t lock;  /* Mutex for queue invariants */
-    pthread_cond_t cv;     /* Signal for work ready / finalize */
-    int done;              /* Flag that work queue is closed up */
-    task_t* tasks;         /* Linked list of tasks */
+    _Alignas(CACHE_LINE) atomic_size_t head;  /* Next position to get */
+    _Alignas(CACHE_LINE) atomic_size_t tail;  /* Next position to put */
+    _Alignas(CACHE_LINE) atomic_int done;     /* Flag that work queue is
+                                                 closed up */
+    size_t mask;                              /* Ring size - 1 */
+    task_t* tasks;                            /* Ring of slots */
 } workq_t;
 
 
 /*
- * Set up the work queue
+ * Set up the work queue with room for at least size items, rounded up
+ * to a power of two.  There are at least two slots: with one, a filled
+ * slot and a freed one would have the same sequence number.
  */
-void workq_init(workq_t* workq)
+void workq_init(workq_t* workq, size_t size)
 {
-    pthread_mutex_init(&(workq->lock), NULL);
-    pthread_cond_init(&(workq->cv), NULL);
-    workq->done = 0;
-    workq->tasks = NULL;
+    size_t n = 2, i;
+    while (n < size)
+        n *= 2;
+    workq->tasks = (task_t*) aligned_alloc(CACHE_LINE,
+                                           n * sizeof(task_t) < CACHE_LINE ?
+                                           CACHE_LINE : n * sizeof(task_t));
+    for (i = 0; i < n; ++i) {
+        atomic_init(&workq->tasks[i].seq, i);
+        workq->tasks[i].data = NULL;
+    }
+    workq->mask = n-1;
+    atomic_init(&workq->head, 0);
+    atomic_init(&workq->tail, 0);
+    atomic_init(&workq->done, 0);
 }
 
 
@@ -90,87 +121,154 @@ void workq_init(workq_t* workq)
  */
 void workq_destroy(workq_t* workq)
 {
-    pthread_cond_destroy(&(workq->cv));
-    pthread_mutex_destroy(&(workq->lock));
+    free(workq->tasks);
+    workq->tasks = NULL;
 }
 
 
 /*
- * Lock the work queue
+ * Wait a bit for another thread to make progress
  */
-void workq_lock(workq_t* workq)
+static void workq_backoff(void)
 {
-    pthread_mutex_lock(&(workq->lock));
+    sched_yield();
 }
 
 
 /*
- * Unlock the work queue
+ * Claim up to n consecutive slots at the tail that are free and fill
+ * them from data.  Returns the number put, or 0 if the queue is full.
  */
-void workq_unlock(workq_t* workq)
+static int workq_try_put_n(workq_t* workq, void** data, int n)
 {
-    pthread_mutex_unlock(&(workq->lock));
+    size_t pos = atomic_load_explicit(&workq->tail, memory_order_relaxed);
+    int k;
+    for (;;) {
+        /* Count the free slots from pos on, up to n */
+        for (k = 0; k < n; ++k) {
+            task_t* task = &workq->tasks[(pos+k) & workq->mask];
+            size_t seq = atomic_load_explicit(&task->seq,
+                                              memory_order_acquire);
+            if (seq != pos+k)
+                break;
+        }
+        if (k > 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &workq->tail, &pos, pos+k,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+            /* Lost the race; pos now holds the current tail */
+        } else {
+            task_t* task = &workq->tasks[pos & workq->mask];
+            size_t seq = atomic_load_explicit(&task->seq,
+                                              memory_order_acquire);
+            if ((intptr_t) (seq - pos) < 0)
+                return 0;  /* Slot not yet emptied from the last pass */
+            pos = atomic_load_explicit(&workq->tail, memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < k; ++i) {
+        task_t* task = &workq->tasks[(pos+i) & workq->mask];
+        task->data = data[i];
+        atomic_store_explicit(&task->seq, pos+i+1, memory_order_release);
+    }
+    return k;
 }
 
 
 /*
- * Signal work available or all work done.
- * Wakes at most one waiting thread.
+ * Claim up to n consecutive filled slots at the head and empty them
+ * into data.  Returns the number taken, or 0 if the queue is empty.
  */
-void workq_signal(workq_t* workq)
+static int workq_try_get_n(workq_t* workq, void** data, int n)
 {
-    pthread_cond_signal(&(workq->cv));
+    size_t pos = atomic_load_explicit(&workq->head, memory_order_relaxed);
+    int k;
+    for (;;) {
+        for (k = 0; k < n; ++k) {
+            task_t* task = &workq->tasks[(pos+k) & workq->mask];
+            size_t seq = atomic_load_explicit(&task->seq,
+                                              memory_order_acquire);
+            if (seq != pos+k+1)
+                break;
+        }
+        if (k > 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &workq->head, &pos, pos+k,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else {
+            task_t* task = &workq->tasks[pos & workq->mask];
+            size_t seq = atomic_load_explicit(&task->seq,
+                                              memory_order_acquire);
+            if ((intptr_t) (seq - (pos+1)) < 0)
+                return 0;  /* Slot not yet filled on this pass */
+            pos = atomic_load_explicit(&workq->head, memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < k; ++i) {
+        task_t* task = &workq->tasks[(pos+i) & workq->mask];
+        data[i] = task->data;
+        atomic_store_explicit(&task->seq, pos+i + workq->mask+1,
+                              memory_order_release);
+    }
+    return k;
 }
 
 
 /*
- * Signal work available or all work done.
- * Wakes all waiting threads
+ * Add n data items to the queue, waiting for room as needed.
+ * The items go in as few runs of consecutive slots as possible.
  */
-void workq_broadcast(workq_t* workq)
+void workq_put_n(workq_t* workq, void** data, int n)
 {
-    pthread_cond_broadcast(&(workq->cv));
+    while (n > 0) {
+        int k = workq_try_put_n(workq, data, n);
+        if (k == 0)
+            workq_backoff();
+        data += k;
+        n -= k;
+    }
 }
 
 
 /*
- * Wait for work available or all work done
- * Precondition: The queue should be locked before calling workq_wait.
+ * Add work to the queue
  */
-void workq_wait(workq_t* workq)
+void workq_put(workq_t* workq, void* data)
 {
-    while (workq->tasks == NULL && workq->done == 0)
-        pthread_cond_wait(&(workq->cv), &(workq->lock));
+    workq_put_n(workq, &data, 1);
 }
 
 
 /*
- * Add work to the queue
- * TODO: This needs synchronization!
+ * Get between 1 and n data items from the queue, waiting until some
+ * are available.  Returns 0 once the queue is empty and finished.
+ *
+ * The done flag is read before trying the queue: workq_finish comes
+ * after the last put, so if done was already set, an empty queue
+ * really is empty for good.
  */
-void workq_put(workq_t* workq, void* data)
+int workq_get_n(workq_t* workq, void** data, int n)
 {
-    task_t* task = (task_t*) malloc(sizeof(task_t));
-    task->data = data;
-    task->next = workq->tasks;
-    workq->tasks = task;
+    for (;;) {
+        int done = atomic_load_explicit(&workq->done, memory_order_acquire);
+        int k = workq_try_get_n(workq, data, n);
+        if (k > 0 || done)
+            return k;
+        workq_backoff();
+    }
 }
 
 
 /*
  * Get a data item from the queue.  We assume NULL data can be used
  * to signal that the queue is empty.
- * TODO: This needs synchronization!
  */
 void* workq_get(workq_t* workq)
 {
     void* result = NULL;
-    if (workq->tasks) {
-        task_t* task = workq->tasks;
-        result = task->data;
-        workq->tasks = task->next;
-        free(task);
-    }
+    workq_get_n(workq, &result, 1);
     return result;
 }
 
@@ -178,12 +276,12 @@ void* workq_get(workq_t* workq)
 /*
  * Signal that no more work will be added to the queue.
  * NB: This function can be called when there are still tasks to process!
- *     We're just saying that we're done adding new tasks.
- * TODO: This needs synchronization!
+ *     We're just saying that we're done adding new tasks.  Every put
+ *     must have returned before this is called.
  */
 void workq_finish(workq_t* workq)
 {
-    workq->done = 1;
+    atomic_store_explicit(&workq->done, 1, memory_order_release);
 }
 
 
@@ -232,25 +330,23 @@ void* consumer_main(void* arg)
 }
 
 
-int main(int argc, char** argv)
+int run_demo(int nworkers)
 {
-    int i, nworkers = 1;
+    int i;
     pthread_t threads[32];
     consumer_t consumers[32];
     workq_t workq;
 
-    /* Get number of workers from command line */
-    if (argc > 1)
-        nworkers = atoi(argv[1]);
     if (nworkers > 32 || nworkers < 1) {
         fprintf(stderr, "Error: Must have between 1 and 32 workers\n");
         return -1;
     }
 
-    /* Initialize I/O mutex and work queue */
+    /* Initialize I/O mutex and work queue (smaller than the work, so
+       the producer sometimes has to wait) */
     pthread_mutex_init(&io_lock, NULL);
-    workq_init(&workq);
-    
+    workq_init(&workq, 16);
+
     /* Launch worker threads */
     for (i = 0; i < nworkers; ++i) {
         consumers[i].id = i;
@@ -258,19 +354,173 @@ int main(int argc, char** argv)
         pthread_create(&threads[i], NULL, consumer_main, &consumers[i]);
         lprintf("Create worker %d\n", i);
     }
-    
+
     /* Run producer */
     producer_main(&workq, 100);
-    
+
     /* Join on worker threads */
     for (i = 0; i < nworkers; ++i) {
         lprintf("Join worker %d\n", i);
         pthread_join(threads[i], NULL);
     }
-    
+
     /* Free I/O mutex and work queue */
     workq_destroy(&workq);
     pthread_mutex_destroy(&io_lock);
 
     return 0;
 }
+
+
+/********************** Stress test ***************************/
+
+
+/*
+ * Stress thread data.  Producer id's item i is the pointer value
+ * id*nitems + i + 1 (never NULL); consumers count each item they see
+ * in the shared seen array.
+ */
+typedef struct stress_t {
+    int id;
+    int nitems;             /* Items per producer */
+    int batch;              /* Items per put or get */
+    int nproducers;
+    workq_t* workq;
+    atomic_uchar* seen;     /* Times each item was taken */
+    long count;             /* Items taken (consumers) */
+    long errors;            /* Duplicates and out-of-order items */
+} stress_t;
+
+
+void* stress_producer(void* arg)
+{
+    stress_t* s = (stress_t*) arg;
+    void** buf = (void**) malloc(s->batch * sizeof(void*));
+    int i, k;
+    for (i = 0; i < s->nitems; i += k) {
+        for (k = 0; k < s->batch && i+k < s->nitems; ++k)
+            buf[k] = (void*) (uintptr_t) ((long) s->id * s->nitems + i+k + 1);
+        workq_put_n(s->workq, buf, k);
+    }
+    free(buf);
+    return NULL;
+}
+
+
+/*
+ * Each consumer takes positions in increasing order, so it should see
+ * each producer's items in increasing order too.
+ */
+void* stress_consumer(void* arg)
+{
+    stress_t* s = (stress_t*) arg;
+    void** buf = (void**) malloc(s->batch * sizeof(void*));
+    long* last = (long*) malloc(s->nproducers * sizeof(long));
+    int i, k;
+    for (i = 0; i < s->nproducers; ++i)
+        last[i] = -1;
+    while ((k = workq_get_n(s->workq, buf, s->batch)) > 0) {
+        for (i = 0; i < k; ++i) {
+            long v = (long) (uintptr_t) buf[i] - 1;
+            int p = v / s->nitems;
+            long item = v % s->nitems;
+            if (item <= last[p] || atomic_fetch_add(&s->seen[v], 1) != 0)
+                ++s->errors;
+            last[p] = item;
+        }
+        s->count += k;
+    }
+    free(last);
+    free(buf);
+    return NULL;
+}
+
+
+int run_stress(int nproducers, int nconsumers, int nitems, int batch,
+               int size)
+{
+    pthread_t pthreads[32], cthreads[32];
+    stress_t producers[32], consumers[32];
+    long total = (long) nproducers * nitems, count = 0, errors = 0, missing;
+    atomic_uchar* seen;
+    struct timespec t0, t1;
+    double t;
+    workq_t workq;
+    int i;
+    long v;
+
+    if (nproducers < 1 || nproducers > 32 ||
+        nconsumers < 1 || nconsumers > 32) {
+        fprintf(stderr, "Error: Must have between 1 and 32 producers "
+                "and consumers\n");
+        return -1;
+    }
+    if (nitems < 1 || batch < 1 || size < 1) {
+        fprintf(stderr, "Error: nitems, batch, and size must be positive\n");
+        return -1;
+    }
+
+    seen = (atomic_uchar*) calloc(total, sizeof(atomic_uchar));
+    workq_init(&workq, size);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < nconsumers + nproducers; ++i) {
+        int is_producer = (i >= nconsumers);
+        stress_t* s = is_producer ? &producers[i-nconsumers] : &consumers[i];
+        s->id = is_producer ? i-nconsumers : i;
+        s->nitems = nitems;
+        s->batch = batch;
+        s->nproducers = nproducers;
+        s->workq = &workq;
+        s->seen = seen;
+        s->count = 0;
+        s->errors = 0;
+        if (is_producer)
+            pthread_create(&pthreads[s->id], NULL, stress_producer, s);
+        else
+            pthread_create(&cthreads[s->id], NULL, stress_consumer, s);
+    }
+    for (i = 0; i < nproducers; ++i)
+        pthread_join(pthreads[i], NULL);
+    workq_finish(&workq);
+    for (i = 0; i < nconsumers; ++i) {
+        pthread_join(cthreads[i], NULL);
+        count += consumers[i].count;
+        errors += consumers[i].errors;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+
+    for (missing = 0, v = 0; v < total; ++v)
+        if (atomic_load(&seen[v]) == 0)
+            ++missing;
+
+    printf("%d producers, %d consumers, batch %d, queue %zu: "
+           "%ld items in %.3f s (%.2f Mitems/s)\n",
+           nproducers, nconsumers, batch, workq.mask+1, count, t,
+           count / t / 1e6);
+    printf("%s: %ld taken, %ld missing, %ld duplicated or out of order\n",
+           (count == total && missing == 0 && errors == 0) ? "PASS" : "FAIL",
+           count, missing, errors);
+
+    workq_destroy(&workq);
+    free(seen);
+    return (count == total && missing == 0 && errors == 0) ? 0 : 1;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+        if (argc < 5) {
+            fprintf(stderr, "Usage: %s -s nproducers nconsumers nitems "
+                    "[batch [size]]\n", argv[0]);
+            return -1;
+        }
+        return run_stress(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]),
+                          argc > 5 ? atoi(argv[5]) : 1,
+                          argc > 6 ? atoi(argv[6]) : 256);
+    }
+
+    /* Get number of workers from command line */
+    return run_demo(argc > 1 ? atoi(argv[1]) : 1);
+}
@@ -0,0 +1,270 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench.h"
+
+static const char* counter_names[BENCH_NCOUNTERS] = {
+    "cycles", "instructions", "llc_misses"
+};
+
+static const uint64_t counter_events[BENCH_NCOUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES
+};
+
+
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+
+/*
+ * Open a user-space hardware counter for this process and the threads
+ * it creates later.  Returns -1 if counters are not available (no
+ * kernel support, a virtual machine, or perf_event_paranoid too high).
+ */
+static int open_counter(uint64_t event)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = event;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+
+static double median(double* x, int n)
+{
+    qsort(x, n, sizeof(double), compare_double);
+    return (n % 2) ? x[n/2] : (x[n/2-1] + x[n/2]) / 2;
+}
+
+
+void bench_init(bench_t* b, int* argc, char** argv)
+{
+    int i, j;
+    memset(b, 0, sizeof(*b));
+    b->warmup = 2;
+    b->trials = 20;
+
+    /* Take out the harness options, leaving the driver's own */
+    for (i = j = 1; i < *argc; ++i) {
+        if (strcmp(argv[i], "--warmup") == 0 && i+1 < *argc)
+            b->warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--trials") == 0 && i+1 < *argc)
+            b->trials = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--flush") == 0)
+            b->flush = 1;
+        else if (strcmp(argv[i], "--counters") == 0)
+            b->counters = 1;
+        else if (strcmp(argv[i], "--output") == 0 && i+1 < *argc)
+            b->output = argv[++i];
+        else
+            argv[j++] = argv[i];
+    }
+    *argc = j;
+    argv[j] = NULL;
+    if (b->trials < 1)
+        b->trials = 1;
+
+    for (i = 0; i < BENCH_NCOUNTERS; ++i)
+        b->fds[i] = b->counters ? open_counter(counter_events[i]) : -1;
+    if (b->counters && b->fds[0] < 0)
+        fprintf(stderr, "Hardware counters unavailable\n");
+
+    if (b->flush) {
+        /* Several times the last-level cache (or 64 MB if unknown) */
+        long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (llc <= 0)
+            llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        b->flushsize = (llc > 0) ? 4*llc : 64L << 20;
+        if (b->flushsize < (16L << 20))
+            b->flushsize = 16L << 20;
+        b->flushbuf = (char*) malloc(b->flushsize);
+    }
+}
+
+
+/* Keeps the flush loop from being optimized away */
+static volatile char sink;
+
+
+static void flush_caches(bench_t* b)
+{
+    char s = 0;
+    for (long i = 0; i < b->flushsize; i += 64) {
+        b->flushbuf[i] += 1;
+        s ^= b->flushbuf[i];
+    }
+    sink = s;
+}
+
+
+const bench_result_t* bench_run(bench_t* b, const char* name,
+                                void (*fn)(void*), void* arg,
+                                double flops, double bytes)
+{
+    int i, k;
+    int n = b->trials;
+    double* times = (double*) malloc(n * sizeof(double));
+    double* counts = (double*) malloc(n * BENCH_NCOUNTERS * sizeof(double));
+    bench_result_t* r;
+
+    if (b->nresults == b->maxresults) {
+        b->maxresults = b->maxresults ? 2*b->maxresults : 16;
+        b->results = (bench_result_t*)
+            realloc(b->results, b->maxresults * sizeof(bench_result_t));
+    }
+    r = b->results + b->nresults++;
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->trials = n;
+    r->flops = flops;
+    r->bytes = bytes;
+
+    for (i = 0; i < b->warmup; ++i)
+        fn(arg);
+
+    for (i = 0; i < n; ++i) {
+        double t0, t1;
+        if (b->flush)
+            flush_caches(b);
+        for (k = 0; k < BENCH_NCOUNTERS; ++k) {
+            if (b->fds[k] >= 0) {
+                ioctl(b->fds[k], PERF_EVENT_IOC_RESET, 0);
+                ioctl(b->fds[k], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+        t0 = wall_time();
+        fn(arg);
+        t1 = wall_time();
+        for (k = 0; k < BENCH_NCOUNTERS; ++k) {
+            uint64_t count;
+            counts[k*n+i] = -1;
+            if (b->fds[k] >= 0) {
+                ioctl(b->fds[k], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(b->fds[k], &count, sizeof(count)) == sizeof(count))
+                    counts[k*n+i] = (double) count;
+            }
+        }
+        times[i] = t1-t0;
+    }
+
+    r->tmin = times[0];
+    for (i = 0; i < n; ++i) {
+        r->tmean += times[i] / n;
+        if (times[i] < r->tmin)
+            r->tmin = times[i];
+    }
+    for (i = 0; i < n; ++i)
+        r->tstddev += (times[i]-r->tmean) * (times[i]-r->tmean);
+    r->tstddev = (n > 1) ? sqrt(r->tstddev / (n-1)) : 0;
+    r->tmedian = median(times, n);
+    for (k = 0; k < BENCH_NCOUNTERS; ++k)
+        r->counts[k] = median(counts + k*n, n);
+
+    printf("%s: median %e s (min %e, stddev %.2e)", r->name,
+           r->tmedian, r->tmin, r->tstddev);
+    if (flops > 0)
+        printf(", %g GFLop/s", flops / r->tmedian / 1e9);
+    if (bytes > 0)
+        printf(", %g GB/s", bytes / r->tmedian / 1e9);
+    if (r->counts[0] > 0 && r->counts[1] >= 0)
+        printf(", IPC %.2f", r->counts[1] / r->counts[0]);
+    printf("\n");
+
+    free(counts);
+    free(times);
+    return r;
+}
+
+
+static void write_results(bench_t* b)
+{
+    size_t len = strlen(b->output);
+    int json = (len > 5 && strcmp(b->output + len-5, ".json") == 0);
+    FILE* fp = fopen(b->output, "w");
+    int i, k;
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open results file: %s\n", b->output);
+        return;
+    }
+
+    if (json)
+        fprintf(fp, "[\n");
+    else
+        fprintf(fp, "name,trials,tmin,tmedian,tmean,tstddev,"
+                "gflops,gbytes,cycles,instructions,llc_misses\n");
+    for (i = 0; i < b->nresults; ++i) {
+        bench_result_t* r = b->results + i;
+        double gflops = r->flops / r->tmedian / 1e9;
+        double gbytes = r->bytes / r->tmedian / 1e9;
+        if (json) {
+            fprintf(fp, "  {\"name\": \"%s\", \"trials\": %d,"
+                    " \"tmin\": %e, \"tmedian\": %e, \"tmean\": %e,"
+                    " \"tstddev\": %e, \"gflops\": %g, \"gbytes\": %g",
+                    r->name, r->trials, r->tmin, r->tmedian, r->tmean,
+                    r->tstddev, gflops, gbytes);
+            for (k = 0; k < BENCH_NCOUNTERS; ++k) {
+                if (r->counts[k] >= 0)
+                    fprintf(fp, ", \"%s\": %.0f",
+                            counter_names[k], r->counts[k]);
+                else
+                    fprintf(fp, ", \"%s\": null", counter_names[k]);
+            }
+            fprintf(fp, "}%s\n", (i+1 < b->nresults) ? "," : "");
+        } else {
+            fprintf(fp, "%s,%d,%e,%e,%e,%e,%g,%g", r->name, r->trials,
+                    r->tmin, r->tmedian, r->tmean, r->tstddev,
+                    gflops, gbytes);
+            for (k = 0; k < BENCH_NCOUNTERS; ++k) {
+                if (r->counts[k] >= 0)
+                    fprintf(fp, ",%.0f", r->counts[k]);
+                else
+                    fprintf(fp, ",");
+            }
+            fprintf(fp, "\n");
+        }
+    }
+    if (json)
+        fprintf(fp, "]\n");
+    fclose(fp);
+}
+
+
+void bench_finish(bench_t* b)
+{
+    int k;
+    if (b->output)
+        write_results(b);
+    for (k = 0; k < BENCH_NCOUNTERS; ++k)
+        if (b->fds[k] >= 0)
+            close(b->fds[k]);
+    free(b->flushbuf);
+    free(b->results);
+}
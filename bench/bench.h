@@ -0,0 +1,63 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Micro-benchmark harness.  A driver sets up a harness with
+ * bench_init (which takes the harness options out of argv), times
+ * each kernel with bench_run, and writes the collected results with
+ * bench_finish.  Harness options:
+ *
+ *   --warmup N    untimed runs before timing (default 2)
+ *   --trials N    timed trials (default 20)
+ *   --flush       flush the caches before each trial
+ *   --counters    read cycles, instructions and LLC misses with
+ *                 perf_event_open (reported as missing if unavailable)
+ *   --output F    write results to F as JSON (if F ends in .json)
+ *                 or CSV (otherwise)
+ *
+ * Counters are inherited by threads created after bench_init, so
+ * call it before starting any OpenMP parallel region.
+ */
+
+#define BENCH_NCOUNTERS 3   /* Cycles, instructions, LLC misses */
+
+typedef struct bench_result_t {
+    char name[64];          /* Benchmark name */
+    int trials;             /* Number of timed trials */
+    double tmin;            /* Minimum time per trial (s) */
+    double tmedian;         /* Median time per trial (s) */
+    double tmean;           /* Mean time per trial (s) */
+    double tstddev;         /* Sample standard deviation (s) */
+    double flops;           /* Flops per trial (0 if not given) */
+    double bytes;           /* Bytes moved per trial (0 if not given) */
+    double counts[BENCH_NCOUNTERS];  /* Median counts per trial, or -1 */
+} bench_result_t;
+
+typedef struct bench_t {
+    int warmup;             /* Untimed runs before timing */
+    int trials;             /* Timed trials */
+    int flush;              /* Flush caches between trials? */
+    int counters;           /* Read hardware counters? */
+    const char* output;     /* Results file (NULL for none) */
+
+    int fds[BENCH_NCOUNTERS];    /* Counter file descriptors (-1 if none) */
+    char* flushbuf;              /* Buffer written to flush the caches */
+    long flushsize;
+    bench_result_t* results;     /* Results so far */
+    int nresults, maxresults;
+} bench_t;
+
+void bench_init(bench_t* b, int* argc, char** argv);
+
+/*
+ * Time fn(arg), given the flops and bytes moved per call (or 0), print
+ * a one-line summary, and record the result.  The returned pointer is
+ * valid until the next call.
+ */
+const bench_result_t* bench_run(bench_t* b, const char* name,
+                                void (*fn)(void*), void* arg,
+                                double flops, double bytes);
+
+void bench_finish(bench_t* b);
+
+#endif /* BENCH_H */
@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cache_params.h"
+
+
+/*
+ * Sizes the C library knows about (glibc reads them from cpuid or
+ * sysfs); zero where it does not
+ */
+int cache_params_sysconf(cache_params_t* p)
+{
+    long sizes[3] = {
+        sysconf(_SC_LEVEL1_DCACHE_SIZE),
+        sysconf(_SC_LEVEL2_CACHE_SIZE),
+        sysconf(_SC_LEVEL3_CACHE_SIZE)
+    };
+    int i;
+
+    memset(p, 0, sizeof(*p));
+    p->line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (p->line <= 0)
+        p->line = 64;
+    for (i = 0; i < 3 && sizes[i] > 0; ++i)
+        p->size[p->levels++] = sizes[i];
+    return p->levels;
+}
+
+
+int cache_params_load(cache_params_t* p, const char* fname)
+{
+    char line[256], key[64];
+    double value;
+    int level;
+    FILE* fp;
+
+    if (fname == NULL)
+        fname = getenv("CACHE_PARAMS");
+    if (fname == NULL)
+        fname = "cache.params";
+    fp = fopen(fname, "r");
+    if (fp == NULL) {
+        cache_params_sysconf(p);
+        return 1;
+    }
+
+    memset(p, 0, sizeof(*p));
+    p->line = 64;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%63s %lf", key, &value) != 2 || key[0] == '#')
+            continue;
+        if (strcmp(key, "line") == 0)
+            p->line = (long) value;
+        else if (strcmp(key, "levels") == 0)
+            p->levels = (int) value;
+        else {
+            /* L<i>_<field> or DRAM_<field> */
+            const char* field = strchr(key, '_');
+            int j;
+            if (field == NULL)
+                continue;
+            if (strncmp(key, "DRAM_", 5) == 0)
+                j = CACHE_MAXLEVELS;
+            else if (sscanf(key, "L%d_", &level) == 1 &&
+                     level >= 1 && level <= CACHE_MAXLEVELS)
+                j = level-1;
+            else
+                continue;
+            ++field;
+            if (strcmp(field, "size") == 0 && j < CACHE_MAXLEVELS)
+                p->size[j] = (long) value;
+            else if (strcmp(field, "latency_ns") == 0)
+                p->latency[j] = value;
+            else if (strcmp(field, "bandwidth_GBs") == 0)
+                p->bandwidth[j] = value;
+        }
+    }
+    fclose(fp);
+
+    if (p->levels < 0 || p->levels > CACHE_MAXLEVELS)
+        p->levels = 0;
+    /* DRAM is stored after the last cache level */
+    if (p->levels < CACHE_MAXLEVELS) {
+        p->latency[p->levels] = p->latency[CACHE_MAXLEVELS];
+        p->bandwidth[p->levels] = p->bandwidth[CACHE_MAXLEVELS];
+    }
+    return 0;
+}
+
+
+int cache_params_write(const cache_params_t* p, const char* fname)
+{
+    FILE* fp = fopen(fname, "w");
+    int i;
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open parameter file: %s\n", fname);
+        return -1;
+    }
+    fprintf(fp, "# Memory hierarchy parameters measured by membench\n");
+    fprintf(fp, "line %ld\n", p->line);
+    fprintf(fp, "levels %d\n", p->levels);
+    for (i = 0; i < p->levels; ++i) {
+        fprintf(fp, "L%d_size %ld\n", i+1, p->size[i]);
+        fprintf(fp, "L%d_latency_ns %.3g\n", i+1, p->latency[i]);
+        fprintf(fp, "L%d_bandwidth_GBs %.3g\n", i+1, p->bandwidth[i]);
+    }
+    fprintf(fp, "DRAM_latency_ns %.3g\n", p->latency[p->levels]);
+    fprintf(fp, "DRAM_bandwidth_GBs %.3g\n", p->bandwidth[p->levels]);
+    if (ferror(fp) | fclose(fp)) {
+        fprintf(stderr, "Error writing parameter file: %s\n", fname);
+        return -1;
+    }
+    return 0;
+}
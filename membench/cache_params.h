@@ -0,0 +1,48 @@
+#ifndef CACHE_PARAMS_H
+#define CACHE_PARAMS_H
+
+/*
+ * Measured memory hierarchy parameters.  membench writes these to a
+ * small text file of "key value" lines:
+ *
+ *   line 64
+ *   levels 3
+ *   L1_size 32768
+ *   L1_latency_ns 1.25
+ *   L1_bandwidth_GBs 95.1
+ *   ...
+ *   DRAM_latency_ns 88.4
+ *   DRAM_bandwidth_GBs 11.7
+ *
+ * and blocked kernels read them at startup with cache_params_load to
+ * pick their block sizes.  Unknown keys are ignored, so the file can
+ * be edited by hand or extended later.
+ */
+
+#define CACHE_MAXLEVELS 4
+
+typedef struct cache_params_t {
+    int levels;                  /* Cache levels (not counting DRAM) */
+    long line;                   /* Cache line size (bytes) */
+    long size[CACHE_MAXLEVELS];  /* Capacity of L1, L2, ... (bytes) */
+    double latency[CACHE_MAXLEVELS+1];    /* Load latency (ns); DRAM last */
+    double bandwidth[CACHE_MAXLEVELS+1];  /* Read bandwidth (GB/s); DRAM last */
+} cache_params_t;
+
+/*
+ * Read parameters from fname; if fname is NULL, use $CACHE_PARAMS or
+ * else "cache.params".  If there is no such file, fall back on what
+ * the C library reports (sysconf), with zero latencies and bandwidths.
+ * Returns 0 if the parameters came from a file, 1 for the fallback.
+ */
+int cache_params_load(cache_params_t* p, const char* fname);
+
+/*
+ * Just what the C library reports (sysconf): sizes, with zero
+ * latencies and bandwidths.  Returns the number of levels it knows.
+ */
+int cache_params_sysconf(cache_params_t* p);
+
+int cache_params_write(const cache_params_t* p, const char* fname);
+
+#endif /* CACHE_PARAMS_H */
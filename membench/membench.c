@@ -0,0 +1,513 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "cache_params.h"
+
+/*
+ * Memory hierarchy characterization.  Three sweeps over array sizes:
+ *
+ *   latency    chase pointers around a random cycle through the lines
+ *              of the array (each load depends on the last)
+ *   bandwidth  stream through the array, summing it
+ *   stride     the classic membench sweep: update every stride-th
+ *              byte of the array, for each power-of-two stride
+ *
+ * Each measurement is printed as a CSV line (mode, bytes, stride,
+ * ns per access, GB/s).  From the latency curve we find the plateaus
+ * (L1, L2, L3, DRAM), attach the streaming bandwidth of each, and
+ * write the result where cache_params_load will find it.
+ */
+
+#define STEPS_PER_OCTAVE 4
+#define MAX_POINTS 256
+#define TRIALS 3
+
+#define PLATEAU_RISE 1.5   /* Latency rise that ends a plateau */
+#define PLATEAU_FLAT 1.10  /* Step-to-step change within a plateau */
+#define LEVEL_MATCH 2.0    /* Slack in matching plateaus to cache sizes */
+
+enum { PAGES_SMALL, PAGES_TRANSPARENT, PAGES_RESERVED };
+
+
+typedef struct membench_t {
+    long minsize, maxsize;  /* Range of array sizes (bytes) */
+    long line;              /* Line size for the pointer chase */
+    double target;          /* Time per measurement (s) */
+    int pages;              /* PAGES_SMALL, _TRANSPARENT or _RESERVED */
+    char* buf;              /* Buffer for the largest array */
+    size_t bufsize;
+} membench_t;
+
+
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+
+/*
+ * Map the buffer.  By default it gets transparent huge pages, placed
+ * on a 2 MB boundary so that even the small arrays at its start are
+ * covered; otherwise the latency curve also steps wherever the arrays
+ * outgrow the reach of a TLB level, and those steps look just like
+ * caches.  PAGES_RESERVED first tries explicit 2 MB pages (MAP_HUGETLB,
+ * which needs pages reserved in /proc/sys/vm/nr_hugepages), and
+ * PAGES_SMALL keeps huge pages off, to see the TLB effects.  Except
+ * with small pages, size should be a multiple of 2 MB.
+ */
+static char* map_buffer(size_t size, int pages)
+{
+    const size_t huge = 2 << 20;
+    char* p;
+    size_t head;
+    if (pages == PAGES_RESERVED) {
+        p = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return p;
+        fprintf(stderr, "No reserved huge pages; trying transparent ones\n");
+    }
+    if (pages == PAGES_SMALL) {
+        p = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+        madvise(p, size, MADV_NOHUGEPAGE);
+        return p;
+    }
+
+    /* Map an extra huge page, and trim to a 2 MB boundary */
+    p = (char*) mmap(NULL, size + huge, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    head = (huge - (uintptr_t) p % huge) % huge;
+    if (head > 0)
+        munmap(p, head);
+    munmap(p + head + size, huge - head);
+    p += head;
+    madvise(p, size, MADV_HUGEPAGE);
+    return p;
+}
+
+
+/*
+ * Array sizes from minsize to maxsize, STEPS_PER_OCTAVE per factor of
+ * two, rounded to whole lines
+ */
+static int sweep_sizes(membench_t* mb, long* sizes, int per_octave)
+{
+    int n = 0;
+    long s0;
+    for (s0 = mb->minsize; s0 <= mb->maxsize && n < MAX_POINTS; s0 *= 2) {
+        int k;
+        for (k = 0; k < per_octave && n < MAX_POINTS; ++k) {
+            long s = (long) (s0 * (1.0 + (double) k / per_octave));
+            s -= s % mb->line;
+            if (s > mb->maxsize)
+                break;
+            sizes[n++] = s;
+        }
+    }
+    return n;
+}
+
+
+/*
+ * Time kernel(mb, size, stride, steps), doubling steps until a run
+ * takes the target time; return the best seconds per step of TRIALS
+ * such runs
+ */
+static double time_steps(membench_t* mb, long size, long stride,
+                         void (*kernel)(membench_t*, long, long, long))
+{
+    long steps = 1;
+    double best = 0;
+    int trial;
+
+    for (;;) {
+        double t0 = wall_time();
+        kernel(mb, size, stride, steps);
+        double t = wall_time() - t0;
+        if (t >= mb->target / TRIALS)
+            break;
+        steps *= (t > 0 && t < mb->target / TRIALS / 8) ? 8 : 2;
+    }
+    for (trial = 0; trial < TRIALS; ++trial) {
+        double t0 = wall_time();
+        kernel(mb, size, stride, steps);
+        double t = (wall_time() - t0) / steps;
+        if (trial == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+
+static volatile uint64_t sink;
+
+
+/*
+ * Link the lines of the first size bytes into one random cycle
+ * (Sattolo's algorithm), so the hardware prefetchers cannot guess
+ * the next line
+ */
+static void build_chase(membench_t* mb, long size)
+{
+    long n = size / mb->line;
+    long* order = (long*) malloc(n * sizeof(long));
+    uint64_t r = 0x9E3779B97F4A7C15ull;
+    long i;
+    for (i = 0; i < n; ++i)
+        order[i] = i;
+    for (i = n-1; i > 0; --i) {
+        long j, tmp;
+        r ^= r << 13;
+        r ^= r >> 7;
+        r ^= r << 17;
+        j = (long) (r % (uint64_t) i);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (i = 0; i < n; ++i)
+        *(char**) (mb->buf + order[i]*mb->line) =
+            mb->buf + order[(i+1) % n]*mb->line;
+    free(order);
+}
+
+
+static void chase_kernel(membench_t* mb, long size, long stride,
+                         long steps)
+{
+    char* p = mb->buf;
+    long i;
+    (void) size;
+    (void) stride;
+    for (i = 0; i < steps; ++i)
+        p = *(char**) p;
+    sink = (uint64_t) (uintptr_t) p;
+}
+
+
+static void read_kernel(membench_t* mb, long size, long stride,
+                        long steps)
+{
+    const uint64_t* a = (const uint64_t*) mb->buf;
+    long n = size / sizeof(uint64_t);
+    uint64_t s = 0;
+    long i, k;
+    (void) stride;
+    for (k = 0; k < steps; ++k)
+        for (i = 0; i < n; ++i)
+            s += a[i];
+    sink = s;
+}
+
+
+static void stride_kernel(membench_t* mb, long size, long stride,
+                          long steps)
+{
+    char* a = mb->buf;
+    long i, k;
+    for (k = 0; k < steps; ++k)
+        for (i = 0; i < size; i += stride)
+            a[i] += 1;
+}
+
+
+/*
+ * Median of x[i0..i1]
+ */
+static double median_range(const double* x, int i0, int i1)
+{
+    double y[MAX_POINTS];
+    int n = i1-i0+1;
+    int i, j;
+    for (i = 0; i < n; ++i) {
+        double v = x[i0+i];
+        for (j = i; j > 0 && y[j-1] > v; --j)
+            y[j] = y[j-1];
+        y[j] = v;
+    }
+    return (n % 2) ? y[n/2] : (y[n/2-1] + y[n/2]) / 2;
+}
+
+
+/*
+ * Group the latency curve into plateaus.  A plateau continues until
+ * two successive sizes are both more than PLATEAU_RISE above its
+ * lowest latency (so one noisy point does not end it); the next one
+ * starts, after any transition points, once two successive sizes
+ * agree to within PLATEAU_FLAT.  Plateaus of a single point are not
+ * counted, and neighbors whose median latencies are within
+ * PLATEAU_RISE of each other are merged.  Returns the number of
+ * plateaus, with the first and last points of each in starts[] and
+ * ends[].
+ */
+static int find_plateaus(const double* lat, int n, int* starts, int* ends,
+                         int maxp)
+{
+    int np = 0;
+    int start = 0;
+    double low = lat[0];
+    double level, last = 0;
+    int k;
+    for (k = 1; k <= n; ++k) {
+        if (k < n && (lat[k] <= PLATEAU_RISE * low ||
+                      (k+1 < n && lat[k+1] <= PLATEAU_RISE * low))) {
+            if (lat[k] < low)
+                low = lat[k];
+            continue;
+        }
+        level = (k-start >= 2) ? median_range(lat, start, k-1) : 0;
+        if (np > 0 && level > 0 && level <= PLATEAU_RISE * last) {
+            ends[np-1] = k-1;
+            last = median_range(lat, starts[np-1], k-1);
+        } else if (level > 0 && np < maxp) {
+            starts[np] = start;
+            ends[np++] = k-1;
+            last = level;
+        }
+        if (k == n)
+            break;
+        while (k+1 < n && lat[k+1] > PLATEAU_FLAT * lat[k])
+            ++k;
+        start = k;
+        low = lat[k];
+    }
+    return np;
+}
+
+
+/*
+ * Decide which plateaus are cache levels.  The last plateau is memory
+ * if it runs to the end of the sweep, or (when the sweep goes past
+ * LEVEL_MATCH times the largest cache the system reports) if it ends
+ * beyond that cache, as one noisy point at the end can cut it short.
+ * If the sweep stops short of LEVEL_MATCH times the largest cache,
+ * memory is not reached (*mem = -1).  Plateaus ending beyond LEVEL_MATCH
+ * times the largest cache are not caches either.  The rest are caches,
+ * unless there are more of them than the system reports levels: not
+ * every plateau is a cache (TLB reach, or a share of a cache, can make
+ * one too).  Then level l takes the plateau after level l-1's whose
+ * last size is nearest (by ratio) the level's reported size, leaving
+ * enough for the levels above, and the rest are dropped.  Sets
+ * level[] to the plateau of each level; returns the number of levels.
+ */
+static int match_levels(const cache_params_t* sys, long maxsize,
+                        const long* sizes, int n, const int* ends, int np,
+                        int* level, int* mem)
+{
+    long largest = (sys->levels > 0) ? sys->size[sys->levels-1] : 0;
+    int reached = (largest * LEVEL_MATCH <= maxsize);
+    int ncache = np, next = 0, l, p;
+
+    *mem = -1;
+    if (np > 0 && (ends[np-1] == n-1 ||
+                   (largest > 0 && reached && sizes[ends[np-1]] > largest))) {
+        ncache = np-1;
+        if (reached)
+            *mem = np-1;
+    }
+    while (largest > 0 && ncache > 0 &&
+           sizes[ends[ncache-1]] > LEVEL_MATCH * largest)
+        --ncache;
+    if (sys->levels == 0 || ncache <= sys->levels) {
+        for (l = 0; l < ncache && l < CACHE_MAXLEVELS; ++l)
+            level[l] = l;
+        return l;
+    }
+    for (l = 0; l < sys->levels; ++l) {
+        double best = HUGE_VAL;
+        for (p = next; p < ncache - (sys->levels-1 - l); ++p) {
+            double r = fabs(log((double) sizes[ends[p]] / sys->size[l]));
+            if (r < best) {
+                best = r;
+                level[l] = p;
+            }
+        }
+        next = level[l]+1;
+    }
+    return l;
+}
+
+
+static void print_usage_quit(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [-m lat|bw|stride|all] [-s minKB] [-S maxMB]"
+            " [-L line] [-t ms] [-H | -P] [-o params]\n", name);
+    exit(-1);
+}
+
+
+/*
+ * Options:
+ *   -m mode = which sweeps to run (default all; the cache parameters
+ *             are only written when the latency sweep runs)
+ *   -s min = smallest array in KB (default 4)
+ *   -S max = largest array in MB (default 256, or four times the
+ *            largest cache sysconf reports, so memory is reached)
+ *   -L line = line size for the pointer chase (default from sysconf)
+ *   -t ms = time per measurement in milliseconds (default 20)
+ *   -H = use reserved huge pages if there are any (default:
+ *        transparent huge pages)
+ *   -P = use small pages
+ *   -o params = cache parameter file (default cache.params)
+ */
+int main(int argc, char** argv)
+{
+    membench_t mb;
+    cache_params_t params, sys;
+    const char* mode = "all";
+    const char* pname = "cache.params";
+    long sizes[MAX_POINTS];
+    double lat[MAX_POINTS], bw[MAX_POINTS];
+    int do_lat, do_bw, do_stride;
+    int n, i;
+
+    memset(&mb, 0, sizeof(mb));
+    cache_params_sysconf(&sys);
+    mb.minsize = 4 << 10;
+    mb.maxsize = 256L << 20;
+    if (sys.levels > 0 && 4 * sys.size[sys.levels-1] > mb.maxsize)
+        mb.maxsize = 4 * sys.size[sys.levels-1];
+    mb.line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    mb.target = 20e-3;
+    mb.pages = PAGES_TRANSPARENT;
+    if (mb.line <= 0)
+        mb.line = 64;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-H") == 0)
+            mb.pages = PAGES_RESERVED;
+        else if (strcmp(argv[i], "-P") == 0)
+            mb.pages = PAGES_SMALL;
+        else if (*argv[i] == '-' && i+1 < argc) {
+            switch (argv[i][1]) {
+            case 'm': mode = argv[++i]; break;
+            case 's': mb.minsize = atol(argv[++i]) << 10; break;
+            case 'S': mb.maxsize = atol(argv[++i]) << 20; break;
+            case 'L': mb.line = atol(argv[++i]); break;
+            case 't': mb.target = atof(argv[++i]) * 1e-3; break;
+            case 'o': pname = argv[++i]; break;
+            default:
+                print_usage_quit(argv[0]);
+            }
+        } else {
+            print_usage_quit(argv[0]);
+        }
+    }
+    do_lat = strcmp(mode, "lat") == 0 || strcmp(mode, "all") == 0;
+    do_bw = strcmp(mode, "bw") == 0 || strcmp(mode, "all") == 0;
+    do_stride = strcmp(mode, "stride") == 0 || strcmp(mode, "all") == 0;
+    if (!(do_lat || do_bw || do_stride) || mb.line < (long) sizeof(char*) ||
+        (mb.line & (mb.line-1)) || mb.minsize < mb.line ||
+        mb.maxsize < mb.minsize || mb.target <= 0)
+        print_usage_quit(argv[0]);
+
+    mb.bufsize = mb.maxsize;
+    if (mb.pages != PAGES_SMALL)
+        mb.bufsize = (mb.bufsize + (2 << 20)-1) & ~(size_t) ((2 << 20)-1);
+    mb.buf = map_buffer(mb.bufsize, mb.pages);
+    if (mb.buf == NULL) {
+        fprintf(stderr, "Could not map %ld bytes\n", mb.maxsize);
+        return -1;
+    }
+    memset(mb.buf, 0, mb.bufsize);
+
+    printf("mode,bytes,stride,ns,gbs\n");
+    n = sweep_sizes(&mb, sizes, STEPS_PER_OCTAVE);
+    for (i = 0; do_lat && i < n; ++i) {
+        build_chase(&mb, sizes[i]);
+        lat[i] = 1e9 * time_steps(&mb, sizes[i], mb.line, chase_kernel);
+        printf("lat,%ld,%ld,%.3f,%.3f\n", sizes[i], mb.line, lat[i],
+               mb.line / lat[i]);
+        fflush(stdout);
+    }
+    for (i = 0; do_bw && i < n; ++i) {
+        double t = time_steps(&mb, sizes[i], sizeof(uint64_t), read_kernel);
+        bw[i] = sizes[i] / t / 1e9;
+        printf("bw,%ld,%d,%.3f,%.3f\n", sizes[i], (int) sizeof(uint64_t),
+               1e9 * t / (sizes[i] / sizeof(uint64_t)), bw[i]);
+        fflush(stdout);
+    }
+    if (do_stride) {
+        long size, stride;
+        for (size = mb.minsize; size <= mb.maxsize; size *= 2)
+            for (stride = 8; stride <= size/2; stride *= 2) {
+                double t = time_steps(&mb, size, stride, stride_kernel);
+                double ns = 1e9 * t / (size / stride);
+                printf("stride,%ld,%ld,%.3f,%.3f\n", size, stride, ns,
+                       (size / stride) * sizeof(char) / t / 1e9);
+                fflush(stdout);
+            }
+    }
+
+    if (do_lat) {
+        int starts[MAX_POINTS], ends[MAX_POINTS];
+        int level[CACHE_MAXLEVELS], used[MAX_POINTS];
+        int np = find_plateaus(lat, n, starts, ends, MAX_POINTS);
+        int mem, p;
+
+        memset(&params, 0, sizeof(params));
+        params.line = mb.line;
+        params.levels = match_levels(&sys, mb.maxsize, sizes, n, ends, np,
+                                     level, &mem);
+        memset(used, 0, sizeof(used));
+        for (i = 0; i <= params.levels; ++i) {
+            p = (i < params.levels) ? level[i] : mem;
+            if (p >= 0) {
+                used[p] = 1;
+                params.latency[i] = median_range(lat, starts[p], ends[p]);
+                if (do_bw)
+                    params.bandwidth[i] = median_range(bw, starts[p], ends[p]);
+            }
+            if (i < params.levels) {
+                /* The last size that still fits; sysconf is only a
+                   cross-check */
+                params.size[i] = sizes[ends[p]];
+                fprintf(stderr, "L%d: %ld bytes", i+1, params.size[i]);
+                if (i < sys.levels) {
+                    double r = (double) params.size[i] / sys.size[i];
+                    fprintf(stderr, " (sysconf %ld%s)", sys.size[i],
+                            (r < 1 / LEVEL_MATCH || r > LEVEL_MATCH) ?
+                            ", does not match" : "");
+                }
+                fprintf(stderr, ", ");
+            } else {
+                fprintf(stderr, "DRAM: ");
+            }
+            if (p < 0) {
+                fprintf(stderr, "not reached; try a larger -S\n");
+                continue;
+            }
+            fprintf(stderr, "%.2f ns", params.latency[i]);
+            if (do_bw)
+                fprintf(stderr, ", %.1f GB/s", params.bandwidth[i]);
+            fprintf(stderr, "\n");
+        }
+        for (i = params.levels; i < sys.levels; ++i)
+            fprintf(stderr, "sysconf reports L%d of %ld bytes; no plateau"
+                    " found for it\n", i+1, sys.size[i]);
+        for (p = 0; p < np; ++p)
+            if (!used[p])
+                fprintf(stderr, "Dropped plateau %ld-%ld bytes, %.2f ns:"
+                        " no matching cache level\n", sizes[starts[p]],
+                        sizes[ends[p]], median_range(lat, starts[p], ends[p]));
+        if (cache_params_write(&params, pname) < 0)
+            return -1;
+    }
+
+    munmap(mb.buf, mb.bufsize);
+    return 0;
+}